@@ -0,0 +1,68 @@
+//filename: affinity.c
+//Description: pinning of node threads to CPUs, see affinity.h
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "affinity.h"
+
+static int cpus[CPU_SETSIZE];       /* CPUs in the order nodes are given them */
+static int num_cpus;
+int affinity_on = 0;
+
+//the CPU list: "all" or comma separated CPUs and ranges
+int affinity_parse(const char *spec) {
+    num_cpus = 0;
+    if (!strcmp(spec, "all")) {
+        cpu_set_t set;
+        if (sched_getaffinity(0, sizeof(set), &set) < 0) {
+            perror("sched_getaffinity");
+            return 0;
+        }
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+            if (CPU_ISSET(c, &set)) cpus[num_cpus++] = c;
+        }
+    } else {
+        const char *p = spec;
+        while (*p) {
+            char *end;
+            long lo = strtol(p, &end, 10), hi = lo;
+            if (end == p) break;
+            if (*end == '-') {
+                p = end + 1;
+                hi = strtol(p, &end, 10);
+                if (end == p) break;
+            }
+            for (long c = lo; c <= hi && c >= 0 && c < CPU_SETSIZE && num_cpus < CPU_SETSIZE; c++) {
+                cpus[num_cpus++] = (int)c;
+            }
+            p = *end == ',' ? end + 1 : end;
+            if (*end && *end != ',') break;
+        }
+        if (*p || num_cpus == 0) {
+            fprintf(stderr, "Bad CPU list %s, expecting all or a list such as 0-7,16-23\n", spec);
+            return 0;
+        }
+    }
+    affinity_on = num_cpus > 0;
+    return affinity_on;
+}
+
+//node i gets the i-th CPU, wrapping around when there are more nodes than CPUs
+int affinity_pin(int node_id) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    int cpu = cpus[(node_id - 1) % num_cpus];
+    CPU_SET(cpu, &set);
+
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err) {
+        fprintf(stderr, "Node %d could not be pinned to CPU %d: %s\n", node_id, cpu, strerror(err));
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,28 @@
+//filename: affinity.h
+//Description: pinning of node threads to CPUs. Without it the node threads float across cores and
+//sockets; with it node i runs on the i-th CPU of the list (wrapping around), and as each node pins itself
+//before allocating anything, its processor_t, queues and the contexts it admits are first touched,
+//and so placed in memory, on its own socket.
+#ifndef PROSIM_AFFINITY_H
+#define PROSIM_AFFINITY_H
+
+//non-zero once a CPU list has been given
+extern int affinity_on;
+
+/* Sets the CPUs node threads are pinned to
+ * @params:
+ *   spec: "all" for every CPU the process may run on, in order, or a list such as 0-7,16-23
+ * @returns:
+ *   1 on success, 0 on a bad list (reported on stderr)
+ */
+extern int affinity_parse(const char *spec);
+
+/* Pins the calling thread to the CPU of node_id
+ * @params:
+ *   node_id: node the thread runs (1 based)
+ * @returns:
+ *   1 on success, 0 if the CPU could not be used (reported on stderr, the thread keeps floating)
+ */
+extern int affinity_pin(int node_id);
+
+#endif
@@ -4,6 +4,7 @@
 //The last arriver flips phase and wakes everyone waiting on the old phase
 
 #include "barrier.h"
+#include "instr.h"
 
 //This method initializes barrier states
 void barrier_init(barrier_t *b, int n) {
@@ -17,11 +18,34 @@ void barrier_init(barrier_t *b, int n) {
     b->phase = 0;
     b->max_threads = n; //threads that must arrive
     b->cur_threads = 0; //threads that have arrived
+    b->serial = NULL;
+}
+
+//the last arriver (or leaver) completes the phase: runs the serial step, flips phase and wakes the others.
+//caller holds the monitor
+static void _release(barrier_t *b) {
+    int my_phase = b->phase;
+    if (b->serial) {
+        b->serial();
+        b->serial = NULL;
+    }
+    b->cur_threads = 0;
+    b->phase ^= 1; //flip the phase
+    pthread_cond_broadcast(&b->cv[my_phase]); //wake everything waiting on last phase
 }
 
 //this method waits at the barrier. it increments arrival count and waits on cv if the last one hasn;t arrived
 void barrier_wait(barrier_t *b) {
+    barrier_wait_serial(b, NULL);
+}
+
+//waits at the barrier; whoever completes the phase runs serial while the others are still held
+void barrier_wait_serial(barrier_t *b, void (*serial)(void)) {
+    INSTR_TIMER(start);
     pthread_mutex_lock(&b->m); //enter monitor
+    if (serial) {
+        b->serial = serial;
+    }
 
     int my_phase = b->phase;
     b->cur_threads++;   //this thread arrived
@@ -33,12 +57,11 @@ void barrier_wait(barrier_t *b) {
         }
     } else {
         //last thread to arrive
-        b->cur_threads = 0;
-        b->phase ^= 1; //flip the phase
-        pthread_cond_broadcast(&b->cv[my_phase]); //wake everything waiting on last phase
+        _release(b);
     }
 
     pthread_mutex_unlock(&b->m); //leave monitor
+    INSTR_BARRIER(start);
 }
 
 //it signals that the last thread is done with the barrier.
@@ -51,10 +74,7 @@ void barrier_done(barrier_t *b) {
 
     //if the number of waiting threads (cur_threads) now equals new max we must release them
     if (b->cur_threads == b->max_threads && b->max_threads > 0) {
-        int my_phase = b->phase;
-        b->cur_threads = 0;
-        b->phase ^= 1;
-        pthread_cond_broadcast(&b->cv[my_phase]);   //release the waiting thread
+        _release(b);   //release the waiting threads
     }
 
     pthread_mutex_unlock(&b->m); //leave monitor
@@ -14,6 +14,7 @@ typedef struct {
     int phase;              //current phase: 0 or 1
     int max_threads;        //total number of threads expected at the barrier
     int cur_threads;        //# of threads waiting in this phase right now
+    void (*serial)(void);   //run by the thread that completes the current phase, if set
 } barrier_t;
 
 //initialize the barrier with an initial # of threads
@@ -22,6 +23,9 @@ void barrier_init(barrier_t *b, int n);
 //blocks until all current threads  arrive
 void barrier_wait(barrier_t *b);
 
+//like barrier_wait, but the thread that completes the phase runs serial before anyone is released
+void barrier_wait_serial(barrier_t *b, void (*serial)(void));
+
 //remove one thread from the barrier when done
 void barrier_done(barrier_t *b);
 
@@ -0,0 +1,80 @@
+#!/bin/bash
+# Runs the benchmark matrix in bench/matrix.txt against the optimized build and reports
+# simulated ticks per second, events (state changes) per second and peak RSS for each case.
+# Results are compared against bench/baseline.txt; a case that is more than BENCH_TOLERANCE
+# percent slower (or bigger) than its baseline is reported as a regression.
+#
+# usage: bench/bench.sh [-u]     -u rewrites the baseline with this run's results
+# env:   BENCH_RUNS (default 5, best run is kept), BENCH_TOLERANCE (default 25)
+
+export LC_ALL=C
+cd "$(dirname "$0")/.." || exit 1
+
+EXE=./prosim-opt
+GEN=./prosim-gen
+MATRIX=bench/matrix.txt
+BASELINE=bench/baseline.txt
+RUNS=${BENCH_RUNS:-5}
+TOLERANCE=${BENCH_TOLERANCE:-25}
+UPDATE=0
+
+if [ "$1" == "-u" ]; then
+	UPDATE=1
+fi
+
+if [ ! -x $EXE ] || [ ! -x $GEN ]; then
+	echo "Cannot find $EXE or $GEN, run make bench"
+	exit 1
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf $WORK' EXIT
+
+printf "%-14s %8s %10s %12s %14s %10s  %s\n" case ticks events ticks/s events/s rss_kb vs-baseline
+RESULTS=$WORK/results
+
+grep -v '^#' $MATRIX | while read -r name args; do
+	[ -z "$name" ] && continue
+	# anything after " -- " is passed to the simulator
+	sim_args=""
+	case "$args" in *" -- "*) sim_args=${args#* -- }; args=${args%% -- *} ;; esac
+	$GEN $args > $WORK/$name.in || exit 1
+
+	best_tps=0
+	for run in $(seq $RUNS); do
+		if ! timeout 300 $EXE -s $sim_args < $WORK/$name.in > /dev/null 2> $WORK/$name.stats; then
+			echo "$name: simulator failed"
+			exit 1
+		fi
+		# ticks N events N seconds S ticks/s T events/s E maxrss_kb R
+		read -r _ ticks _ events _ secs _ tps _ eps _ rss < $WORK/$name.stats
+		if awk -v a="$tps" -v b="$best_tps" 'BEGIN { exit !(a > b) }'; then
+			best_tps=$tps; best_eps=$eps; best_rss=$rss; best_ticks=$ticks; best_events=$events
+		fi
+	done
+
+	cmp=""
+	base=$(awk -v n="$name" '$1 == n { print $2, $3, $4 }' $BASELINE 2> /dev/null)
+	if [ -z "$base" ] && [ $UPDATE -eq 0 ]; then
+		cmp="no baseline, run make bench-baseline"
+	elif [ -n "$base" ] && [ $UPDATE -eq 0 ]; then
+		cmp=$(echo "$base" | awk -v t="$best_tps" -v e="$best_eps" -v r="$best_rss" -v tol="$TOLERANCE" '{
+			dt = 100 * (t - $1) / $1; de = 100 * (e - $2) / $2; dr = 100 * (r - $3) / $3;
+			flag = (dt < -tol || dr > tol) ? "  REGRESSION" : "";
+			printf "ticks/s %+.1f%% events/s %+.1f%% rss %+.1f%%%s", dt, de, dr, flag }')
+	fi
+	printf "%-14s %8d %10d %12.1f %14.1f %10d  %s\n" $name $best_ticks $best_events $best_tps $best_eps $best_rss "$cmp"
+	echo "$name $best_tps $best_eps $best_rss" >> $RESULTS
+	case "$cmp" in *REGRESSION*) echo "$name" >> $WORK/regressed ;; esac
+done || exit 1
+
+if [ $UPDATE -eq 1 ]; then
+	{
+		echo "# name ticks/s events/s rss_kb (written by bench/bench.sh -u on $(uname -m), $(nproc) cpus)"
+		cat $RESULTS
+	} > $BASELINE
+	echo "Baseline written to $BASELINE"
+elif [ -s $WORK/regressed ]; then
+	echo "Regressions (more than $TOLERANCE%): $(tr '\n' ' ' < $WORK/regressed)"
+	exit 1
+fi
@@ -0,0 +1,367 @@
+//filename: cache.c
+//Description: content-addressed result cache, see cache.h. A group's file holds its state lines and
+//summary rows as printed, each with the (time, node, pid) it is ordered by:
+//  prosim-cache 1 <# of programs>
+//  L <time> <node> <line>
+//  R <time> <node> <pid> <row>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "device.h"
+#include "sched.h"
+
+#define CACHE_MAX_NODES 101
+#define CACHE_VERSION   "prosim-cache 1"
+//the Makefile passes a checksum of the sources, so a rebuilt simulator does not replay old results
+#ifndef PROSIM_BUILD
+#define PROSIM_BUILD    __DATE__ " " __TIME__
+#endif
+#define CACHE_LINE_MAX  512
+#define FNV_OFFSET      14695981039346656037ULL
+#define FNV_PRIME       1099511628211ULL
+
+typedef struct cache_entry {
+    int time, node, pid;            /* what the entry is ordered by; pid is -1 for a state line */
+    int seq;                        /* keeps a node's lines of one tick in the order they were printed */
+    char *text;                     /* without the newline */
+} cache_entry_t;
+
+typedef struct cache_list {
+    cache_entry_t *e;
+    int n, cap;
+} cache_list_t;
+
+typedef struct cache_group {
+    unsigned long long key;
+    int num_procs;
+    int hit;                        /* found in the cache, not simulated */
+} cache_group_t;
+
+//what each node printed in this run: lines by the node's thread, rows by whoever streams the summary
+typedef struct cache_node {
+    cache_list_t lines;
+    cache_list_t rows;
+} __attribute__((aligned(64))) cache_node_t;
+
+static char *cache_dir;
+static unsigned long long salt = FNV_OFFSET;
+static int group_of[CACHE_MAX_NODES];
+static cache_group_t *groups;
+static int num_groups;
+static cache_node_t nodes[CACHE_MAX_NODES];
+static cache_list_t replay_lines, replay_rows;
+static int next_line, next_row;
+int cache_on = 0;
+int cache_settle = 0;
+
+static unsigned long long _fnv(unsigned long long h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+//byte by byte, so keys do not depend on the host's byte order
+static unsigned long long _fnv_int(unsigned long long h, int v) {
+    unsigned char b[4] = { v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff, (v >> 24) & 0xff };
+    return _fnv(h, b, 4);
+}
+
+static unsigned long long _fnv_str(unsigned long long h, const char *s) {
+    return _fnv(h, s, strlen(s) + 1);
+}
+
+static void _append(cache_list_t *l, int time, int node, int pid, const char *text) {
+    if (l->n == l->cap) {
+        l->cap = l->cap ? 2 * l->cap : 64;
+        l->e = realloc(l->e, l->cap * sizeof(cache_entry_t));
+        assert(l->e);
+    }
+    cache_entry_t *e = &l->e[l->n];
+    e->time = time;
+    e->node = node;
+    e->pid = pid;
+    e->seq = l->n++;
+    e->text = strdup(text);
+    assert(e->text);
+    char *nl = strchr(e->text, '\n');
+    if (nl) *nl = '\0';
+}
+
+//(time, node, pid) for rows, (time, node, seq) for lines, as the simulation prints them
+static int _cmp_entry(const void *a, const void *b) {
+    const cache_entry_t *x = a, *y = b;
+    if (x->time != y->time) return x->time < y->time ? -1 : 1;
+    if (x->node != y->node) return x->node < y->node ? -1 : 1;
+    if (x->pid != y->pid) return x->pid < y->pid ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+//creates the directory unless it is there already
+int cache_open(const char *dir) {
+    if (mkdir(dir, 0777) && errno != EEXIST) {
+        perror(dir);
+        return 0;
+    }
+    cache_dir = strdup(dir);
+    assert(cache_dir);
+    cache_param(CACHE_VERSION, PROSIM_BUILD);
+    cache_on = 1;
+    return 1;
+}
+
+void cache_param(const char *name, const char *value) {
+    salt = _fnv_str(salt, name);
+    salt = _fnv_str(salt, value);
+}
+
+int cache_file(const char *path) {
+    FILE *fin = fopen(path, "r");
+    if (!fin) {
+        return 0;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fin)) > 0) {
+        salt = _fnv(salt, buf, n);
+    }
+    fclose(fin);
+    return 1;
+}
+
+//union-find root, halving the path on the way
+static int _find(int *parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+static void _union(int *parent, int a, int b) {
+    a = _find(parent, a);
+    b = _find(parent, b);
+    if (a != b) {
+        if (a < b) parent[b] = a; else parent[a] = b;
+    }
+}
+
+static void _path(char *path, size_t len, unsigned long long key, const char *ext) {
+    snprintf(path, len, "%s/%016llx.%s", cache_dir, key, ext);
+}
+
+/* Reads a group's file into the replay lists
+ * @params:
+ *   g : the group
+ * @returns:
+ *   1 if the file is there and holds a row for every program of the group, 0 otherwise
+ */
+static int _load(cache_group_t *g) {
+    char path[CACHE_LINE_MAX], line[CACHE_LINE_MAX];
+    _path(path, sizeof(path), g->key, "grp");
+    FILE *fin = fopen(path, "r");
+    if (!fin) {
+        return 0;
+    }
+
+    int procs = -1;
+    cache_list_t lines = {0}, rows = {0};
+    if (fgets(line, sizeof(line), fin) && sscanf(line, CACHE_VERSION " %d", &procs) == 1) {
+        while (fgets(line, sizeof(line), fin)) {
+            int time, node, pid, at = 0;
+            if (sscanf(line, "L %d %d %n", &time, &node, &at) == 2 && at) {
+                _append(&lines, time, node, -1, line + at);
+            } else if (sscanf(line, "R %d %d %d %n", &time, &node, &pid, &at) == 3 && at) {
+                _append(&rows, time, node, pid, line + at);
+            } else {
+                procs = -1;
+                break;
+            }
+        }
+    }
+    fclose(fin);
+
+    int ok = procs == g->num_procs && rows.n == procs;
+    for (int i = 0; i < lines.n; i++) {
+        if (ok) {
+            _append(&replay_lines, lines.e[i].time, lines.e[i].node, -1, lines.e[i].text);
+        }
+        free(lines.e[i].text);
+    }
+    for (int i = 0; i < rows.n; i++) {
+        if (ok) {
+            _append(&replay_rows, rows.e[i].time, rows.e[i].node, rows.e[i].pid, rows.e[i].text);
+            if (rows.e[i].time > cache_settle) cache_settle = rows.e[i].time;
+        }
+        free(rows.e[i].text);
+    }
+    free(lines.e);
+    free(rows.e);
+    return ok;
+}
+
+/* Splits the nodes into groups that never interact, keys them and looks them up.
+ * A program listed after a later arrival is admitted with that later one, so its arrival is raised
+ * before the other groups' programs are taken out of the input.
+ */
+int cache_plan(context **procs, int num_procs, int num_threads) {
+    int parent[CACHE_MAX_NODES];
+    assert(num_threads < CACHE_MAX_NODES);
+    for (int i = 0; i < CACHE_MAX_NODES; i++) {
+        parent[i] = i;
+        group_of[i] = -1;
+    }
+
+    //node 0 stands for the shared devices and the collectives, whose processes are only known at run time
+    int latest = 0;
+    for (int i = 0; i < num_procs; i++) {
+        context *proc = procs[i];
+        if (proc->arrival < latest) proc->arrival = latest; else latest = proc->arrival;
+        for (opcode *op = proc->code; op->op != OP_HALT; op++) {
+            if ((op->op == OP_SEND || op->op == OP_RECV) && op->arg >= 100) {
+                int peer = op->arg / 100;
+                if (peer <= num_threads) {
+                    _union(parent, proc->thread, peer);
+                }
+            } else if ((op->op == OP_IO && device_shared(op->arg)) ||
+                       op->op == OP_BCAST || op->op == OP_GATHER || op->op == OP_ALLREDUCE) {
+                _union(parent, proc->thread, 0);
+            }
+        }
+    }
+
+    //groups are numbered by their first program, keyed by their nodes' policies and then their programs
+    groups = calloc(num_threads + 1, sizeof(cache_group_t));
+    assert(groups);
+    int root_group[CACHE_MAX_NODES];
+    memset(root_group, -1, sizeof(root_group));
+    for (int i = 0; i < num_procs; i++) {
+        int root = _find(parent, procs[i]->thread);
+        if (root_group[root] < 0) {
+            root_group[root] = num_groups;
+            groups[num_groups++].key = salt;
+        }
+        group_of[procs[i]->thread] = root_group[root];
+    }
+    for (int node = 1; node <= num_threads; node++) {
+        cache_group_t *g = group_of[node] >= 0 ? &groups[group_of[node]] : NULL;
+        if (g) {
+            g->key = _fnv_int(g->key, node);
+            g->key = _fnv_str(g->key, sched_for(node)->name);
+        }
+    }
+    for (int i = 0; i < num_procs; i++) {
+        context *proc = procs[i];
+        cache_group_t *g = &groups[group_of[proc->thread]];
+        g->key = _fnv_str(g->key, proc->name);
+        g->key = _fnv_int(g->key, proc->priority);
+        g->key = _fnv_int(g->key, proc->thread);
+        g->key = _fnv_int(g->key, proc->arrival);
+        g->key = _fnv_int(g->key, proc->code_size);
+        for (int k = 0; k < proc->code_size; k++) {
+            g->key = _fnv_int(g->key, proc->code[k].op);
+            g->key = _fnv_int(g->key, proc->code[k].arg);
+            g->key = _fnv_int(g->key, proc->code[k].size);
+            g->key = _fnv_int(g->key, proc->code[k].tag);
+            g->key = _fnv_int(g->key, proc->code[k].count);
+        }
+        g->num_procs++;
+    }
+
+    for (int i = 0; i < num_groups; i++) {
+        groups[i].hit = _load(&groups[i]);
+    }
+    qsort(replay_lines.e, replay_lines.n, sizeof(cache_entry_t), _cmp_entry);
+    qsort(replay_rows.e, replay_rows.n, sizeof(cache_entry_t), _cmp_entry);
+
+    int n = 0;
+    for (int i = 0; i < num_procs; i++) {
+        if (groups[group_of[procs[i]->thread]].hit) {
+            context_free(procs[i]);
+        } else {
+            procs[n++] = procs[i];
+        }
+    }
+    return n;
+}
+
+void cache_line(int node_id, int clock_time, const char *line) {
+    _append(&nodes[node_id].lines, clock_time, node_id, -1, line);
+}
+
+void cache_row(context *proc, const char *row) {
+    _append(&nodes[proc->thread].rows, proc->finished, proc->thread, proc->id, row);
+}
+
+//the lines of a tick come before its rows, as the rows are streamed at the end of the tick
+void cache_replay(int clock_time, int node_id, int pid, FILE *fout) {
+    cache_entry_t next = { clock_time, node_id, pid, 0, NULL };
+    while (next_line < replay_lines.n && replay_lines.e[next_line].time <= clock_time) {
+        fprintf(fout, "%s\n", replay_lines.e[next_line++].text);
+    }
+    while (next_row < replay_rows.n && _cmp_entry(&replay_rows.e[next_row], &next) < 0) {
+        fprintf(fout, "%s\n", replay_rows.e[next_row++].text);
+    }
+}
+
+//writes a group to a temporary file first, so an interrupted run leaves no partial entry
+static void _store(int gi) {
+    cache_group_t *g = &groups[gi];
+    char path[CACHE_LINE_MAX], tmp[CACHE_LINE_MAX];
+    _path(path, sizeof(path), g->key, "grp");
+    _path(tmp, sizeof(tmp), g->key, "tmp");
+    FILE *fout = fopen(tmp, "w");
+    if (!fout) {
+        perror(tmp);
+        return;
+    }
+    fprintf(fout, CACHE_VERSION " %d\n", g->num_procs);
+    for (int node = 1; node < CACHE_MAX_NODES; node++) {
+        if (group_of[node] != gi) {
+            continue;
+        }
+        for (int i = 0; i < nodes[node].lines.n; i++) {
+            cache_entry_t *e = &nodes[node].lines.e[i];
+            fprintf(fout, "L %d %d %s\n", e->time, e->node, e->text);
+        }
+        for (int i = 0; i < nodes[node].rows.n; i++) {
+            cache_entry_t *e = &nodes[node].rows.e[i];
+            fprintf(fout, "R %d %d %d %s\n", e->time, e->node, e->pid, e->text);
+        }
+    }
+    if (fclose(fout) || rename(tmp, path)) {
+        perror(path);
+        remove(tmp);
+    }
+}
+
+//a group with a process that did not finish deadlocked, and is left to be simulated again
+void cache_store(void) {
+    for (int gi = 0; gi < num_groups; gi++) {
+        if (groups[gi].hit) {
+            continue;
+        }
+        int rows = 0;
+        for (int node = 1; node < CACHE_MAX_NODES; node++) {
+            if (group_of[node] == gi) rows += nodes[node].rows.n;
+        }
+        if (rows == groups[gi].num_procs) {
+            _store(gi);
+        }
+    }
+}
+
+void cache_print(FILE *fout) {
+    int hits = 0;
+    for (int i = 0; i < num_groups; i++) {
+        hits += groups[i].hit;
+    }
+    fprintf(fout, "cache groups %d replayed %d simulated %d\n", num_groups, hits, num_groups - hits);
+}
@@ -0,0 +1,74 @@
+//filename: cache.h
+//Description: content-addressed cache of simulation results. The nodes are split into independent groups,
+//the connected components of the static SEND/RECV graph (nodes doing IO on a shared device are one
+//group). A group's results depend only on its own programs, so each group is keyed by an FNV-1a hash of
+//its programs' code, names, priorities, nodes and arrivals, its nodes' policies, the quantum, the
+//options that change the simulation and a checksum of the simulator's sources. A group found in the cache directory is not simulated again: its
+//state lines and summary rows are replayed in order with those of the groups that are.
+//
+//Groups are only stored when all of their programs finished; a group that deadlocks is simulated on
+//every run, and the deadlock is not declared before the last finish of the replayed groups, as it would
+//not be in a full run either.
+#ifndef PROSIM_CACHE_H
+#define PROSIM_CACHE_H
+
+#include <stdio.h>
+#include "context.h"
+
+//non-zero once a cache directory has been given
+extern int cache_on;
+
+//latest finish time among the replayed groups, 0 if none
+extern int cache_settle;
+
+/* Uses dir as the cache, creating it if needed
+ * @params:
+ *   dir : cache directory
+ * @returns:
+ *   1 on success, 0 if it cannot be created (reported on stderr)
+ */
+extern int cache_open(const char *dir);
+
+//mixes a setting that changes the simulation (an option and its value) into every key
+extern void cache_param(const char *name, const char *value);
+
+/* Mixes the contents of a file the simulation reads (devices, interconnect model) into every key
+ * @params:
+ *   path : the file
+ * @returns:
+ *   1 on success, 0 if it cannot be read
+ */
+extern int cache_file(const char *path);
+
+/* Splits the programs into node groups, looks each group up and drops the programs of the groups found
+ * @params:
+ *   procs       : every program, in input order; the kept ones are moved to the front
+ *   num_procs   : # of programs
+ *   num_threads : # of nodes
+ * @returns:
+ *   # of programs left to simulate
+ */
+extern int cache_plan(context **procs, int num_procs, int num_threads);
+
+//records a state line printed by node_id (owner thread only)
+extern void cache_line(int node_id, int clock_time, const char *line);
+
+//records the summary row of a finished process (under the summary lock)
+extern void cache_row(context *proc, const char *row);
+
+/* Prints the replayed state lines up to clock_time and the replayed rows that sort before (clock_time, node, pid)
+ * @params:
+ *   clock_time, node_id, pid : the next row to be printed by the simulation
+ *   fout : output file
+ * @returns:
+ *   none
+ */
+extern void cache_replay(int clock_time, int node_id, int pid, FILE *fout);
+
+//writes the groups simulated in this run whose programs all finished
+extern void cache_store(void);
+
+//one line: groups found, groups simulated
+extern void cache_print(FILE *fout);
+
+#endif
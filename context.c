@@ -2,13 +2,61 @@
 #include <string.h>
 #include <assert.h>
 #include "context.h"
+#include "device.h"
 
-static const char *OPS [] = {"HALT", "DOOP", "LOOP", "END", "BLOCK", "SEND", "RECV", NULL};
+static const char *OPS [] = {"HALT", "DOOP", "LOOP", "END", "BLOCK", "SEND", "RECV", "IO", "BCAST", "GATHER", "ALLREDUCE",
+                              NULL};
+
+int context_overhead_stats = 0;
+int context_collectives = 0;
 
 #define PUSH(s,v) (*(s++) = v)
 #define POP(s) (*(--s))
 #define PEEK(s) (*(s - 1))
 
+/* Reads an optional integer that follows on the same line.
+ * @params:
+ *   fin: FILE from which to read
+ *   val: where to store the integer if one is present
+ * @returns:
+ *   1 if an integer was read, 0 if the line ends (or something else follows) instead
+ */
+static int read_opt_int(FILE *fin, int *val) {
+    int c;
+    do {
+        c = fgetc(fin);
+    } while (c == ' ' || c == '\t' || c == '\r');
+
+    if (c == EOF) {
+        return 0;
+    }
+    ungetc(c, fin);
+    if (!(c == '-' || (c >= '0' && c <= '9'))) {
+        return 0;
+    }
+    return fscanf(fin, "%d", val) == 1;
+}
+
+/* Reads the word ANY if it is the next one.
+ * @params:
+ *   fin: FILE from which to read
+ * @returns:
+ *   1 if ANY was read, 0 if something else follows (only blanks are consumed, unless it starts with A)
+ */
+static int read_any(FILE *fin) {
+    int c;
+    do {
+        c = fgetc(fin);
+    } while (c == ' ' || c == '\t');
+
+    if (c != 'A') {
+        if (c != EOF) ungetc(c, fin);
+        return 0;
+    }
+    char rest[3];
+    return fscanf(fin, "%2[NY]", rest) == 1 && !strcmp(rest, "NY");
+}
+
 /* Move the instruction pointer to the next DOOP, BLOCK or HALT to be executed.
  * @params:
  *   cur: pointer to process context
@@ -22,6 +70,7 @@ extern context *context_load(FILE *fin) {
      */
     context *cur = calloc(1, sizeof(context));
     assert(cur);
+    cur->gang = -1;
 
     /* Read in the program description header and do some very basic validation
      * We assume it will be correct for the most part.
@@ -32,11 +81,19 @@ extern context *context_load(FILE *fin) {
         return NULL;
     }
 
+    /* The arrival time is optional, processes without one arrive at time 0
+     */
+    if (!read_opt_int(fin, &cur->arrival) || cur->arrival < 0) {
+        cur->arrival = 0;
+    }
+
     /* Allocate the primitive array and stack for the process.
      * We assume that the allocations will be successful.
      */
+    cur->code_size = size;
     cur->stack = malloc(2 * sizeof(int) * size);
     assert(cur->stack);
+    cur->stack_base = cur->stack;
 
     cur->code = malloc(size * sizeof(opcode));
     assert(cur->code);
@@ -64,17 +121,76 @@ extern context *context_load(FILE *fin) {
          * Apart from checking that the argument is an integer, no validation is done.
          */
         cur->code[i].op = -1;
+        cur->code[i].count = 0;
         for (int j = 0; OPS[j]; j++) {
             if (!strcmp(op, OPS[j])) {
                 cur->code[i].op = j;
+                //IO names a device, then the request size and optionally its position
+                if (j == OP_IO) {
+                    char dev[16];
+                    cur->code[i].tag = 0;
+                    if (fscanf(fin, "%15s %d", dev, &cur->code[i].size) < 2 ||
+                        (cur->code[i].arg = device_find(dev)) < 0) {
+                        fprintf(stderr, "Bad input: Expecting a known device and size on line %d in %s\n",
+                                i + 1, cur->name);
+                        return NULL;
+                    }
+                    read_opt_int(fin, &cur->code[i].tag);
+                    break;
+                }
+                //BCAST and GATHER name their root and how many take part, ALLREDUCE only how many;
+                //then the size each one's data has and the group, which keeps apart collectives whose
+                //processes are otherwise named the same
+                if (j == OP_BCAST || j == OP_GATHER || j == OP_ALLREDUCE) {
+                    cur->code[i].arg = MSG_ANY;
+                    cur->code[i].size = 0;
+                    cur->code[i].tag = 0;
+                    if ((j != OP_ALLREDUCE && (fscanf(fin, "%d", &cur->code[i].arg) < 1 || cur->code[i].arg < 0)) ||
+                        fscanf(fin, "%d", &cur->code[i].count) < 1 || cur->code[i].count < 1) {
+                        fprintf(stderr, "Bad input: Expecting %s on line %d in %s\n",
+                                j == OP_ALLREDUCE ? "a count" : "a root and a count", i + 1, cur->name);
+                        return NULL;
+                    }
+                    if (read_opt_int(fin, &cur->code[i].size)) {
+                        if (cur->code[i].size < 0) {
+                            cur->code[i].size = 0;
+                        }
+                        if (read_opt_int(fin, &cur->code[i].tag) && cur->code[i].tag < 0) {
+                            cur->code[i].tag = 0;
+                        }
+                    }
+                    context_collectives = 1;
+                    break;
+                }
+                //RECV may take its message from ANY source
+                if (j == OP_RECV && read_any(fin)) {
+                    cur->code[i].arg = MSG_ANY;
                 //LOOP, DOOP, BLOCK, SEND, RECV have integer argument
-                if (j == OP_LOOP || j == OP_DOOP || j == OP_BLOCK || j == OP_SEND || j == OP_RECV) {
+                } else if (j == OP_LOOP || j == OP_DOOP || j == OP_BLOCK || j == OP_SEND || j == OP_RECV) {
                     if (fscanf(fin, "%d", &cur->code[i].arg) < 1) {
                         fprintf(stderr, "Bad input: Expecting argument to op on line %d in %s\n",
                                 i + 1, cur->name);
                         return NULL;
                     }
                 }
+                //SEND may give the message size, which only matters under an interconnect model,
+                //and then a tag; RECV may give the tag it takes, otherwise any tag matches
+                cur->code[i].size = 0;
+                cur->code[i].tag = j == OP_RECV ? MSG_ANY : 0;
+                if (j == OP_SEND && read_opt_int(fin, &cur->code[i].size)) {
+                    if (cur->code[i].size < 0) {
+                        cur->code[i].size = 0;
+                    }
+                    if (read_opt_int(fin, &cur->code[i].tag) && cur->code[i].tag < 0) {
+                        cur->code[i].tag = 0;
+                    }
+                } else if (j == OP_RECV && read_opt_int(fin, &cur->code[i].tag) && cur->code[i].tag < 0) {
+                    cur->code[i].tag = MSG_ANY;
+                }
+                //DOOP may give a deadline, relative to when it becomes ready
+                if (j == OP_DOOP && read_opt_int(fin, &cur->code[i].size) && cur->code[i].size < 0) {
+                    cur->code[i].size = 0;
+                }
                 break;
             }
         }
@@ -126,6 +242,12 @@ extern int context_next_op(context *cur) {
                 return 1;
             case OP_RECV:
                 return 1;
+            case OP_IO:
+                return 1;
+            case OP_BCAST:
+            case OP_GATHER:
+            case OP_ALLREDUCE:
+                return 1;
             case OP_END:
                 /* The top of stack contains current loop info.
                  * Number of iterations is one-less now.
@@ -153,6 +275,46 @@ extern int context_next_op(context *cur) {
     }
 }
 
+/* Moves a context, its primitive array and its stack into memory allocated (and written) by the
+ * calling thread. The stack pointer keeps its depth.
+ * @params:
+ *   cur: pointer to process context
+ * @returns:
+ *   pointer to the new copy
+ */
+extern context *context_relocate(context *cur) {
+    context *copy = malloc(sizeof(context));
+    assert(copy);
+    *copy = *cur;
+
+    copy->code = malloc(cur->code_size * sizeof(opcode));
+    assert(copy->code);
+    memcpy(copy->code, cur->code, cur->code_size * sizeof(opcode));
+
+    copy->stack_base = malloc(2 * sizeof(int) * cur->code_size);
+    assert(copy->stack_base);
+    memcpy(copy->stack_base, cur->stack_base, 2 * sizeof(int) * cur->code_size);
+    copy->stack = copy->stack_base + (cur->stack - cur->stack_base);
+
+    context_free(cur);
+    return copy;
+}
+
+/* Frees a context and its primitive array and stack.
+ * @params:
+ *   cur: pointer to process context
+ * @returns:
+ *   none
+ */
+extern void context_free(context *cur) {
+    if (!cur) {
+        return;
+    }
+    free(cur->code);
+    free(cur->stack_base);
+    free(cur);
+}
+
 /* returns the duration of the current primitive.
  * @params:
  *   cur: pointer to process context
@@ -164,6 +326,50 @@ extern int context_cur_duration(context *cur) {
     return cur->code[cur->ip].arg;
 }
 
+/* returns the message size of the current primitive.
+ * @params:
+ *   cur: pointer to process context
+ * @returns:
+ *   the size operand of a SEND, 0 otherwise
+ */
+extern int context_cur_size(context *cur) {
+    assert(cur->ip >= 0);
+    return cur->code[cur->ip].size;
+}
+
+/* returns the relative deadline of the current primitive.
+ * @params:
+ *   cur: pointer to process context
+ * @returns:
+ *   the deadline operand of a DOOP, 0 otherwise
+ */
+extern int context_cur_deadline(context *cur) {
+    assert(cur->ip >= 0);
+    return cur->code[cur->ip].op == OP_DOOP ? cur->code[cur->ip].size : 0;
+}
+
+/* returns the message tag of the current primitive.
+ * @params:
+ *   cur: pointer to process context
+ * @returns:
+ *   the tag of a SEND or RECV
+ */
+extern int context_cur_tag(context *cur) {
+    assert(cur->ip >= 0);
+    return cur->code[cur->ip].tag;
+}
+
+/* returns the # of processes taking part in the current primitive.
+ * @params:
+ *   cur: pointer to process context
+ * @returns:
+ *   the count of a BCAST, GATHER or ALLREDUCE, 0 otherwise
+ */
+extern int context_cur_count(context *cur) {
+    assert(cur->ip >= 0);
+    return cur->code[cur->ip].count;
+}
+
 /* Returns the current primitive being executed
  * @params:
  *   cur: pointer to process context
@@ -183,6 +389,12 @@ extern int context_cur_op(context *cur) {
  *   none
  */
 extern void context_stats(context *cur, FILE *fout) {
+    if (context_overhead_stats) {
+        fprintf(fout,"| %5.5d | Proc %2.2d.%2.2d | Run %d, Block %d, Wait %d, Sends %d, Recvs %d, Switches %d, Overhead %d\n",
+                cur->finished, cur->thread, cur->id, cur->doop_time, cur->block_time,
+                cur->wait_time, cur->send_count, cur->recv_count, cur->switch_count, cur->overhead_time);
+        return;
+    }
     fprintf(fout,"| %5.5d | Proc %2.2d.%2.2d | Run %d, Block %d, Wait %d, Sends %d, Recvs %d\n",
             cur->finished, cur->thread, cur->id, cur->doop_time, cur->block_time,
             cur->wait_time, cur->send_count, cur->recv_count);
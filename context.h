@@ -3,17 +3,29 @@
 
 #include <stdio.h>
 enum {
-    OP_HALT, OP_DOOP, OP_LOOP, OP_END, OP_BLOCK, OP_SEND, OP_RECV, OP_LAST
+    OP_HALT, OP_DOOP, OP_LOOP, OP_END, OP_BLOCK, OP_SEND, OP_RECV, OP_IO, OP_BCAST, OP_GATHER, OP_ALLREDUCE,
+    OP_LAST
 };
 
+//RECV source or tag that matches any
+#define MSG_ANY (-1)
+
 typedef struct opcode {
     int op;                     /* primitive op code (see enum above) */
-    int arg;                    /* argument value associated with the op code */
+    int arg;                    /* argument value associated with the op code (MSG_ANY for RECV ANY, device for IO,
+                                   the root of a BCAST/GATHER, MSG_ANY for ALLREDUCE) */
+    int size;                   /* message size, SEND's optional second operand (0 if not given), IO's size,
+                                   or DOOP's relative deadline (0 if not given) */
+    int tag;                    /* message tag: SEND's third operand (default 0), RECV's second (default MSG_ANY),
+                                   IO's position (default 0) or a collective's group (default 0) */
+    int count;                  /* # of processes taking part in a collective */
 } opcode;
 
 typedef struct context {
     opcode *code;               /* array of primitives */
+    int code_size;              /* # of primitives */
     int *stack;                 /* stack for processing loops */
+    int *stack_base;            /* start of the stack allocation */
     char name[11];              /* program name */
     int ip;                     /* index of current primitive being executed */
     int id;                     /* process id */
@@ -28,14 +40,36 @@ typedef struct context {
     int wait_count;             /* number of times process is added to the ready queue */
     int wait_time;              /* number of clock ticks spent waiting in ready queue */
     int thread;                 /* node id to which process is to be assigned */
+    int node;                   /* node it runs on: thread, or the node that stole it */
     int finished;               /* time process finished */
-    int send_count;             /* number of SENDs performed */
-    int recv_count;             /* number of RECVs performed */
+    int send_count;             /* number of SENDs performed (and collectives it gave data to) */
+    int recv_count;             /* number of RECVs performed (and collectives it got data from) */
+    int arrival;                /* clock tick at which the process is admitted (0 if not given) */
+    int admitted;               /* time process was admitted */
+    int first_run;              /* time process was first dispatched, -1 until then */
+    int addr;                   /* message address (node*100 + pid at admission), 0 if unreachable */
+    int slice_state;            /* state whose timeline slice is open */
+    int slice_start;            /* time that slice started */
+    int switch_count;           /* dispatches onto a core that last ran another process */
+    int overhead_time;          /* clock ticks spent in dispatch and switch overhead */
+    int gang;                   /* gang the process is co-scheduled with, -1 if none */
+    int msg_time;               /* time the current SEND/RECV was issued */
+    int deadline;               /* time the current op should be done by (EDF) */
+    int level;                  /* MLFQ level, 0 is the top */
+    int level_used;             /* ticks used at that level */
+    int level_epoch;            /* MLFQ boost the level is from */
+    long long vruntime;         /* CFS virtual runtime */
 } context;
 
-/* Move the instruction pointer to the next DOOP, BLOCK, SEND, RECV or HALT to be executed.
+//non-zero to add switch counts and overhead to the stats line (set when overhead costs are modeled)
+extern int context_overhead_stats;
+
+//non-zero once a program with a BCAST, GATHER or ALLREDUCE has been loaded
+extern int context_collectives;
+
+/* Move the instruction pointer to the next DOOP, BLOCK, SEND, RECV, IO, collective or HALT to be executed.
  * @returns:
- *   1 if DOOP/BLOCK/SEND/RECV is the next primitive.
+ *   1 if DOOP/BLOCK/SEND/RECV/IO or a collective is the next primitive.
  *   0 if HALT is the next primitive
  *  -1 if unknown primitive encountered.
  */
@@ -49,6 +83,24 @@ extern int context_next_op(context *cur);
  */
 extern context *context_load(FILE *fin);
 
+/* Moves a context, its primitive array and its stack into memory allocated by the calling thread,
+ * so that their pages are first touched on that thread's CPU. The old copy is freed.
+ * Only for contexts that nothing else points to yet (before process_admit).
+ * @params:
+ *   cur: pointer to process context
+ * @returns:
+ *   pointer to the new copy
+ */
+extern context *context_relocate(context *cur);
+
+/* Frees a context and its primitive array and stack.
+ * @params:
+ *   cur: pointer to process context
+ * @returns:
+ *   none
+ */
+extern void context_free(context *cur);
+
 /* Outputs aggregate statistics about a process to the specified file.
  * @params:
  *   cur: pointer to process context
@@ -66,6 +118,38 @@ extern void context_stats(context *cur, FILE *fout);
  */
 extern int context_cur_duration(context *cur);
 
+/* Returns the message size of the current primitive
+ * @params:
+ *   cur: pointer to process context
+ * @returns:
+ *   the size given to a SEND, 0 if none was given or the primitive is not a SEND
+ */
+extern int context_cur_size(context *cur);
+
+/* Returns the relative deadline of the current primitive
+ * @params:
+ *   cur: pointer to process context
+ * @returns:
+ *   the deadline given to a DOOP, 0 if none was given or the primitive is not a DOOP
+ */
+extern int context_cur_deadline(context *cur);
+
+/* Returns the message tag of the current primitive
+ * @params:
+ *   cur: pointer to process context
+ * @returns:
+ *   the tag of a SEND or RECV (MSG_ANY for a RECV that takes any tag)
+ */
+extern int context_cur_tag(context *cur);
+
+/* Returns the # of processes taking part in the current primitive
+ * @params:
+ *   cur: pointer to process context
+ * @returns:
+ *   the count given to a BCAST, GATHER or ALLREDUCE, 0 for other primitives
+ */
+extern int context_cur_count(context *cur);
+
 /* Returns the current primitive being executed
  * @params:
  *   cur: pointer to process context
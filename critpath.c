@@ -0,0 +1,213 @@
+//filename: critpath.c
+//Description: critical path analysis across SEND/RECV dependencies, see critpath.h
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "critpath.h"
+
+#define CP_MAX_NODES 101
+
+typedef struct cp_interval {
+    int start;                  /* first tick; it ends where the next interval starts */
+    int kind;                   /* CP_ kind */
+    int edge;                   /* index into edges if a partner released it, -1 otherwise */
+} cp_interval_t;
+
+typedef struct cp_edge {
+    struct cp_proc *partner;    /* process whose arrival completed the rendezvous */
+    int index;                  /* interval of the partner that ends at the rendezvous */
+    int time;                   /* clock of the rendezvous */
+} cp_edge_t;
+
+typedef struct cp_proc {
+    cp_interval_t *iv;          /* closed intervals, zero length ones are dropped */
+    int n, cap;
+    cp_edge_t *edges;
+    int nedges, edges_cap;
+    int kind;                   /* kind of the open interval */
+    int start;                  /* start of the open interval */
+    int end;                    /* finish time, -1 while running */
+    int node, pid;
+    cp_edge_t pending;          /* release recorded by the partner, applied when the interval closes */
+    int released;
+} cp_proc_t;
+
+typedef struct cp_node {
+    cp_proc_t **procs;          /* indexed by pid, only grown by the owning node */
+    int cap;
+} __attribute__((aligned(64))) cp_node_t;
+
+static cp_node_t nodes[CP_MAX_NODES];
+static pthread_mutex_t last_lock = PTHREAD_MUTEX_INITIALIZER;
+static cp_proc_t *last;         /* latest finisher, ties to the lowest node and pid */
+int critpath_on = 0;
+
+static const char *kinds[] = {"compute", "queueing", "block", "message wait", "before arrival"};
+
+//turns on recording
+void critpath_enable(void) {
+    critpath_on = 1;
+}
+
+//record of a process, created when it is admitted
+static cp_proc_t *_proc(int node_id, int pid) {
+    cp_node_t *n = &nodes[node_id];
+    if (pid >= n->cap) {
+        int cap = n->cap ? n->cap : 64;
+        while (cap <= pid) cap *= 2;
+        n->procs = realloc(n->procs, cap * sizeof(cp_proc_t *));
+        assert(n->procs);
+        memset(n->procs + n->cap, 0, (cap - n->cap) * sizeof(cp_proc_t *));
+        n->cap = cap;
+    }
+    if (!n->procs[pid]) {
+        cp_proc_t *p = calloc(1, sizeof(cp_proc_t));
+        assert(p);
+        p->kind = CP_NONE;
+        p->end = -1;
+        p->node = node_id;
+        p->pid = pid;
+        n->procs[pid] = p;
+    }
+    return n->procs[pid];
+}
+
+//closes the open interval and opens one of the new kind
+void critpath_state(int node_id, int pid, int kind, int clock_time, int finished) {
+    cp_proc_t *p = _proc(node_id, pid);
+
+    if (p->kind != CP_NONE && clock_time > p->start) {
+        if (p->n == p->cap) {
+            p->cap = p->cap ? 2 * p->cap : 16;
+            p->iv = realloc(p->iv, p->cap * sizeof(cp_interval_t));
+            assert(p->iv);
+        }
+        cp_interval_t *iv = &p->iv[p->n++];
+        iv->start = p->start;
+        iv->kind = p->kind;
+        iv->edge = -1;
+
+        if (p->kind == CP_MESSAGE && p->released) {
+            if (p->nedges == p->edges_cap) {
+                p->edges_cap = p->edges_cap ? 2 * p->edges_cap : 8;
+                p->edges = realloc(p->edges, p->edges_cap * sizeof(cp_edge_t));
+                assert(p->edges);
+            }
+            p->edges[p->nedges] = p->pending;
+            iv->edge = p->nedges++;
+        }
+    }
+    p->released = 0;
+    p->kind = kind;
+    p->start = clock_time;
+
+    if (finished) {
+        p->end = clock_time;
+        pthread_mutex_lock(&last_lock);
+        if (!last || p->end > last->end ||
+            (p->end == last->end && (p->node < last->node || (p->node == last->node && p->pid < last->pid)))) {
+            last = p;
+        }
+        pthread_mutex_unlock(&last_lock);
+    }
+}
+
+//the matcher's interval in progress (running) is the next one it will close
+void critpath_release(int waiter_addr, int matcher_node, int matcher_pid, int clock_time) {
+    cp_proc_t *w = _proc(waiter_addr / 100, waiter_addr % 100);
+    cp_proc_t *m = _proc(matcher_node, matcher_pid);
+
+    w->pending.partner = m;
+    w->pending.index = m->n;
+    w->pending.time = clock_time;
+    w->released = 1;
+}
+
+typedef struct cp_seg {
+    cp_proc_t *proc;
+    int kind;
+    int start, end;
+} cp_seg_t;
+
+//prepends [start, end) to the path, merging with the previous segment when it continues it
+static void _seg(cp_seg_t **segs, int *n, int *cap, cp_proc_t *p, int kind, int start, int end,
+                 long long *total) {
+    if (end <= start) {
+        return;
+    }
+    total[kind] += end - start;
+    if (*n > 0) {
+        cp_seg_t *s = &(*segs)[*n - 1];
+        if (s->proc == p && s->kind == kind && s->start == end) {
+            s->start = start;
+            return;
+        }
+    }
+    if (*n == *cap) {
+        *cap = *cap ? 2 * *cap : 64;
+        *segs = realloc(*segs, *cap * sizeof(cp_seg_t));
+        assert(*segs);
+    }
+    (*segs)[(*n)++] = (cp_seg_t){p, kind, start, end};
+}
+
+/* Walk the critical path and print it
+ * Starting at the finish of the last process, intervals are consumed backwards; a message wait that
+ * a partner ended continues on the partner from the rendezvous. Time only moves backwards, so each
+ * interval is looked at once.
+ * @params:
+ *   fout : output file
+ * @returns:
+ *   none
+ */
+void critpath_print(FILE *fout) {
+    long long total[CP_NONE] = {0};
+    cp_seg_t *segs = NULL;
+    int nsegs = 0, cap = 0;
+
+    if (!last) {
+        fprintf(fout, "Critical path: no process finished\n");
+        return;
+    }
+
+    cp_proc_t *p = last;
+    int i = p->n - 1;
+    int t = p->end;
+    while (t > 0) {
+        if (i < 0) {
+            _seg(&segs, &nsegs, &cap, p, CP_ARRIVAL, 0, t, total);
+            break;
+        }
+        cp_interval_t *iv = &p->iv[i];
+        if (iv->start >= t) {
+            i--;
+            continue;
+        }
+        if (iv->edge >= 0 && p->edges[iv->edge].time > iv->start && p->edges[iv->edge].time < t) {
+            cp_edge_t *e = &p->edges[iv->edge];
+            _seg(&segs, &nsegs, &cap, p, CP_MESSAGE, e->time, t, total);
+            t = e->time;
+            p = e->partner;
+            i = e->index < p->n ? e->index : p->n - 1;
+            continue;
+        }
+        _seg(&segs, &nsegs, &cap, p, iv->kind, iv->start, t, total);
+        t = iv->start;
+        i--;
+    }
+
+    fprintf(fout, "Critical path: makespan %d, ends with process %2.2d.%2.2d\n", last->end, last->node, last->pid);
+    for (int k = 0; k < CP_NONE; k++) {
+        fprintf(fout, "%-15s %8lld  %5.1f%%\n", kinds[k], total[k],
+                last->end ? 100.0 * total[k] / last->end : 0.0);
+    }
+    fprintf(fout, "Segments (oldest first):\n");
+    for (int k = nsegs - 1; k >= 0; k--) {
+        fprintf(fout, "| %5.5d - %5.5d | %2.2d.%2.2d | %s\n", segs[k].start, segs[k].end,
+                segs[k].proc->node, segs[k].proc->pid, kinds[segs[k].kind]);
+    }
+    free(segs);
+}
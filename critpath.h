@@ -0,0 +1,37 @@
+//filename: critpath.h
+//Description: critical path analysis. Every process' state intervals are recorded as it moves, plus a
+//happens-before edge whenever a process blocked in SEND/RECV is released by its partner arriving.
+//After the run the path that sets the makespan is walked backwards from the last process to finish,
+//following the edges into the partners, in time linear in the number of recorded intervals.
+#ifndef PROSIM_CRITPATH_H
+#define PROSIM_CRITPATH_H
+
+#include <stdio.h>
+
+//what a process is doing during an interval
+enum {
+    CP_COMPUTE = 0,     /* running */
+    CP_QUEUE,           /* waiting in the ready queue */
+    CP_BLOCK,           /* in a BLOCK */
+    CP_MESSAGE,         /* blocked in SEND or RECV */
+    CP_ARRIVAL,         /* not admitted yet (only used on the path) */
+    CP_NONE             /* new or finished, nothing is recorded */
+};
+
+//non-zero once critpath_enable has been called; hooks are skipped otherwise
+extern int critpath_on;
+
+//turns on recording for the run
+extern void critpath_enable(void);
+
+//process pid on node entered a state of the given CP_ kind at clock_time; finished processes pass CP_NONE
+extern void critpath_state(int node_id, int pid, int kind, int clock_time, int finished);
+
+//the process at waiter_addr (node*100 + pid) was released at clock_time by matcher_pid on matcher_node
+//arriving at the rendezvous. called by the matcher's node while the waiter is still blocked
+extern void critpath_release(int waiter_addr, int matcher_node, int matcher_pid, int clock_time);
+
+//walks the critical path and prints its attribution and segments
+extern void critpath_print(FILE *fout);
+
+#endif
@@ -0,0 +1,297 @@
+//filename: device.c
+//Description: I/O device model, see device.h
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "device.h"
+#include "prio_q.h"
+
+#define DEV_MAX       16
+#define DEV_MAX_NODES 101
+
+enum { DEV_FIFO, DEV_SSTF, DEV_PARALLEL };
+static const char *disciplines[] = {"fifo", "sstf", "parallel", NULL};
+
+typedef struct dev_req {
+    context *proc;
+    int node;                   /* node the process waits on */
+    int submit;                 /* tick it was submitted */
+    int pos;                    /* position, for SSTF */
+    int left;                   /* size still to serve */
+    long long order;            /* (tick, node, pid), the order requests are taken in */
+} dev_req_t;
+
+typedef struct dev_inst {
+    pthread_mutex_t lock;       /* shared instances take requests from every node */
+    dev_req_t **queue;          /* waiting requests in order */
+    int n, cap;
+    dev_req_t **chan;           /* requests in service, NULL for a free channel */
+    int head;                   /* position of the last request started (SSTF) */
+    int last_tick;              /* tick last served, so a shared device is served once a tick */
+    int used;
+    long long busy;             /* channel ticks spent serving */
+    long long served;           /* requests started */
+    long long wait;             /* ticks they spent queued */
+    int max_queue;
+} dev_inst_t;
+
+typedef struct device {
+    char name[16];
+    int shared;
+    int discipline;
+    int rate;                   /* size units per tick */
+    int channels;
+    dev_inst_t *inst;           /* one, or one per node */
+} device_t;
+
+typedef struct dev_node {
+    pthread_mutex_t lock;       /* done is filled by whichever node serves a shared device */
+    prio_q_t *done;
+    int pending;                /* processes waiting on a device (owner only) */
+} __attribute__((aligned(64))) dev_node_t;
+
+static device_t devices[DEV_MAX];
+static int num_devices;
+static dev_node_t nodes[DEV_MAX_NODES];
+int device_on = 0;
+
+//parses one device line into devices[num_devices]
+static int _parse(const char *line) {
+    device_t *d = &devices[num_devices];
+    char scope[16], disc[16];
+    d->channels = 0;
+    int n = sscanf(line, "%15s %15s %15s %d %d", d->name, scope, disc, &d->rate, &d->channels);
+    if (n < 4 || d->rate < 1 || device_find(d->name) >= 0) {
+        return 0;
+    }
+    if (!strcmp(scope, "node")) d->shared = 0;
+    else if (!strcmp(scope, "shared")) d->shared = 1;
+    else return 0;
+
+    d->discipline = -1;
+    for (int i = 0; disciplines[i]; i++) {
+        if (!strcmp(disc, disciplines[i])) d->discipline = i;
+    }
+    if (d->discipline < 0) {
+        return 0;
+    }
+    if (d->discipline != DEV_PARALLEL) {
+        d->channels = 1;
+    } else if (n < 5) {
+        d->channels = 2;
+    }
+    if (d->channels < 1) {
+        return 0;
+    }
+
+    int count = d->shared ? 1 : DEV_MAX_NODES;
+    d->inst = calloc(count, sizeof(dev_inst_t));
+    assert(d->inst);
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_init(&d->inst[i].lock, NULL);
+        d->inst[i].chan = calloc(d->channels, sizeof(dev_req_t *));
+        assert(d->inst[i].chan);
+        d->inst[i].last_tick = -1;
+    }
+    num_devices++;
+    return 1;
+}
+
+//reads the device file
+int device_load(const char *path) {
+    FILE *fin = fopen(path, "r");
+    if (!fin) {
+        perror(path);
+        return 0;
+    }
+
+    char line[256];
+    int lineno = 0, ok = 1;
+    while (ok && fgets(line, sizeof(line), fin)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char word[2];
+        if (sscanf(line, "%1s", word) < 1) {
+            continue;
+        }
+        ok = num_devices < DEV_MAX && _parse(line);
+    }
+    fclose(fin);
+    if (!ok) {
+        fprintf(stderr, "%s:%d: expecting name node|shared fifo|sstf|parallel rate [channels]\n", path, lineno);
+        return 0;
+    }
+
+    for (int i = 0; i < DEV_MAX_NODES; i++) {
+        pthread_mutex_init(&nodes[i].lock, NULL);
+        nodes[i].done = prio_q_new();
+    }
+    device_on = 1;
+    return 1;
+}
+
+//linear search, there are only a few devices and this is only used while loading programs
+int device_find(const char *name) {
+    for (int i = 0; i < num_devices; i++) {
+        if (!strcmp(devices[i].name, name)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//true if every node's requests go to the one instance of the device
+int device_shared(int dev) {
+    return dev >= 0 && dev < num_devices && devices[dev].shared;
+}
+
+int device_any_shared(void) {
+    for (int d = 0; d < num_devices; d++) {
+        if (devices[d].shared) return 1;
+    }
+    return 0;
+}
+
+//the instance a node's requests to device d go to
+static dev_inst_t *_inst(device_t *d, int node_id) {
+    return d->shared ? &d->inst[0] : &d->inst[node_id];
+}
+
+//queues the request behind those it comes after; requests of one tick arrive in any order
+void device_submit(int node_id, context *proc, int clock_time) {
+    device_t *d = &devices[context_cur_duration(proc)];
+    dev_inst_t *in = _inst(d, node_id);
+
+    dev_req_t *r = malloc(sizeof(dev_req_t));
+    assert(r);
+    r->proc = proc;
+    r->node = node_id;
+    r->submit = clock_time;
+    r->pos = context_cur_tag(proc);
+    r->left = context_cur_size(proc) > 0 ? context_cur_size(proc) : 1;
+    r->order = (long long)clock_time << 32 | (long long)node_id << 20 | (proc->id & 0xfffff);
+    nodes[node_id].pending++;
+
+    pthread_mutex_lock(&in->lock);
+    if (in->n == in->cap) {
+        in->cap = in->cap ? 2 * in->cap : 16;
+        in->queue = realloc(in->queue, in->cap * sizeof(dev_req_t *));
+        assert(in->queue);
+    }
+    int i = in->n++;
+    while (i > 0 && in->queue[i - 1]->order > r->order) {
+        in->queue[i] = in->queue[i - 1];
+        i--;
+    }
+    in->queue[i] = r;
+    in->used = 1;
+    if (in->n > in->max_queue) in->max_queue = in->n;
+    pthread_mutex_unlock(&in->lock);
+}
+
+//index of the next request to start: the oldest, or for SSTF the one nearest the head (oldest on ties)
+static int _pick(device_t *d, dev_inst_t *in) {
+    if (d->discipline != DEV_SSTF) {
+        return 0;
+    }
+    int best = 0;
+    for (int i = 1; i < in->n; i++) {
+        if (abs(in->queue[i]->pos - in->head) < abs(in->queue[best]->pos - in->head)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+/* Serves one tick: free channels take their next request, then every request in service gets rate
+ * units; finished ones go to their node's completion queue
+ * Caller holds the instance lock.
+ */
+static void _serve(device_t *d, dev_inst_t *in, int clock_time) {
+    in->last_tick = clock_time;
+    for (int c = 0; c < d->channels; c++) {
+        if (!in->chan[c] && in->n > 0) {
+            int i = _pick(d, in);
+            dev_req_t *r = in->queue[i];
+            memmove(in->queue + i, in->queue + i + 1, (in->n - i - 1) * sizeof(dev_req_t *));
+            in->n--;
+            in->chan[c] = r;
+            in->head = r->pos;
+            in->served++;
+            in->wait += clock_time - r->submit;
+        }
+        dev_req_t *r = in->chan[c];
+        if (!r) {
+            continue;
+        }
+        in->busy++;
+        r->left -= d->rate;
+        if (r->left <= 0) {
+            dev_node_t *dn = &nodes[r->node];
+            pthread_mutex_lock(&dn->lock);
+            prio_q_add(dn->done, r->proc, r->order);
+            pthread_mutex_unlock(&dn->lock);
+            free(r);
+            in->chan[c] = NULL;
+        }
+    }
+}
+
+//the node's own instances, then the shared devices if no other node has served them this tick
+void device_tick(int node_id, int clock_time) {
+    for (int i = 0; i < num_devices; i++) {
+        device_t *d = &devices[i];
+        dev_inst_t *in = _inst(d, node_id);
+        if (!in->used) {
+            continue;
+        }
+        pthread_mutex_lock(&in->lock);
+        if (in->last_tick < clock_time) {
+            _serve(d, in, clock_time);
+        }
+        pthread_mutex_unlock(&in->lock);
+    }
+}
+
+//finished requests are ordered by submission, so the node takes them back in the same order every run
+int device_collect(int node_id, context **out, int maxn) {
+    dev_node_t *dn = &nodes[node_id];
+    int n = 0;
+    pthread_mutex_lock(&dn->lock);
+    while (n < maxn && !prio_q_empty(dn->done)) {
+        out[n++] = prio_q_remove(dn->done);
+    }
+    pthread_mutex_unlock(&dn->lock);
+    dn->pending -= n;
+    return n;
+}
+
+//processes of this node still on a device
+int device_pending(int node_id) {
+    return device_on ? nodes[node_id].pending : 0;
+}
+
+//one row per instance that saw a request
+void device_print(FILE *fout, int makespan) {
+    fprintf(fout, "Device  node  discipline  requests  utilization  mean_wait  max_queue\n");
+    for (int i = 0; i < num_devices; i++) {
+        device_t *d = &devices[i];
+        int count = d->shared ? 1 : DEV_MAX_NODES;
+        for (int k = 0; k < count; k++) {
+            dev_inst_t *in = &d->inst[k];
+            if (!in->used) continue;
+            if (d->shared) {
+                fprintf(fout, "%s  all", d->name);
+            } else {
+                fprintf(fout, "%s  %2.2d", d->name, k);
+            }
+            fprintf(fout, "  %s  %lld  %.1f%%  %.2f  %d\n", disciplines[d->discipline], in->served,
+                    makespan ? 100.0 * in->busy / ((long long)makespan * d->channels) : 0.0,
+                    in->served ? (double)in->wait / in->served : 0.0, in->max_queue);
+        }
+    }
+}
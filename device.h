@@ -0,0 +1,56 @@
+//filename: device.h
+//Description: I/O devices for the IO op. A device is either per node (every node has its own instance)
+//or shared by all nodes, and serves requests of a given size at a fixed rate under a FIFO, SSTF or
+//parallel-channel discipline. A process doing IO is blocked until the device finishes its request.
+//
+//Requests are submitted during a tick's first two steps; every node then advances the devices in
+//Step 3, after the second barrier, so all of a tick's requests are known and shared devices serve
+//them in (tick, node, pid) order whatever the thread timing. Completions are collected by the
+//owning node at the start of the next tick.
+//
+//Device file, one device per line ('#' starts a comment):
+//  name node|shared fifo|sstf|parallel rate [channels]
+//rate is in size units per tick; channels (parallel only, default 2) is how many requests are
+//served at once. SSTF serves the request whose position is closest to the last one served.
+#ifndef PROSIM_DEVICE_H
+#define PROSIM_DEVICE_H
+
+#include <stdio.h>
+#include "context.h"
+
+//non-zero once devices have been loaded
+extern int device_on;
+
+/* Loads the devices, before any program is read
+ * @params:
+ *   path: device file
+ * @returns:
+ *   1 on success, 0 if the file cannot be read or has a bad line (reported on stderr)
+ */
+extern int device_load(const char *path);
+
+//index of the named device, -1 if there is none
+extern int device_find(const char *name);
+
+//true if the device is shared by all nodes
+extern int device_shared(int dev);
+
+//true if some device is shared by all nodes
+extern int device_any_shared(void);
+
+//the process submits its current IO op on node_id at clock_time
+extern void device_submit(int node_id, context *proc, int clock_time);
+
+//serves one tick of the node's own devices and, once per tick, of the shared ones
+extern void device_tick(int node_id, int clock_time);
+
+//takes the node's finished requests, in submission order. returns the count
+extern int device_collect(int node_id, context **out, int maxn);
+
+//# of the node's processes waiting on a device (owner only)
+extern int device_pending(int node_id);
+
+//prints requests, utilization, queue wait and longest queue of every device instance used
+extern void device_print(FILE *fout, int makespan);
+
+#endif
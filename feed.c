@@ -0,0 +1,318 @@
+//filename: feed.c
+//Description: This file implements streaming admission. Programs must be listed in order of arrival
+//time; a program listed after a later arrival is admitted late, as soon as it is read.
+//Nodes pull their due programs at the start of each tick and the first node to get there for a tick
+//reads ahead in the input until it finds a program that is not due yet. What the nodes check every
+//tick (the next arrival, the programs due to each node, whether anything is left) is also published
+//in atomics, so the lock is only taken when a program is due.
+
+#include <pthread.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "feed.h"
+#include "prio_q.h"
+#include "place.h"
+#include "gang.h"
+#include "cache.h"
+#include "shard.h"
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *feed_in;            /* program descriptions still to be read */
+static int feed_left;            /* # of programs not read yet */
+static int feed_threads;         /* # of nodes */
+static context *lookahead;       /* program read but not yet due */
+static prio_q_t **due;           /* per node queue of programs that have arrived, in input order */
+static int feed_due;             /* # of programs sitting in the due queues */
+static int feed_placing;         /* read everything up front and run the placement */
+static FILE *feed_mapping;       /* where the placement prints its mapping */
+static context **preloaded;      /* with placement, gangs or the cache: every program to run, in input order */
+static int preload_next;         /* next preloaded program to hand out */
+static int feed_relocate;        /* hand out programs in memory of the admitting node */
+static int feed_first = 1;       /* nodes run by this process (all of them, unless it is a shard) */
+static int feed_last;
+static int *feed_count;          /* # of programs given to each node so far, which is the next one's pid */
+
+//a collective as processes name it, and how many distinct processes have named it so far
+typedef struct coll_tally {
+    int op, root, count, group;
+    int procs;
+    int last;                    /* the program that named it last, so a program is only counted once */
+    int used;
+} coll_tally_t;
+
+static coll_tally_t *tallies;    /* open addressing on the four fields */
+static int tallies_cap;
+static int tallies_used;
+static int programs_read;        /* numbers the programs for coll_tally_t.last */
+
+//written under the lock, read without it
+static int next_arrival;         /* arrival of the lookahead, INT_MAX once there is none */
+static int lookahead_node;       /* node of the lookahead, 0 if none */
+static int unread;               /* feed_left */
+static int *due_count;           /* # of programs in each node's due queue */
+static int exhausted;            /* nothing left to read or hand out */
+
+//next program of the input, from the preloaded array when the whole input was read up front
+static context *_read(void) {
+    if (preloaded) {
+        return preloaded[preload_next++];
+    }
+    return context_load(feed_in);
+}
+
+//true if a program has a SEND, RECV or collective, which needs a message address
+static int _messages(context *proc) {
+    for (int i = 0; i < proc->code_size; i++) {
+        int op = proc->code[i].op;
+        if (op == OP_SEND || op == OP_RECV || op == OP_BCAST || op == OP_GATHER || op == OP_ALLREDUCE) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static unsigned _tally_hash(opcode *c, int cap) {
+    unsigned h = (unsigned)c->op * 2654435761u ^ (unsigned)c->arg * 40503u ^ (unsigned)c->count * 97u ^
+                 (unsigned)c->tag * 2246822519u;
+    return h & (cap - 1);
+}
+
+//the tally of the collective c names, added if new
+static coll_tally_t *_tally(opcode *c) {
+    if ((tallies_used + 1) * 2 > tallies_cap) {
+        int cap = tallies_cap ? tallies_cap * 2 : 16;
+        coll_tally_t *old = tallies;
+        tallies = calloc(cap, sizeof(coll_tally_t));
+        assert(tallies);
+        for (int i = 0; i < tallies_cap; i++) {
+            if (!old[i].used) continue;
+            opcode key = { .op = old[i].op, .arg = old[i].root, .count = old[i].count, .tag = old[i].group };
+            unsigned h = _tally_hash(&key, cap);
+            while (tallies[h].used) h = (h + 1) & (cap - 1);
+            tallies[h] = old[i];
+        }
+        free(old);
+        tallies_cap = cap;
+    }
+
+    unsigned h = _tally_hash(c, tallies_cap);
+    for (; tallies[h].used; h = (h + 1) & (tallies_cap - 1)) {
+        coll_tally_t *t = &tallies[h];
+        if (t->op == c->op && t->root == c->arg && t->count == c->count && t->group == c->tag) {
+            return t;
+        }
+    }
+    tallies[h] = (coll_tally_t){ .op = c->op, .root = c->arg, .count = c->count, .group = c->tag, .used = 1 };
+    tallies_used++;
+    return &tallies[h];
+}
+
+/* Counts the program in for every collective it names. The instances of a collective take the first
+ * processes to arrive, so more processes than its count would fill them differently from run to run.
+ * returns 0 if the program is one too many for one of them
+ */
+static int _count_collectives(context *proc) {
+    static const char *names[] = { [OP_BCAST] = "BCAST", [OP_GATHER] = "GATHER", [OP_ALLREDUCE] = "ALLREDUCE" };
+    programs_read++;
+    for (int i = 0; i < proc->code_size; i++) {
+        opcode *c = &proc->code[i];
+        if (c->op != OP_BCAST && c->op != OP_GATHER && c->op != OP_ALLREDUCE) continue;
+        coll_tally_t *t = _tally(c);
+        if (t->last == programs_read) continue;
+        t->last = programs_read;
+        if (++t->procs > t->count) {
+            fprintf(stderr, "Bad input: %s would be process %d in %s", proc->name, t->procs, names[c->op]);
+            if (c->op != OP_ALLREDUCE) {
+                fprintf(stderr, " %d", c->arg);
+            }
+            fprintf(stderr, " %d of group %d, which takes %d processes; give the others another group\n",
+                    c->count, c->tag, c->count);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//read programs until one is found that does not arrive by clock_time. caller holds lock.
+//returns 0 if the input is bad
+static int _fill(int clock_time) {
+    for (;;) {
+        if (!lookahead) {
+            if (feed_left == 0) {
+                return 1;
+            }
+            lookahead = _read();
+            feed_left--;
+            if (!lookahead) {
+                return 0;
+            }
+        }
+
+        if (lookahead->arrival > clock_time) {
+            return 1;
+        }
+
+        //a node's programs get pids in input order; addresses are node*100 + pid, so only the first
+        //99 programs of a node can message
+        if (lookahead->thread >= 1 && lookahead->thread <= feed_threads &&
+            ++feed_count[lookahead->thread] >= 100 && _messages(lookahead)) {
+            fprintf(stderr, "Bad input: %s would be process %d of node %d, but only the first 99 processes of a "
+                    "node can SEND, RECV or take part in collectives\n", lookahead->name,
+                    feed_count[lookahead->thread], lookahead->thread);
+            return 0;
+        }
+        if (lookahead->thread >= 1 && lookahead->thread <= feed_threads && context_collectives &&
+            !_count_collectives(lookahead)) {
+            return 0;
+        }
+
+        //programs for nodes that do not exist, or are run by another shard, are never admitted here
+        if (lookahead->thread >= feed_first && lookahead->thread <= feed_last) {
+            prio_q_add(due[lookahead->thread], lookahead, 0);
+            __atomic_add_fetch(&due_count[lookahead->thread], 1, __ATOMIC_RELAXED);
+            feed_due++;
+        } else {
+            context_free(lookahead);
+        }
+        lookahead = NULL;
+    }
+}
+
+//publishes the state the lock-free checks read; caller holds lock. The due counts are updated before
+//this, so a node that sees what was read also sees the programs queued for it
+static void _publish(void) {
+    __atomic_store_n(&unread, feed_left, __ATOMIC_RELEASE);
+    __atomic_store_n(&lookahead_node, lookahead ? lookahead->thread : 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&exhausted, feed_left == 0 && !lookahead && feed_due == 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&next_arrival, lookahead ? lookahead->arrival : feed_left ? INT_MIN : INT_MAX,
+                     __ATOMIC_RELEASE);
+}
+
+//reads the whole input before the run so programs can be moved between nodes
+void feed_place(FILE *mapping) {
+    feed_placing = 1;
+    feed_mapping = mapping;
+}
+
+//loads every program, drops those for nodes that do not exist, places the rest, works out their gangs
+//and leaves out those whose results are cached.
+//returns 0 on bad input
+static int _preload(int num_procs) {
+    preloaded = calloc(num_procs + 1, sizeof(context *));
+    assert(preloaded);
+
+    int n = 0;
+    for (int i = 0; i < num_procs; i++) {
+        context *proc = context_load(feed_in);
+        if (!proc) {
+            return 0;
+        }
+        if (proc->thread >= 1 && proc->thread <= feed_threads) {
+            preloaded[n++] = proc;
+        } else {
+            context_free(proc);
+        }
+    }
+
+    if (feed_placing) {
+        place_programs(preloaded, n, feed_threads, feed_mapping);
+    }
+    if (gang_on) {
+        gang_assign(preloaded, n);
+    }
+    if (cache_on) {
+        n = cache_plan(preloaded, n, feed_threads);
+    }
+    feed_left = n;
+    return 1;
+}
+
+//programs are read by whichever thread gets to the input first; with pinned nodes they are copied
+//over to the node that runs them
+void feed_local(void) {
+    feed_relocate = 1;
+}
+
+//sets up the feed and reads every program arriving at time 0
+int feed_init(FILE *fin, int num_procs, int num_threads) {
+    feed_in = fin;
+    feed_left = num_procs;
+    feed_threads = num_threads;
+    feed_last = num_threads;
+    lookahead = NULL;
+
+    if ((feed_placing || gang_on || cache_on || shard_procs) && !_preload(num_procs)) {
+        return 0;
+    }
+
+    due = calloc(num_threads + 1, sizeof(prio_q_t *));
+    feed_count = calloc(num_threads + 1, sizeof(int));
+    due_count = calloc(num_threads + 1, sizeof(int));
+    assert(due && feed_count && due_count);
+    for (int i = 1; i <= num_threads; i++) {
+        due[i] = prio_q_new();
+    }
+
+    int ok = _fill(0);
+    _publish();
+    return ok;
+}
+
+//keeps only the programs of nodes first..last; the others still count as unread until they arrive,
+//so every shard sees the input run out at the same tick
+void feed_shard(int first, int last) {
+    feed_first = first;
+    feed_last = last;
+    for (int i = 1; i <= feed_threads; i++) {
+        while ((i < first || i > last) && !prio_q_empty(due[i])) {
+            context_free(prio_q_remove(due[i]));
+            due_count[i]--;
+            feed_due--;
+        }
+    }
+    _publish();
+}
+
+//hands out the programs that have arrived for this node, one at a time; without the lock when the
+//next arrival is later and nothing is queued for the node
+context *feed_next(int node_id, int clock_time) {
+    context *proc = NULL;
+
+    if (__atomic_load_n(&next_arrival, __ATOMIC_ACQUIRE) > clock_time &&
+        __atomic_load_n(&due_count[node_id], __ATOMIC_RELAXED) == 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&lock);
+    if (!_fill(clock_time)) {
+        fprintf(stderr, "Bad input, could not load program description\n");
+        exit(-1);
+    }
+    if (!prio_q_empty(due[node_id])) {
+        proc = prio_q_remove(due[node_id]);
+        __atomic_sub_fetch(&due_count[node_id], 1, __ATOMIC_RELAXED);
+        feed_due--;
+    }
+    _publish();
+    pthread_mutex_unlock(&lock);
+
+    if (proc && feed_relocate) {
+        proc = context_relocate(proc);
+    }
+    return proc;
+}
+
+//a node stays alive while it has programs due or while unread programs might be for it.
+//the due count is read last: a program read for this node meanwhile is counted before it is published
+int feed_pending(int node_id) {
+    return __atomic_load_n(&unread, __ATOMIC_ACQUIRE) > 0 ||
+           __atomic_load_n(&lookahead_node, __ATOMIC_ACQUIRE) == node_id ||
+           __atomic_load_n(&due_count[node_id], __ATOMIC_RELAXED) > 0;
+}
+
+//true once there is nothing left to read or hand out
+int feed_exhausted(void) {
+    return __atomic_load_n(&exhausted, __ATOMIC_ACQUIRE);
+}
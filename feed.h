@@ -0,0 +1,34 @@
+//filename: feed.h
+//Description: header for the admission feed. Program descriptions are read from the input as the
+//simulation clock reaches their arrival time, so only programs that have arrived are held in memory.
+#ifndef PROSIM_FEED_H
+#define PROSIM_FEED_H
+
+#include <stdio.h>
+#include "context.h"
+
+//makes feed_init read the whole input and reassign programs to nodes before the run (see place.h),
+//printing the mapping to mapping if it is not NULL
+void feed_place(FILE *mapping);
+
+//makes feed_next move every program into memory allocated by the node that admits it (see affinity.h)
+void feed_local(void);
+
+//sets up the feed over the remaining num_procs programs in fin and reads those arriving at time 0
+//(or all of them, with placement, gang scheduling, the cache or shards, see gang.h, cache.h and shard.h).
+//returns 1 on success, 0 if a program description could not be loaded
+int feed_init(FILE *fin, int num_procs, int num_threads);
+
+//in a shard, drops the programs of the nodes other shards run (see shard.h)
+void feed_shard(int first, int last);
+
+//returns the next program for this node whose arrival time is <= clock_time, or NULL if none is due
+context *feed_next(int node_id, int clock_time);
+
+//true if programs may still arrive for this node
+int feed_pending(int node_id);
+
+//true once every program has been read and handed to its node
+int feed_exhausted(void);
+
+#endif
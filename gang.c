@@ -0,0 +1,251 @@
+//filename: gang.c
+//Description: gang scheduling, see gang.h
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "gang.h"
+
+#define GANG_MAX_NODES 101
+#define GANG_MAX_PIDS  99           /* highest addressable pid on a node */
+#define GANG_MAX_ADDR  (GANG_MAX_NODES * 100)
+
+typedef struct gang_node {
+    long long dispatches;           /* members dispatched in their slot */
+    long long preemptions;          /* of which took a core from another process */
+} __attribute__((aligned(64))) gang_node_t;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int infer;                   /* gangs come from the message graph */
+static int **declared;              /* declared gangs: member addresses, 0 terminated */
+static int num_declared;
+static int *left;                   /* members of each gang not finished yet */
+static int num_gangs;
+static int num_members;
+static int cur_gang = -1;           /* gang holding the slot */
+static int slot_end;                /* first tick after its slot */
+static int last_tick = -1;          /* tick the slot was last looked at */
+static long long slots;             /* slots handed out */
+static gang_node_t nodes[GANG_MAX_NODES];
+int gang_on = 0;
+
+//reads the gang file
+static int _read_gangs(const char *path) {
+    FILE *fin = fopen(path, "r");
+    if (!fin) {
+        perror(path);
+        return 0;
+    }
+
+    char line[1024];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), fin)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        int cap = 8, n = 0;
+        int *members = malloc((cap + 1) * sizeof(int));
+        assert(members);
+        char *tok = strtok(line, " \t\r\n");
+        for (; tok; tok = strtok(NULL, " \t\r\n")) {
+            char *end;
+            long addr = strtol(tok, &end, 10);
+            if (*end || addr < 100 || addr >= GANG_MAX_ADDR || addr % 100 == 0) {
+                fprintf(stderr, "Bad gang address %s on line %d in %s\n", tok, lineno, path);
+                fclose(fin);
+                return 0;
+            }
+            if (n == cap) {
+                cap *= 2;
+                members = realloc(members, (cap + 1) * sizeof(int));
+                assert(members);
+            }
+            members[n++] = (int)addr;
+        }
+        if (n == 0) {
+            free(members);
+            continue;
+        }
+        members[n] = 0;
+        declared = realloc(declared, (num_declared + 1) * sizeof(int *));
+        assert(declared);
+        declared[num_declared++] = members;
+    }
+    fclose(fin);
+    return 1;
+}
+
+//"infer" or a gang file
+int gang_load(const char *spec) {
+    if (!strcmp(spec, "infer")) {
+        infer = 1;
+    } else if (!_read_gangs(spec)) {
+        return 0;
+    }
+    gang_on = 1;
+    return 1;
+}
+
+//union-find root, halving the path on the way
+static int _find(int *parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/* Joins every program with the programs its SEND/RECV ops name
+ * @params:
+ *   procs     : every program
+ *   num_procs : # of programs
+ *   addr_map  : address -> program index, -1 if none
+ *   parent    : union-find forest over the programs
+ * @returns:
+ *   none
+ */
+static void _infer(context **procs, int num_procs, int *addr_map, int *parent) {
+    for (int i = 0; i < num_procs; i++) {
+        for (opcode *op = procs[i]->code; op->op != OP_HALT; op++) {
+            if ((op->op != OP_SEND && op->op != OP_RECV) || op->arg < 0 || op->arg >= GANG_MAX_ADDR) {
+                continue;
+            }
+            int peer = addr_map[op->arg];
+            if (peer < 0) {
+                continue;
+            }
+            int a = _find(parent, i), b = _find(parent, peer);
+            if (a != b) {
+                //the earlier program stays the root, so gangs are numbered in input order
+                if (a < b) parent[b] = a; else parent[a] = b;
+            }
+        }
+    }
+}
+
+//gives the programs their gang, numbering gangs by their first member in input order
+void gang_assign(context **procs, int num_procs) {
+    int *addr_map = malloc(GANG_MAX_ADDR * sizeof(int));
+    int *parent = malloc((num_procs + 1) * sizeof(int));
+    int *size = calloc(num_procs + 1, sizeof(int));
+    int next_pid[GANG_MAX_NODES] = {0};
+    assert(addr_map && parent && size);
+
+    //pids are handed out in input order on each node, as the feed admits the programs
+    memset(addr_map, -1, GANG_MAX_ADDR * sizeof(int));
+    for (int i = 0; i < num_procs; i++) {
+        int pid = ++next_pid[procs[i]->thread];
+        if (pid <= GANG_MAX_PIDS) {
+            addr_map[procs[i]->thread * 100 + pid] = i;
+        }
+        parent[i] = i;
+        procs[i]->gang = -1;
+    }
+
+    if (infer) {
+        _infer(procs, num_procs, addr_map, parent);
+    } else {
+        //a declared gang is rooted at its earliest member; a program listed twice keeps its first gang
+        int *owner = malloc((num_procs + 1) * sizeof(int));
+        assert(owner);
+        memset(owner, -1, (num_procs + 1) * sizeof(int));
+        for (int g = 0; g < num_declared; g++) {
+            int root = -1;
+            for (int *m = declared[g]; *m; m++) {
+                int i = addr_map[*m];
+                if (i >= 0 && owner[i] < 0 && (root < 0 || i < root)) root = i;
+            }
+            for (int *m = declared[g]; *m && root >= 0; m++) {
+                int i = addr_map[*m];
+                if (i >= 0 && owner[i] < 0) {
+                    owner[i] = g;
+                    parent[i] = root;
+                }
+            }
+        }
+        free(owner);
+    }
+
+    for (int i = 0; i < num_procs; i++) {
+        size[_find(parent, i)]++;
+    }
+
+    //programs on their own are left out, there is nobody to co-schedule them with
+    int *gang_of = malloc((num_procs + 1) * sizeof(int));
+    assert(gang_of);
+    for (int i = 0; i < num_procs; i++) {
+        int root = _find(parent, i);
+        if (size[root] < 2) {
+            continue;
+        }
+        if (root == i) {
+            gang_of[i] = num_gangs++;
+        }
+        procs[i]->gang = gang_of[root];
+        num_members++;
+    }
+
+    left = calloc(num_gangs + 1, sizeof(int));
+    assert(left);
+    for (int i = 0; i < num_procs; i++) {
+        if (procs[i]->gang >= 0) {
+            left[procs[i]->gang]++;
+        }
+    }
+
+    free(gang_of);
+    free(size);
+    free(parent);
+    free(addr_map);
+}
+
+//the first node to get here in a tick moves the slot on when it has run out or its gang is done
+int gang_slot(int clock_time, int slot) {
+    pthread_mutex_lock(&lock);
+    if (last_tick != clock_time) {
+        last_tick = clock_time;
+        if (cur_gang < 0 || clock_time >= slot_end || left[cur_gang] == 0) {
+            int next = -1;
+            for (int i = 1; i <= num_gangs; i++) {
+                int g = ((cur_gang < 0 ? -1 : cur_gang) + i) % num_gangs;
+                if (left[g] > 0) {
+                    next = g;
+                    break;
+                }
+            }
+            cur_gang = next;
+            slot_end = clock_time + (slot > 0 ? slot : 1);
+            slots += next >= 0;
+        }
+    }
+    int g = cur_gang;
+    pthread_mutex_unlock(&lock);
+    return g;
+}
+
+//finishes come in before the second barrier, so gang_slot sees all of a tick's
+void gang_finish(int gang) {
+    pthread_mutex_lock(&lock);
+    left[gang]--;
+    pthread_mutex_unlock(&lock);
+}
+
+//per node, no lock needed
+void gang_dispatched(int node_id, int preempted) {
+    nodes[node_id].dispatches++;
+    nodes[node_id].preemptions += preempted;
+}
+
+//one summary line
+void gang_print(FILE *fout) {
+    long long dispatches = 0, preemptions = 0;
+    for (int i = 0; i < GANG_MAX_NODES; i++) {
+        dispatches += nodes[i].dispatches;
+        preemptions += nodes[i].preemptions;
+    }
+    fprintf(fout, "Gangs %d (%d processes), %lld slots, %lld dispatches in slot, %lld preemptions\n",
+            num_gangs, num_members, slots, dispatches, preemptions);
+}
@@ -0,0 +1,54 @@
+//filename: gang.h
+//Description: gang scheduling of communicating processes. Gangs are either declared in a file, one
+//gang per line listing the message addresses (node*100 + pid, after any placement) of its members,
+//or inferred as the connected components of the static SEND/RECV graph ("infer"; RECV ANY gives no edge).
+//
+//The gangs take turns holding a slot of one quantum. All nodes agree on whose slot it is: the slot
+//is advanced in Step 3, after the second barrier, when every finish of the tick is known. In its slot a
+//gang's READY members are dispatched first on every node, taking idle cores and then preempting any
+//other running process, so partners reach their SEND/RECV in the same ticks instead of waiting for each other.
+#ifndef PROSIM_GANG_H
+#define PROSIM_GANG_H
+
+#include <stdio.h>
+#include "context.h"
+
+//non-zero once gangs have been asked for
+extern int gang_on;
+
+/* Turns gang scheduling on, before any program is read
+ * @params:
+ *   spec: "infer", or a file of gangs
+ * @returns:
+ *   1 on success, 0 if the file cannot be read or has a bad line (reported on stderr)
+ */
+extern int gang_load(const char *spec);
+
+/* Works out the gang of every program, after placement
+ * @params:
+ *   procs     : every program, in input order, all on valid nodes
+ *   num_procs : # of programs
+ * @returns:
+ *   none
+ */
+extern void gang_assign(context **procs, int num_procs);
+
+/* The gang whose slot it is (called by every node in Step 3)
+ * @params:
+ *   clock_time : current tick
+ *   slot       : ticks a slot lasts
+ * @returns:
+ *   the gang, or -1 if every gang has finished
+ */
+extern int gang_slot(int clock_time, int slot);
+
+//a member of gang finished
+extern void gang_finish(int gang);
+
+//a member was dispatched in its gang's slot on node_id, preempting another process or not
+extern void gang_dispatched(int node_id, int preempted);
+
+//prints the gangs, their slots and the dispatches and preemptions made for them
+extern void gang_print(FILE *fout);
+
+#endif
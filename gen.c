@@ -0,0 +1,257 @@
+//filename: gen.c
+//Description: synthetic workload generator for the simulator. It writes a program description on stdout
+//with every process on a node running the same loop nest, so the SEND/RECV ops in the innermost body
+//always pair up and the workload cannot deadlock.
+//
+//Topologies (all use the same pid on every node, so process j talks to process j elsewhere):
+//  ring   : node k sends to k+1 and receives from k-1; node 1 sends first, as in test.07
+//  all    : every pair of nodes exchanges one message with probability density/100, pairs taken
+//           in one global order (lower address sends first) so the smallest pending pair can always match
+//  groups : disjoint rings of group_size nodes, as in test.09
+//  bcast, allreduce : every process takes part in each of the body's collectives, rooted at 01.01
+//Extra programs (-y) go to node 1 only and do not send or receive, to make that node the bottleneck.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define GEN_MAX_NODES 100
+#define GEN_MAX_PROCS 99
+
+enum { TOPO_NONE, TOPO_RING, TOPO_ALL, TOPO_GROUPS, TOPO_BCAST, TOPO_ALLREDUCE };
+
+typedef struct gen_args {
+    int nodes;          /* # of nodes */
+    int procs;          /* processes per node */
+    int quantum;        /* CPU quantum */
+    int doop_pct;       /* % of compute ops that are DOOP (the rest are BLOCK) */
+    int ops;            /* compute ops per loop body */
+    int max_len;        /* longest DOOP/BLOCK */
+    int depth;          /* loop nesting depth */
+    int iters;          /* iterations per loop */
+    int msgs;           /* message rounds per loop body (ring/groups/collectives) */
+    int density;        /* % of node pairs that exchange messages (all) */
+    int topo;           /* topology */
+    int group;          /* group size for TOPO_GROUPS */
+    int arrival;        /* processes arrive spread over [0, arrival) */
+    int extra;          /* extra compute-only programs on node 1 */
+    int size;           /* message size given to every SEND and collective, 0 for none */
+    const char *sched;  /* scheduling policies written after the header, NULL for the default */
+    unsigned seed;      /* random seed */
+} gen_args;
+
+static unsigned rng_state;
+
+//small deterministic PRNG so the same arguments always give the same workload on any libc
+static unsigned rng(void) {
+    rng_state = rng_state * 1103515245u + 12345u;
+    return (rng_state >> 16) & 0x7fff;
+}
+
+/* Address of process pid on node, as used by SEND/RECV
+ * @params:
+ *   node: node id (1 based)
+ *   pid : process id on the node (1 based)
+ * @returns:
+ *   the message address
+ */
+static int addr_of(int node, int pid) {
+    return node * 100 + pid;
+}
+
+//the optional size operand of a SEND or collective
+static const char *size_of(gen_args *a) {
+    static char buf[16];
+    if (a->size <= 0) {
+        return "";
+    }
+    snprintf(buf, sizeof(buf), " %d", a->size);
+    return buf;
+}
+
+/* Writes the message ops of one loop body for process pid on node
+ * @params:
+ *   a    : generator arguments
+ *   node : node id of the process
+ *   pid  : process id of the process
+ *   out  : where to write, or NULL to only count the ops
+ * @returns:
+ *   number of ops written
+ */
+static int emit_msgs(gen_args *a, int node, int pid, FILE *out) {
+    int n = 0;
+
+    if (pid > a->procs) {
+        return 0;           /* extra programs only compute */
+    }
+
+    if (a->topo == TOPO_RING || a->topo == TOPO_GROUPS) {
+        int size = a->topo == TOPO_RING ? a->nodes : a->group;
+        int base = (node - 1) / size * size;            /* first node of this ring, 0 based */
+        int width = a->nodes - base < size ? a->nodes - base : size;
+        if (width < 2) {
+            return 0;
+        }
+        int next = base + (node - 1 - base + 1) % width + 1;
+        int prev = base + (node - 1 - base + width - 1) % width + 1;
+
+        for (int m = 0; m < a->msgs; m++) {
+            if (node - 1 == base) {
+                if (out) fprintf(out, "  SEND %d%s\n  RECV %d\n", addr_of(next, pid), size_of(a), addr_of(prev, pid));
+            } else {
+                if (out) fprintf(out, "  RECV %d\n  SEND %d%s\n", addr_of(prev, pid), addr_of(next, pid), size_of(a));
+            }
+            n += 2;
+        }
+    } else if (a->topo == TOPO_ALL) {
+        /* The pair selection has to be the same for both ends, so it is derived from the pair itself
+         */
+        for (int x = 1; x <= a->nodes; x++) {
+            for (int y = x + 1; y <= a->nodes; y++) {
+                if (x != node && y != node) continue;
+                unsigned h = (unsigned)(x * 7919 + y * 104729) ^ a->seed;
+                h = h * 2654435761u;
+                if ((int)((h >> 8) % 100) >= a->density) continue;
+
+                if (node == x) {
+                    if (out) fprintf(out, "  SEND %d%s\n  RECV %d\n", addr_of(y, pid), size_of(a), addr_of(y, pid));
+                } else {
+                    if (out) fprintf(out, "  RECV %d\n  SEND %d%s\n", addr_of(x, pid), addr_of(x, pid), size_of(a));
+                }
+                n += 2;
+            }
+        }
+    } else if (a->topo == TOPO_BCAST || a->topo == TOPO_ALLREDUCE) {
+        for (int m = 0; m < a->msgs; m++) {
+            if (out && a->topo == TOPO_BCAST) {
+                fprintf(out, "  BCAST %d %d%s\n", addr_of(1, 1), a->nodes * a->procs, size_of(a));
+            } else if (out) {
+                fprintf(out, "  ALLREDUCE %d%s\n", a->nodes * a->procs, size_of(a));
+            }
+            n++;
+        }
+    }
+    return n;
+}
+
+/* Writes one program
+ * @params:
+ *   a    : generator arguments
+ *   node : node id of the process
+ *   pid  : process id of the process
+ *   out  : where to write
+ * @returns:
+ *   none
+ */
+static void emit_program(gen_args *a, int node, int pid, FILE *out) {
+    /* Compute ops are drawn up front so that the size in the header is known
+     */
+    int kind[a->ops + 1], len[a->ops + 1];
+    for (int i = 0; i < a->ops; i++) {
+        kind[i] = (int)(rng() % 100) < a->doop_pct;
+        len[i] = 1 + (int)(rng() % a->max_len);
+    }
+
+    int size = 2 * a->depth + a->ops + emit_msgs(a, node, pid, NULL) + 1;
+    /* Arrivals grow with the position in the output, which keeps the input in arrival order
+     */
+    long index = (long)(pid - 1) * a->nodes + (node - 1);
+    int arrival = (int)(index * a->arrival / ((long)a->nodes * a->procs + a->extra));
+
+    fprintf(out, "\nP%d_%d %d %d %d", node, pid, size, 1, node);
+    if (a->arrival > 0) {
+        fprintf(out, " %d", arrival);
+    }
+    fprintf(out, "\n");
+
+    for (int d = 0; d < a->depth; d++) {
+        fprintf(out, "LOOP %d\n", a->iters);
+    }
+    for (int i = 0; i < a->ops; i++) {
+        fprintf(out, "  %s %d\n", kind[i] ? "DOOP" : "BLOCK", len[i]);
+    }
+    emit_msgs(a, node, pid, out);
+    for (int d = 0; d < a->depth; d++) {
+        fprintf(out, "END\n");
+    }
+    fprintf(out, "HALT\n");
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-n nodes] [-p procs/node] [-q quantum] [-m doop%%] [-o ops/body] [-x max op len]\n"
+            "          [-l loop depth] [-i iterations] [-t ring|all|groups|bcast|allreduce|none] [-g group size]\n"
+            "          [-k msg rounds] [-d density%%] [-a arrival spread] [-s seed]\n"
+            "          [-y extra programs on node 1] [-z message size] [-c \"policy ...\"]\n", prog);
+}
+
+/* Main line
+ * @params:
+ *   command line options, see usage()
+ * @returns:
+ *   0 on success
+ */
+int main(int argc, char **argv) {
+    gen_args a = {
+        .nodes = 4, .procs = 4, .quantum = 5, .doop_pct = 75, .ops = 3, .max_len = 5,
+        .depth = 1, .iters = 10, .msgs = 1, .density = 50, .topo = TOPO_RING, .group = 3,
+        .arrival = 0, .extra = 0, .size = 0, .sched = NULL, .seed = 1
+    };
+
+    int c;
+    while ((c = getopt(argc, argv, "n:p:q:m:o:x:l:i:t:g:k:d:a:s:y:z:c:")) != -1) {
+        switch (c) {
+            case 'n': a.nodes = atoi(optarg); break;
+            case 'p': a.procs = atoi(optarg); break;
+            case 'q': a.quantum = atoi(optarg); break;
+            case 'm': a.doop_pct = atoi(optarg); break;
+            case 'o': a.ops = atoi(optarg); break;
+            case 'x': a.max_len = atoi(optarg); break;
+            case 'l': a.depth = atoi(optarg); break;
+            case 'i': a.iters = atoi(optarg); break;
+            case 'g': a.group = atoi(optarg); break;
+            case 'k': a.msgs = atoi(optarg); break;
+            case 'd': a.density = atoi(optarg); break;
+            case 'a': a.arrival = atoi(optarg); break;
+            case 's': a.seed = (unsigned)strtoul(optarg, NULL, 10); break;
+            case 'y': a.extra = atoi(optarg); break;
+            case 'z': a.size = atoi(optarg); break;
+            case 'c': a.sched = optarg; break;
+            case 't':
+                if (!strcmp(optarg, "ring")) a.topo = TOPO_RING;
+                else if (!strcmp(optarg, "all")) a.topo = TOPO_ALL;
+                else if (!strcmp(optarg, "groups")) a.topo = TOPO_GROUPS;
+                else if (!strcmp(optarg, "bcast")) a.topo = TOPO_BCAST;
+                else if (!strcmp(optarg, "allreduce")) a.topo = TOPO_ALLREDUCE;
+                else if (!strcmp(optarg, "none")) a.topo = TOPO_NONE;
+                else { usage(argv[0]); return 1; }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    /* Addresses are node*100 + pid, which bounds both dimensions
+     */
+    if (a.nodes < 1 || a.nodes > GEN_MAX_NODES || a.procs < 1 || a.procs > GEN_MAX_PROCS ||
+        a.quantum < 1 || a.ops < 0 || a.max_len < 1 || a.depth < 0 || a.iters < 1 ||
+        a.group < 1 || a.msgs < 0 || a.arrival < 0 || a.extra < 0 || a.procs + a.extra > GEN_MAX_PROCS) {
+        fprintf(stderr, "Bad arguments: at most %d nodes and %d processes per node\n",
+                GEN_MAX_NODES, GEN_MAX_PROCS);
+        return 1;
+    }
+    rng_state = a.seed;
+    printf("%d %d %d%s%s\n", a.nodes * a.procs + a.extra, a.quantum, a.nodes, a.sched ? " " : "", a.sched ? a.sched : "");
+
+    for (int pid = 1; pid <= a.procs; pid++) {
+        for (int node = 1; node <= a.nodes; node++) {
+            emit_program(&a, node, pid, stdout);
+        }
+    }
+    for (int pid = a.procs + 1; pid <= a.procs + a.extra; pid++) {
+        emit_program(&a, 1, pid, stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+//filename: hist.c
+//Description: log-bucketed histograms, see hist.h
+
+#include "hist.h"
+
+//bucket index of a value
+static int _bucket(unsigned v) {
+    if (v < HIST_SUB) {
+        return (int)v;
+    }
+    int msb = 31 - __builtin_clz(v);
+    int sub = (v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+//smallest value that falls into bucket i
+static int _lower(int i) {
+    if (i < HIST_SUB) {
+        return i;
+    }
+    int msb = i / HIST_SUB + HIST_SUB_BITS - 1;
+    int sub = i % HIST_SUB;
+    return (HIST_SUB + sub) << (msb - HIST_SUB_BITS);
+}
+
+//adds one value
+void hist_add(hist_t *h, int value) {
+    if (value < 0) {
+        value = 0;
+    }
+    h->count[_bucket((unsigned)value)]++;
+    h->total++;
+    h->sum += value;
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+//adds every value of src to dst
+void hist_merge(hist_t *dst, hist_t *src) {
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        dst->count[i] += src->count[i];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+//lower bound of the bucket holding the percentile
+int hist_percentile(hist_t *h, double pct) {
+    if (h->total == 0) {
+        return 0;
+    }
+
+    long long rank = (long long)(pct / 100.0 * h->total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > h->total) rank = h->total;
+
+    long long seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->count[i];
+        if (seen >= rank) {
+            return _lower(i);
+        }
+    }
+    return h->max;
+}
+
+//prints one summary line
+void hist_print(hist_t *h, const char *name, FILE *fout) {
+    fprintf(fout, "%-12s count %lld mean %.2f p50 %d p90 %d p99 %d p99.9 %d max %d\n", name, h->total,
+            h->total ? (double)h->sum / h->total : 0.0, hist_percentile(h, 50), hist_percentile(h, 90),
+            hist_percentile(h, 99), hist_percentile(h, 99.9), h->max);
+}
@@ -0,0 +1,33 @@
+//filename: hist.h
+//Description: fixed-size log-bucketed histograms (HDR-style) for tick counts. Values below 8 get their
+//own bucket and every power of two above that is split into 8 linear sub-buckets, so a bucket is
+//never wider than 1/8 of its value. Adding is O(1) and histograms merge by adding counts.
+#ifndef PROSIM_HIST_H
+#define PROSIM_HIST_H
+
+#include <stdio.h>
+
+#define HIST_SUB_BITS  3
+#define HIST_SUB       (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS   ((31 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct hist {
+    long long count[HIST_BUCKETS];  /* # of values in each bucket */
+    long long total;                /* # of values */
+    long long sum;                  /* sum of values, for the mean */
+    int max;                        /* largest value */
+} hist_t;
+
+//adds one value (negative values count as 0)
+extern void hist_add(hist_t *h, int value);
+
+//adds every value of src to dst
+extern void hist_merge(hist_t *dst, hist_t *src);
+
+//returns the lower bound of the bucket holding the given percentile (0-100), 0 if empty
+extern int hist_percentile(hist_t *h, double pct);
+
+//prints one line: count, mean, p50, p90, p99, p99.9 and max
+extern void hist_print(hist_t *h, const char *name, FILE *fout);
+
+#endif
@@ -0,0 +1,82 @@
+//filename: instr.c
+//Description: counters for the optional hot-path instrumentation (see instr.h) and their JSON dump
+
+#include <string.h>
+#include <time.h>
+
+#include "instr.h"
+
+#define INSTR_MAX_NODES 101
+
+#ifdef PROSIM_INSTRUMENT
+
+static instr_node_t nodes[INSTR_MAX_NODES];
+static int used[INSTR_MAX_NODES];
+
+__thread instr_node_t *instr_self = NULL;
+
+//binds the calling thread to its node's counters
+void instr_attach(int node_id) {
+    if (node_id < 0 || node_id >= INSTR_MAX_NODES) {
+        return;
+    }
+    memset(&nodes[node_id], 0, sizeof(instr_node_t));
+    used[node_id] = 1;
+    instr_self = &nodes[node_id];
+    instr_self->last_ns = instr_now();
+}
+
+//monotonic time in ns (vDSO, no syscall on Linux)
+long long instr_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//lock m, counting whether somebody else already held it. returns what pthread_mutex_lock would
+int instr_lock(pthread_mutex_t *m, int which) {
+    int result = pthread_mutex_trylock(m);
+    if (result != 0) {
+        if (instr_self) instr_self->lock_contended[which]++;
+        result = pthread_mutex_lock(m);
+    }
+    if (instr_self) instr_self->lock_acquired[which]++;
+    return result;
+}
+
+#endif
+
+//writes the counters of every node as JSON
+int instr_dump(FILE *fout) {
+#ifdef PROSIM_INSTRUMENT
+    static const char *phases[] = {"admit", "step1a", "step1b", "step2", "step3", "step4"};
+    static const char *locks[] = {"endpoint", "pernode", "output"};
+    int first = 1;
+
+    fprintf(fout, "{\"nodes\": [");
+    for (int n = 0; n < INSTR_MAX_NODES; n++) {
+        if (!used[n]) continue;
+        instr_node_t *c = &nodes[n];
+
+        fprintf(fout, "%s\n  {\"node\": %d, \"ticks\": %lld,\n   \"phase_ns\": {", first ? "" : ",", n, c->ticks);
+        for (int p = 0; p < INSTR_PHASES; p++) {
+            fprintf(fout, "%s\"%s\": %lld", p ? ", " : "", phases[p], c->phase_ns[p]);
+        }
+        fprintf(fout, "},\n   \"barrier\": {\"waits\": %lld, \"wait_ns\": %lld},\n   \"locks\": {",
+                c->barrier_waits, c->barrier_ns);
+        for (int l = 0; l < INSTR_LOCKS; l++) {
+            fprintf(fout, "%s\"%s\": {\"acquired\": %lld, \"contended\": %lld}", l ? ", " : "",
+                    locks[l], c->lock_acquired[l], c->lock_contended[l]);
+        }
+        fprintf(fout, "},\n   \"prio_q\": {\"add\": %lld, \"remove\": %lld, \"walks\": %lld, "
+                "\"walk_steps\": %lld, \"walk_max\": %lld}}",
+                c->q_add, c->q_remove, c->q_walks, c->q_walk_steps, c->q_walk_max);
+        first = 0;
+    }
+    fprintf(fout, "\n]}\n");
+    return 1;
+#else
+    (void)fout;
+    return 0;
+#endif
+}
@@ -0,0 +1,84 @@
+//filename: instr.h
+//Description: optional host-side instrumentation of the simulator's hot paths. Build with
+//`make INSTRUMENT=1` to enable it; otherwise every macro below compiles to nothing (or to the plain
+//pthread call it wraps), so the normal build pays nothing for it.
+//Counters live in one cache-line aligned block per node and are only written by that node's thread.
+#ifndef PROSIM_INSTR_H
+#define PROSIM_INSTR_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+//phases of a tick in process_simulate, barrier waits excluded
+enum {
+    INSTR_ADMIT = 0,     /* Step 0: admission */
+    INSTR_STEP1A,        /* Step 1(a): message completions */
+    INSTR_STEP1B,        /* Step 1(b): BLOCK wake-ups */
+    INSTR_STEP2,         /* Step 2: update running process */
+    INSTR_STEP3,         /* Step 3: dispatch */
+    INSTR_STEP4,         /* Step 4: deadlock check, summary emission, clock */
+    INSTR_PHASES
+};
+
+//mutexes whose contention is counted
+enum {
+    INSTR_LOCK_ENDPOINT = 0,   /* ep[].lock in message.c */
+    INSTR_LOCK_PERNODE,        /* pernode[].lock in message.c */
+    INSTR_LOCK_OUTPUT,         /* trace output lock in process.c */
+    INSTR_LOCKS
+};
+
+typedef struct instr_node {
+    long long ticks;                        /* ticks simulated */
+    long long phase_ns[INSTR_PHASES];       /* time spent in each phase */
+    long long barrier_waits;                /* # of barrier_wait calls */
+    long long barrier_ns;                   /* time spent inside barrier_wait */
+    long long lock_acquired[INSTR_LOCKS];   /* # of acquisitions */
+    long long lock_contended[INSTR_LOCKS];  /* # of acquisitions that found the lock held */
+    long long q_add;                        /* prio_q_add calls */
+    long long q_remove;                     /* prio_q_remove calls */
+    long long q_walks;                      /* adds that had to walk the list */
+    long long q_walk_steps;                 /* total nodes stepped over by those walks */
+    long long q_walk_max;                   /* longest single walk */
+    long long last_ns;                      /* start of the phase being timed */
+} __attribute__((aligned(64))) instr_node_t;
+
+#ifdef PROSIM_INSTRUMENT
+
+extern __thread instr_node_t *instr_self;
+
+extern void instr_attach(int node_id);
+extern long long instr_now(void);
+extern int instr_lock(pthread_mutex_t *m, int which);
+
+#define INSTR_ATTACH(node)        instr_attach(node)
+#define INSTR_RESTART()           do { if (instr_self) instr_self->last_ns = instr_now(); } while (0)
+#define INSTR_MARK(phase)         do { if (instr_self) { long long _n = instr_now(); \
+                                      instr_self->phase_ns[phase] += _n - instr_self->last_ns; \
+                                      instr_self->last_ns = _n; } } while (0)
+#define INSTR_COUNT(field)        do { if (instr_self) instr_self->field++; } while (0)
+#define INSTR_WALK(steps)         do { if (instr_self) { instr_self->q_walks++; \
+                                      instr_self->q_walk_steps += (steps); \
+                                      if ((steps) > instr_self->q_walk_max) instr_self->q_walk_max = (steps); } } while (0)
+#define INSTR_TIMER(var)          long long var = instr_now()
+#define INSTR_BARRIER(start)      do { if (instr_self) { instr_self->barrier_waits++; \
+                                      instr_self->barrier_ns += instr_now() - (start); } } while (0)
+#define INSTR_LOCK(m, which)      instr_lock((m), (which))
+
+#else
+
+#define INSTR_ATTACH(node)        ((void)0)
+#define INSTR_RESTART()           ((void)0)
+#define INSTR_MARK(phase)         ((void)0)
+#define INSTR_COUNT(field)        ((void)0)
+#define INSTR_WALK(steps)         ((void)0)
+#define INSTR_TIMER(var)          ((void)0)
+#define INSTR_BARRIER(start)      ((void)0)
+#define INSTR_LOCK(m, which)      pthread_mutex_lock(m)
+
+#endif
+
+//writes the counters of every node as JSON. returns 0 if the build has no instrumentation
+extern int instr_dump(FILE *fout);
+
+#endif
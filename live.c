@@ -0,0 +1,73 @@
+//filename: live.c
+//Description: the writer side of the live gauges segment, see live.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "live.h"
+
+static live_segment_t *seg;
+static char *seg_name;
+int live_on = 0;
+
+int live_open(const char *name, int num_nodes) {
+    if (num_nodes >= LIVE_MAX_NODES) {
+        fprintf(stderr, "Live gauges are kept for at most %d nodes\n", LIVE_MAX_NODES - 1);
+        return 0;
+    }
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(live_segment_t))) {
+        perror(name);
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+    seg = mmap(NULL, sizeof(live_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg == MAP_FAILED) {
+        perror(name);
+        shm_unlink(name);
+        seg = NULL;
+        return 0;
+    }
+
+    //the object starts zeroed; the magic goes last so a reader never sees a half set up header
+    seg->version = LIVE_VERSION;
+    seg->num_nodes = num_nodes;
+    __atomic_store_n(&seg->magic, LIVE_MAGIC, __ATOMIC_RELEASE);
+    seg_name = strdup(name);
+    live_on = 1;
+    return 1;
+}
+
+//odd sequence number, gauges, even sequence number; the release fence keeps the gauges after the odd store
+void live_publish(int node_id, const live_gauges_t *g, int done) {
+    live_node_t *n = &seg->node[node_id];
+    unsigned seq = n->seq;
+    const long long *src = (const long long *)g;
+    long long *dst = (long long *)&n->g;
+
+    __atomic_store_n(&n->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (size_t i = 0; i < LIVE_WORDS; i++) {
+        __atomic_store_n(&dst[i], src[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&n->done, done, __ATOMIC_RELAXED);
+    __atomic_store_n(&n->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void live_close(void) {
+    if (!seg) {
+        return;
+    }
+    __atomic_store_n(&seg->done, 1, __ATOMIC_RELEASE);
+    munmap(seg, sizeof(live_segment_t));
+    shm_unlink(seg_name);
+    free(seg_name);
+    seg = NULL;
+    live_on = 0;
+}
@@ -0,0 +1,63 @@
+//filename: live.h
+//Description: live gauges of a running simulation in a POSIX shared-memory segment (prosim -S name),
+//read by prosim-top (top.c). Each node owns one cache line of the segment and rewrites it at the end of
+//every tick under a seqlock: it makes the sequence number odd, stores the gauges, then makes it even
+//again. A reader copies the gauges between two reads of the sequence number and retries if it was odd
+//or changed, so writers never take a lock or make a system call. Rates (ticks per second) are worked
+//out by the reader from two samples.
+#ifndef PROSIM_LIVE_H
+#define PROSIM_LIVE_H
+
+#define LIVE_MAGIC      0x50534c56  /* "PSLV" */
+#define LIVE_VERSION    2
+#define LIVE_MAX_NODES  101
+
+//one node's gauges; all long long, so they can be copied a word at a time with atomic stores and loads
+typedef struct live_gauges {
+    long long clock_time;           /* node's clock */
+    long long running;              /* busy cores */
+    long long ready;                /* ready queue length */
+    long long blocked;              /* processes in BLOCK or waiting on a device */
+    long long msg_wait;             /* processes blocked in SEND/RECV */
+    long long finished;             /* processes finished on the node */
+    long long matched;              /* messages received by its processes */
+} live_gauges_t;
+
+#define LIVE_WORDS (sizeof(live_gauges_t) / sizeof(long long))
+
+//the flag shares the sequence number's word, so a slot is exactly one cache line
+typedef struct live_node {
+    unsigned seq;                   /* odd while the node is writing */
+    unsigned done;                  /* the node has left the simulation */
+    live_gauges_t g;
+} __attribute__((aligned(64))) live_node_t;
+
+_Static_assert(sizeof(live_node_t) == 64, "a node's gauges must fit one cache line");
+
+typedef struct live_segment {
+    unsigned magic;
+    unsigned version;
+    int num_nodes;
+    int done;                       /* the simulation has ended */
+    live_node_t node[LIVE_MAX_NODES];
+} live_segment_t;
+
+//non-zero while the segment is published
+extern int live_on;
+
+/* Creates the segment (replacing any left over with the same name) and maps it
+ * @params:
+ *   name      : shared-memory object name, e.g. /prosim
+ *   num_nodes : # of nodes
+ * @returns:
+ *   1 on success, 0 on failure (reported on stderr)
+ */
+extern int live_open(const char *name, int num_nodes);
+
+//stores the node's gauges and whether it has left (owner thread only)
+extern void live_publish(int node_id, const live_gauges_t *g, int done);
+
+//marks the simulation as ended and removes the segment's name; attached readers keep their mapping
+extern void live_close(void);
+
+#endif
@@ -1,12 +1,34 @@
+#define _GNU_SOURCE
 #include <assert.h>
+#include <errno.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 #include "context.h"
 #include "process.h"
 #include "barrier.h"
-
-static context **procs;
+#include "feed.h"
+#include "instr.h"
+#include "report.h"
+#include "sampler.h"
+#include "trace.h"
+#include "timeline.h"
+#include "critpath.h"
+#include "steal.h"
+#include "net.h"
+#include "device.h"
+#include "gang.h"
+#include "sched.h"
+#include "affinity.h"
+#include "cache.h"
+#include "live.h"
+#include "shard.h"
 
 static barrier_t gbarrier; //initializing barrier
 
@@ -23,15 +45,14 @@ typedef struct thread_args {
 static void *thread_runner(void *arg) {
     thread_args *thd_arg = (thread_args *)arg;
 
-    processor_t *cpu = process_new();
-    cpu->node_id = thd_arg->id;      // keep the node id
-
-    for (int i = 0; procs[i]; i++) {
-        if (procs[i]->thread == thd_arg->id) {
-            process_admit(cpu, procs[i]);
-        }
+    // a pinned node allocates its state only once it runs where it will stay
+    if (affinity_on) {
+        affinity_pin(thd_arg->id);
     }
+    INSTR_ATTACH(thd_arg->id);
+    processor_t *cpu = process_new(thd_arg->id);
 
+    // processes are admitted from the feed as their arrival time comes up
     process_simulate(cpu);
 
     // This node is done  in the barrier
@@ -39,50 +60,386 @@ static void *thread_runner(void *arg) {
     return NULL;
 }
 
+static int tee_fd = -1;       /* write end of the baseline child's input, -1 once it is closed */
+
+//passes what is read on to the baseline child; a child that went away stops getting it
+static void _tee(const char *buf, ssize_t n) {
+    while (n > 0 && tee_fd >= 0) {
+        ssize_t k = write(tee_fd, buf, n);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) {
+            close(tee_fd);
+            tee_fd = -1;
+            return;
+        }
+        buf += k;
+        n -= k;
+    }
+}
+
+//reads the input for the run as the feed asks for it, copying it to the baseline child
+static ssize_t _tee_read(void *cookie, char *buf, size_t size) {
+    (void)cookie;
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, buf, size)) < 0 && errno == EINTR);
+    if (n > 0) {
+        _tee(buf, n);
+    }
+    return n;
+}
+
+//hands the child whatever of the input the run did not need and lets it see the end
+static void _tee_close(void) {
+    char buf[4096];
+    ssize_t n;
+    while (tee_fd >= 0 && (n = read(STDIN_FILENO, buf, sizeof(buf))) > 0) {
+        _tee(buf, n);
+    }
+    if (tee_fd >= 0) {
+        close(tee_fd);
+        tee_fd = -1;
+    }
+}
+
+/* Forks a child that simulates the same input without work stealing and gang scheduling and with its
+ * output thrown away, so that the report can compare the throughput and message wait against it. The input is not read up front: the
+ * child gets each block through a pipe as the run reads it, so memory stays bounded by what the feed
+ * holds. A slow child can hold the run up on the pipe, never the other way around.
+ * @params:
+ *   child : set to 1 in the child, 0 in the parent
+ *   fd    : the child's write end of the result pipe in the child, the read end in the parent
+ * @returns:
+ *   the input to read from, or NULL on failure
+ */
+static FILE *fork_baseline(int *child, int *fd) {
+    int input[2], result[2];
+    if (pipe(input) < 0 || pipe(result) < 0) {
+        perror("pipe");
+        return NULL;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return NULL;
+    }
+    *child = pid == 0;
+    *fd = result[*child];
+    close(result[!*child]);
+    if (*child) {
+        close(input[1]);
+        steal_on = gang_on = 0;
+        if (!freopen("/dev/null", "w", stdout) || !freopen("/dev/null", "w", stderr)) {
+            _exit(1);
+        }
+        return fdopen(input[0], "r");
+    }
+
+    //the child may stop reading early; its pipe then fails instead of killing the run
+    close(input[0]);
+    signal(SIGPIPE, SIG_IGN);
+    tee_fd = input[1];
+    cookie_io_functions_t io = { .read = _tee_read };
+    return fopencookie(NULL, "r", io);
+}
+
+/* Print host-side throughput of the run on stderr
+ * @params:
+ *   start: wall clock time at which the simulation started
+ * @returns:
+ *   none
+ */
+static void print_host_stats(struct timespec *start) {
+    struct timespec end;
+    struct rusage usage;
+    long long num_events;
+    int num_ticks;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &usage);
+    process_counts(&num_events, &num_ticks);
+
+    double secs = (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+    if (secs <= 0) {
+        secs = 1e-9;
+    }
+    fprintf(stderr, "ticks %d events %lld seconds %.6f ticks/s %.1f events/s %.1f maxrss_kb %ld\n",
+            num_ticks, num_events, secs, num_ticks / secs, num_events / secs, usage.ru_maxrss);
+}
+
 /* Main line
  * @params:
- *   None
+ *   -s : print host-side throughput and peak memory on stderr at exit
+ *   -j file : write the hot-path counters of each node as JSON (needs make INSTRUMENT=1)
+ *   -r file : write turnaround/response/ready-wait distributions and node utilization ("-" for stdout)
+ *   -t file : write a CSV time series of each node's queue depths and blocked counts ("-" for stdout)
+ *   -T n    : sample the time series every n ticks (default 1)
+ *   -b file : write the process trace in binary to file instead of stdout (decode with prosim-trace)
+ *   -P file : write a Chrome/Perfetto timeline of process states and message rendezvous as JSON
+ *   -c file : write the critical path of the run and what it spent its time on ("-" for stdout)
+ *   -p file : reassign programs to nodes by their static cost and messages, writing the mapping to file
+ *   -w n    : let idle nodes steal READY processes from the busiest node, migrations taking n ticks;
+ *             with -r the same run is also simulated without stealing, for the throughput change
+ *   -k n    : give every node n cores sharing its ready queue (default 1)
+ *   -o d[,s[,c]] : dispatching a process costs d ticks, plus s when the core last ran another process
+ *              of the same program or c (default s) when it last ran another program
+ *   -g infer|file : gang schedule communicating processes, gangs taken from the message graph or the file
+ *   -C dir : reuse the results of node groups whose programs and settings are unchanged since a run that
+ *            stored them in dir, and store those of the groups simulated (see cache.h)
+ *   -S name : publish live per-node gauges in the shared-memory object name, for prosim-top
+ *   -M n[,sock] : run the nodes in n processes that trade messages over shared memory (or sockets, see shard.h)
+ *   -A cpus : pin node i to the i-th CPU of the list ("all" or e.g. 0-7,16-23) and keep its data in its own memory
+ *   -D file : load the I/O devices used by IO ops (see device.h for the format)
+ *   -L file : delay SEND/RECV completions by the latency and bandwidth of the interconnect model in file
  * @returns:
  *   0
  */
-int main() {
+int main(int argc, char **argv) {
     int num_procs;
     int quantum;
     int num_threads;
+    int host_stats = 0;
+    const char *instr_file = NULL;
+    const char *report_file = NULL;
+    const char *sample_file = NULL;
+    const char *trace_file = NULL;
+    const char *timeline_file = NULL;
+    const char *critpath_file = NULL;
+    const char *place_file = NULL;
+    const char *cache_dir = NULL;
+    const char *live_name = NULL;
+    int sample_every = 1;
+    FILE *in = stdin;
+    int baseline = 0, baseline_fd = -1;
+    struct timespec start;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "sj:r:t:T:b:P:c:p:w:k:L:o:D:g:A:C:S:M:")) != -1) {
+        switch (opt) {
+            case 's':
+                host_stats = 1;
+                break;
+            case 'j':
+                instr_file = optarg;
+                break;
+            case 'r':
+                report_file = optarg;
+                report_enable();
+                break;
+            case 't':
+                sample_file = optarg;
+                break;
+            case 'T':
+                sample_every = atoi(optarg);
+                break;
+            case 'b':
+                trace_file = optarg;
+                break;
+            case 'P':
+                timeline_file = optarg;
+                break;
+            case 'c':
+                critpath_file = optarg;
+                critpath_enable();
+                break;
+            case 'p':
+                place_file = optarg;
+                break;
+            case 'w':
+                steal_enable(atoi(optarg));
+                break;
+            case 'k':
+                process_set_cores(atoi(optarg));
+                report_set_cores(atoi(optarg));
+                cache_param("k", optarg);
+                break;
+            case 'o': {
+                int d = 0, s = 0, c = -1;
+                if (sscanf(optarg, "%d,%d,%d", &d, &s, &c) < 1) {
+                    fprintf(stderr, "Bad overhead %s, expecting dispatch[,switch[,cross]] ticks\n", optarg);
+                    return -1;
+                }
+                process_set_overhead(d, s, c < 0 ? s : c);
+                cache_param("o", optarg);
+                break;
+            }
+            case 'D':
+                if (!device_load(optarg) || !cache_file(optarg)) {
+                    return -1;
+                }
+                break;
+            case 'g':
+                if (!gang_load(optarg)) {
+                    return -1;
+                }
+                break;
+            case 'A':
+                if (!affinity_parse(optarg)) {
+                    return -1;
+                }
+                feed_local();
+                break;
+            case 'L':
+                if (!net_load(optarg) || !cache_file(optarg)) {
+                    return -1;
+                }
+                break;
+            case 'C':
+                cache_dir = optarg;
+                break;
+            case 'S':
+                live_name = optarg;
+                break;
+            case 'M':
+                if (!shard_parse(optarg)) {
+                    return -1;
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-s] [-j counters.json] [-r report.txt] [-t series.csv [-T ticks]]"
+                        " [-b trace.bin] [-P timeline.json] [-c critpath.txt]"
+                        " [-p mapping.txt] [-w migration cost] [-k cores] [-o dispatch,switch,cross] [-L net.model] [-D devices]"
+                        " [-g infer|gangs] [-A cpus] [-C cache dir] [-S shm name] [-M shards[,sock]] < program description\n", argv[0]);
+                return -1;
+        }
+    }
+    /* Replayed groups leave nothing behind but their output, and must not share anything with the others
+     */
+    if (cache_dir) {
+        if (report_file || sample_file || trace_file || timeline_file || critpath_file || steal_on || gang_on) {
+            fprintf(stderr, "-C cannot be combined with -r, -t, -b, -P, -c, -w or -g\n");
+            return -1;
+        }
+        if (!cache_open(cache_dir)) {
+            return -1;
+        }
+    }
+    /* Shards only share messages and the wait-for summary; what else the nodes share stays in one process
+     */
+    if (shard_procs) {
+        if (instr_file || report_file || sample_file || trace_file || timeline_file || critpath_file ||
+            steal_on || gang_on || cache_dir || device_any_shared()) {
+            fprintf(stderr, "-M cannot be combined with -j, -r, -t, -b, -P, -c, -w, -g, -C or shared devices\n");
+            return -1;
+        }
+    }
+    /* The binary trace, the timeline and the critical path keep a process in the tables of the node
+     * it was admitted on, which a stolen process leaves
+     */
+    if (steal_on && (trace_file || timeline_file || critpath_file)) {
+        fprintf(stderr, "-w cannot be combined with -b, -P or -c\n");
+        return -1;
+    }
+    /* A child simulates the same input without stealing and gangs first; it only hands back its
+     * throughput and message wait
+     */
+    if ((steal_on || gang_on) && report_file) {
+        if (!(in = fork_baseline(&baseline, &baseline_fd))) {
+            return -1;
+        }
+        if (baseline) {
+            instr_file = report_file = sample_file = live_name = NULL;
+            place_file = place_file ? "-" : NULL;
+            host_stats = 0;
+        }
+    }
+    if (sample_file && !sampler_open(sample_file, sample_every)) {
+        perror(sample_file);
+        return -1;
+    }
+    if (trace_file && !process_set_trace(trace_file)) {
+        perror(trace_file);
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
     /* Read in the header of the process description with minimal validation
      */
-    if (scanf("%d %d %d", &num_procs, &quantum, &num_threads) < 3) {
+    if (fscanf(in, "%d %d %d", &num_procs, &quantum, &num_threads) < 3) {
         fprintf(stderr, "Bad input, expecting # of processes, quantum, and # of threads\n");
         return -1;
     }
 
-    /* We use an array of pointers to contexts to track the processes.
-     * We also use an array of args for the nodes and an array for thread IDs
+    /* The rest of the header line may name the nodes' scheduling policies (see sched.h)
+     */
+    char policies[1024];
+    if (fgets(policies, sizeof(policies), in) && !sched_assign(policies)) {
+        return -1;
+    }
+    char qstr[16];
+    snprintf(qstr, sizeof(qstr), "%d", quantum);
+    cache_param("q", qstr);
+    if (live_name && !live_open(live_name, num_threads)) {
+        return -1;
+    }
+    if (timeline_file && !timeline_open(timeline_file, num_threads)) {
+        perror(timeline_file);
+        return -1;
+    }
+
+    /* We use an array of args for the nodes and an array for thread IDs
      */
-    procs  = calloc(num_procs + 1, sizeof(context *));
     thread_args *args  = calloc(num_threads, sizeof(thread_args));
     pthread_t *tid = calloc(num_threads, sizeof(pthread_t));
 
     process_init(quantum);
 
-    /* Load each process, if an error occurs, we just give up.
+    /* With placement every program is loaded now, so that they can be moved between nodes
      */
-    for (int i = 0; i < num_procs; i++) {
-        procs[i] = context_load(stdin);
-        if (!procs[i]) {
-            fprintf(stderr, "Bad input, could not load program description\n");
+    FILE *place_out = NULL;
+    if (place_file) {
+        place_out = strcmp(place_file, "-") ? fopen(place_file, "w") : stdout;
+        if (!place_out) {
+            perror(place_file);
             return -1;
         }
+        feed_place(place_out);
+    }
+
+    /* Load the processes that arrive at time 0, if an error occurs, we just give up.
+     * The rest are read by the nodes as the simulation reaches their arrival time.
+     */
+    if (!feed_init(in, num_procs, num_threads)) {
+        fprintf(stderr, "Bad input, could not load program description\n");
+        return -1;
+    }
+    if (place_out && place_out != stdout) {
+        fclose(place_out);
+    }
+
+    /* With shards this process only coordinates them from here on, and each shard runs its block of nodes
+     */
+    int first = 1, last = num_threads;
+    if (shard_procs) {
+        //a collective's processes are only known once it fills, so no shard could own its instance
+        if (context_collectives) {
+            fprintf(stderr, "-M cannot run programs with BCAST, GATHER or ALLREDUCE\n");
+            return -1;
+        }
+        int role = shard_fork(num_threads, &first, &last);
+        if (role < 0) {
+            return -1;
+        }
+        if (role == 0) {
+            int ok = shard_coordinate(stdout);
+            live_close();
+            if (host_stats) {
+                print_host_stats(&start);
+            }
+            return ok ? 0 : -1;
+        }
+        feed_shard(first, last);
     }
 
     // Initialize and give the barrier to the simulation
-    barrier_init(&gbarrier, num_threads);
+    barrier_init(&gbarrier, last - first + 1);
     process_set_barrier(&gbarrier);
 
+    // Summary rows are written as soon as every node's clock has passed their finish time
+    process_set_summary(stdout);
+
     /* Create threads and assume creation will be successful (or just die)
      */
-    for (int i = 0; i < num_threads; i++) {
+    for (int i = first - 1; i < last; i++) {
         args[i].id = i + 1;
         int result = pthread_create(&tid[i], NULL, thread_runner, &args[i]);
         assert(result == 0);
@@ -90,14 +447,91 @@ int main() {
 
     /* Wait for threads to complete and assume we will be successful (or just die)
      */
-    for (int i = 0; i < num_threads; i++) {
+    for (int i = first - 1; i < last; i++) {
         int result = pthread_join(tid[i], NULL);
         assert(result == 0);
     }
 
-    /* Output the statistics for processes in order of completion.
+    //a shard hands its last rows to the coordinator and exits
+    if (shard_on) {
+        process_summary(stdout);
+        shard_leave();
+    }
+
+    /* Output the statistics for the remaining processes in order of completion.
      */
     process_summary(stdout);
+    if (cache_on) {
+        cache_store();
+    }
+
+    sampler_close();
+    trace_close();
+    timeline_close();
+    live_close();
+
+    if (host_stats) {
+        print_host_stats(&start);
+        if (cache_on) {
+            cache_print(stderr);
+        }
+    }
+
+    if (baseline) {
+        long long finished, msg_wait;
+        int makespan;
+        report_throughput(&finished, &makespan, &msg_wait);
+        if (write(baseline_fd, &finished, sizeof(finished)) != sizeof(finished) ||
+            write(baseline_fd, &makespan, sizeof(makespan)) != sizeof(makespan) ||
+            write(baseline_fd, &msg_wait, sizeof(msg_wait)) != sizeof(msg_wait)) {
+            return -1;
+        }
+        return 0;
+    }
+    if (baseline_fd >= 0) {
+        _tee_close();
+        long long finished, msg_wait;
+        int makespan, status;
+        if (read(baseline_fd, &finished, sizeof(finished)) == sizeof(finished) &&
+            read(baseline_fd, &makespan, sizeof(makespan)) == sizeof(makespan) &&
+            read(baseline_fd, &msg_wait, sizeof(msg_wait)) == sizeof(msg_wait)) {
+            report_set_baseline(finished, makespan, msg_wait);
+        }
+        close(baseline_fd);
+        wait(&status);
+    }
+
+    if (report_file) {
+        FILE *fout = strcmp(report_file, "-") ? fopen(report_file, "w") : stdout;
+        if (!fout) {
+            perror(report_file);
+        } else {
+            report_print(fout);
+            if (fout != stdout) fclose(fout);
+        }
+    }
+
+    if (critpath_file) {
+        FILE *fout = strcmp(critpath_file, "-") ? fopen(critpath_file, "w") : stdout;
+        if (!fout) {
+            perror(critpath_file);
+        } else {
+            critpath_print(fout);
+            if (fout != stdout) fclose(fout);
+        }
+    }
+
+    if (instr_file) {
+        FILE *fout = fopen(instr_file, "w");
+        if (!fout) {
+            perror(instr_file);
+        } else {
+            if (!instr_dump(fout)) {
+                fprintf(stderr, "No counters to write, rebuild with make INSTRUMENT=1\n");
+            }
+            fclose(fout);
+        }
+    }
 
     return 0;
 }
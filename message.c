@@ -3,11 +3,16 @@
 //Description: This file implements synchronous message passing for the simulator
 
 #include <pthread.h>
-#include <string.h>
+#include <sched.h>
+#include <stdlib.h>
 #include <assert.h>
 
 #include "message.h"
 #include "prio_q.h"
+#include "instr.h"
+#include "net.h"
+#include "shard.h"
+#include "critpath.h"
 
 // bounds for the synchronization
 #define MSG_MAX_THREADS 100
@@ -16,94 +21,256 @@
 //address = node*100 + pid
 #define MSG_MAX_ADDR    ((MSG_MAX_THREADS+2)*100 + (MSG_MAX_PROCS+2))
 
-typedef struct {
+typedef struct endpoint endpoint_t;
+
+//the senders waiting on one receiver with one tag
+typedef struct tag_list {
+    int tag;
+    int used;             /* slot taken (lists that become empty keep it until the table is rebuilt) */
+    endpoint_t *head, *tail;
+} tag_list_t;
+
+struct endpoint {
     pthread_mutex_t lock;
-    int init;
-    int waiting_type;     /* 0 none, 1 waiting SEND, 2 waiting RECV */
-    int partner_addr;     /* the address it is paired/waiting for */
+    int init;             /* 0 unused, 1 lock being set up, 2 ready (see _init_once) */
+    int waiting_type;     /* 0 none, 1 waiting SEND, 2 waiting RECV, 3 waiting in a collective */
+    int partner_addr;     /* the address it is paired/waiting for, MSG_ANY for RECV ANY, a collective's root */
     int node_id;          /* node owning this address */
+    int size;             /* size of the message while waiting in SEND */
+    int tag;              /* tag of the SEND/RECV it waits in, group of the collective */
+    int post_time;        /* tick it started waiting */
+
+    /* As a sender waiting on a receiver: links in the receiver's queues, which are in
+     * (post_time, address) order so that ANY matches do not depend on thread timing.
+     * Guarded by the receiver's lock.
+     */
+    endpoint_t *uq_prev, *uq_next;      /* all senders waiting on the receiver */
+    endpoint_t *tq_prev, *tq_next;      /* those with the same tag */
+
+    /* As a receiver: the senders waiting on it (unexpected sends), indexed by tag;
+     * a source is indexed by its own endpoint, as a blocked sender has only one SEND pending
+     */
+    endpoint_t *uq_head, *uq_tail;
+    tag_list_t *tags;     /* open addressing on the tag, rebuilt without empty lists at half load */
+    int tags_cap, tags_used;
+
+    endpoint_t *any_prev, *any_next;    /* on its node's list of RECV ANY waiters (owner only) */
 
     context *ctx;         /* context pointer */
-} endpoint_t;
+    int remote;           /* a sender run by another shard, standing in on the receivers' shard */
+} __attribute__((aligned(64)));
+
+//node status as last reported by msg_tick_state, used for deadlock detection
+enum { NODE_DONE = 0, NODE_BUSY, NODE_STUCK };
 
 typedef struct {
     pthread_mutex_t lock;
-    prio_q_t *ready;      /* matched processes to unblock next tick  */
-} pernode_t;
-
-static endpoint_t ep[MSG_MAX_ADDR];
+    int init;             /* as for endpoints */
+    prio_q_t *ready;      /* matched processes by delivery tick, then pid */
+    int waiting;          /* # of endpoints on this node blocked in SEND/RECV or a collective */
+    int waiting_send;     /* ... of which blocked in SEND */
+    int waiting_recv;     /* ... of which blocked in RECV */
+    int status;           /* NODE_DONE, NODE_BUSY or NODE_STUCK (owner thread only) */
+    int clock_time;       /* node clock at the last status report */
+    endpoint_t *any_head; /* its processes waiting in RECV ANY (owner only) */
+} __attribute__((aligned(64))) pernode_t;
+
+/* Endpoints are kept in one page aligned block per node, so that no two nodes' endpoints share a
+ * cache line and, as the arrays are only written once a process registers, each node's block is
+ * first touched (and so placed in memory) by that node's thread
+ */
+typedef struct ep_block {
+    endpoint_t ep[MSG_MAX_PROCS];
+} __attribute__((aligned(4096))) ep_block_t;
+
+static ep_block_t ep_blocks[MSG_MAX_ADDR / MSG_MAX_PROCS + 1];
 static pernode_t  pernode[MSG_MAX_THREADS+1];
 
+#define EP(addr) (ep_blocks[(addr) / MSG_MAX_PROCS].ep[(addr) % MSG_MAX_PROCS])
+
+//global wait-for summary: how many nodes can still make progress / are stuck on messages
+static pthread_mutex_t dl_lock = PTHREAD_MUTEX_INITIALIZER;
+static int dl_busy;
+static int dl_stuck;
+
+//in a sharded run, the summary over every shard as of the last tick (see msg_dl_set)
+static int dl_shared;
+static int dl_all_busy, dl_all_stuck;
+
+//a collective being filled: the processes that named the same op, root, count and group wait on it
+//until count of them are in (see msg_collective)
+typedef struct collective {
+    int op, root, count, group;
+    int arrived;          /* arrival counter */
+    int size;             /* largest size given */
+    int *members;         /* addresses of the processes in so far, in order of arrival */
+    struct collective *next;
+} collective_t;
+
+static pthread_mutex_t coll_lock = PTHREAD_MUTEX_INITIALIZER;
+static collective_t *colls;   /* the instances being filled */
+
+//the address given at registration; it stays with the process if it migrates
 static inline int _addr_of(context *c) {
-    return c->thread * 100 + c->id;
+    return c->addr;
+}
+
+/* Endpoints and nodes are set up by the first thread to use them, which can be mid-run and on
+ * several node threads in the same tick (two SENDs to a receiver that has not arrived yet).
+ * The thread that moves init from 0 to 1 sets them up; the others wait until it is 2.
+ * @params:
+ *   init  : the init field
+ *   lock  : the mutex to set up
+ *   ready : the completion queue to create, or NULL
+ * @returns:
+ *   none
+ */
+static void _init_once(int *init, pthread_mutex_t *lock, prio_q_t **ready) {
+    if (__atomic_load_n(init, __ATOMIC_ACQUIRE) == 2) {
+        return;
+    }
+    int expected = 0;
+    if (__atomic_compare_exchange_n(init, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_init(lock, NULL);
+        if (ready) {
+            *ready = prio_q_new();
+        }
+        __atomic_store_n(init, 2, __ATOMIC_RELEASE);
+        return;
+    }
+    while (__atomic_load_n(init, __ATOMIC_ACQUIRE) != 2) {
+        sched_yield();
+    }
 }
 
 //init helpers
 static void _init_ep(endpoint_t *e) {
-    if (!e->init) {
-        pthread_mutex_init(&e->lock, NULL);
-        e->init = 1;
-    }
+    _init_once(&e->init, &e->lock, NULL);
 }
 
 //initializing nodes
 static void _init_node(int node_id) {
-    if (!pernode[node_id].ready) {
-        pthread_mutex_init(&pernode[node_id].lock, NULL);
-        pernode[node_id].ready = prio_q_new();
-    }
+    _init_once(&pernode[node_id].init, &pernode[node_id].lock, &pernode[node_id].ready);
 }
 
-//initializing messages
+//initializing messages; the arrays start zeroed and are left untouched here, see ep_block_t
 void msg_init(void) {
-    memset(ep, 0, sizeof(ep));
-    memset(pernode, 0, sizeof(pernode));
+    dl_busy = 0;
+    dl_stuck = 0;
 }
 
 //register a process so that node,pid pair to context is clear later
+//addresses are node*100 + pid, so only the first MSG_MAX_PROCS-1 processes of a node are reachable
 void msg_register(int node_id, context *proc) {
+    if (proc->id >= MSG_MAX_PROCS) {
+        proc->addr = 0;
+        return;
+    }
+
     int addr = node_id * 100 +  proc->id;
     assert(addr >= 0 && addr < MSG_MAX_ADDR);
+    proc->addr = addr;
 
-    _init_ep(&ep[addr]);
+    _init_ep(&EP(addr));
     _init_node(node_id);
 
-    pthread_mutex_lock(&ep[addr].lock);
+    INSTR_LOCK(&EP(addr).lock, INSTR_LOCK_ENDPOINT);
 
-    ep[addr].waiting_type = 0; //not waiting yet
-    ep[addr].partner_addr = 0;
+    EP(addr).waiting_type = 0; //not waiting yet
+    EP(addr).partner_addr = 0;
 
-    ep[addr].node_id = node_id;
-    ep[addr].ctx = proc;
+    EP(addr).node_id = node_id;
+    EP(addr).ctx = proc;
 
-    pthread_mutex_unlock(&ep[addr].lock);
+    pthread_mutex_unlock(&EP(addr).lock);
 }
 
-//Push a context to its node's completion list (ordered by PID)
-static void _push_done(context *c) {
-    int node_id = c->thread;
+//unregister a finished process; later SENDs/RECVs naming it wait on a dead partner
+void msg_unregister(context *proc) {
+    if (!proc->addr) {
+        return;
+    }
+
+    int addr = _addr_of(proc);
+    assert(addr >= 0 && addr < MSG_MAX_ADDR);
+
+    INSTR_LOCK(&EP(addr).lock, INSTR_LOCK_ENDPOINT);
+    EP(addr).ctx = NULL;
+    pthread_mutex_unlock(&EP(addr).lock);
+}
+
+//a process moved to another node: its completions and waits now belong to that node
+void msg_migrate(context *proc, int node_id) {
+    if (!proc->addr) {
+        return;
+    }
     _init_node(node_id);
 
-    pthread_mutex_lock(&pernode[node_id].lock);
+    INSTR_LOCK(&EP(proc->addr).lock, INSTR_LOCK_ENDPOINT);
+    EP(proc->addr).node_id = node_id;
+    pthread_mutex_unlock(&EP(proc->addr).lock);
+}
+
+//Push a context to the completion list of the node it runs on, to be collected at the delivery tick
+//(lower address first)
+static void _push_done(context *c, int deliver) {
+    int node_id = c->node;
+    _init_node(node_id);
 
-    prio_q_add(pernode[node_id].ready, c, c->id); //lower PID first
+    INSTR_LOCK(&pernode[node_id].lock, INSTR_LOCK_PERNODE);
+
+    prio_q_add(pernode[node_id].ready, c, (long long)deliver * MSG_MAX_ADDR + c->addr);
 
     pthread_mutex_unlock(&pernode[node_id].lock);
 }
 
+//put an endpoint into a waiting state, adding the edge addr -> partner to the wait-for graph
+//caller holds the endpoint lock
+static void _set_waiting(endpoint_t *e, int type, int partner_addr) {
+    int was = e->waiting_type;
+
+    e->waiting_type = type;
+    e->partner_addr = partner_addr;
+
+    if (was != type && !e->remote) {
+        pernode_t *pn = &pernode[e->node_id];
+        INSTR_LOCK(&pn->lock, INSTR_LOCK_PERNODE);
+        pn->waiting += was == 0;
+        pn->waiting_send += (type == 1) - (was == 1);
+        pn->waiting_recv += (type == 2) - (was == 2);
+        pthread_mutex_unlock(&pn->lock);
+    }
+}
+
+//take an endpoint out of its waiting state, removing its wait-for edge
+//caller holds the endpoint lock
+static void _clear_waiting(endpoint_t *e) {
+    if (e->waiting_type != 0 && !e->remote) {
+        pernode_t *pn = &pernode[e->node_id];
+        INSTR_LOCK(&pn->lock, INSTR_LOCK_PERNODE);
+        pn->waiting--;
+        pn->waiting_send -= e->waiting_type == 1;
+        pn->waiting_recv -= e->waiting_type == 2;
+        pthread_mutex_unlock(&pn->lock);
+    }
+
+    e->waiting_type = 0;
+    e->partner_addr = 0;
+}
+
 //lock two endpoints in ascending address order (for deadlock prevention
 static void _lock_two(endpoint_t *a, int aaddr, endpoint_t *b, int baddr) {
     if (aaddr == baddr) {
-        pthread_mutex_lock(&a->lock);
+        INSTR_LOCK(&a->lock, INSTR_LOCK_ENDPOINT);
         return;
     }
 
     if (aaddr < baddr) {
-        pthread_mutex_lock(&a->lock);
-        pthread_mutex_lock(&b->lock);
+        INSTR_LOCK(&a->lock, INSTR_LOCK_ENDPOINT);
+        INSTR_LOCK(&b->lock, INSTR_LOCK_ENDPOINT);
     } else {
-        pthread_mutex_lock(&b->lock);
-        pthread_mutex_lock(&a->lock);
+        INSTR_LOCK(&b->lock, INSTR_LOCK_ENDPOINT);
+        INSTR_LOCK(&a->lock, INSTR_LOCK_ENDPOINT);
     }
 }
 
@@ -118,86 +285,512 @@ static void _unlock_two(endpoint_t *a, endpoint_t *b, int same) {
     pthread_mutex_unlock(&b->lock);
 }
 
-//this method handles sending the message
-void msg_send(context *sender, int receiver_addr) {
-    int saddr = _addr_of(sender); //sender's address
+//tick at which both partners of a rendezvous made now see it complete: the next one, plus the
+//modeled transfer time from the sender's node to the receiver's
+static int _deliver_at(int clock_time, int from, int to, int size) {
+    return clock_time + 1 + (net_on ? net_cost(from, to, size) : 0);
+}
 
-    assert(receiver_addr >= 0 && receiver_addr < MSG_MAX_ADDR);
+//address of an endpoint
+static inline int _ep_addr(endpoint_t *e) {
+    size_t off = (char *)e - (char *)ep_blocks;
+    return (int)(off / sizeof(ep_block_t) * MSG_MAX_PROCS + off % sizeof(ep_block_t) / sizeof(endpoint_t));
+}
 
-    _init_ep(&ep[saddr]);
-    _init_ep(&ep[receiver_addr]);
+//a sender that can still be matched: a registered process, or a stand-in for one on another shard
+static inline int _alive(endpoint_t *e) {
+    return e->ctx != NULL || e->remote;
+}
 
-    endpoint_t *se = &ep[saddr];
-    endpoint_t *re = &ep[receiver_addr];
+//the sender's half of a rendezvous; a sender on another shard hears of it through by's outbox
+static void _sender_done(endpoint_t *se, int deliver, int by) {
+    if (se->remote) {
+        shard_match(by, _ep_addr(se), deliver);
+        return;
+    }
+    se->ctx->send_count++;
+    _push_done(se->ctx, deliver);
+}
 
-    _lock_two(se, saddr, re, receiver_addr);
+//true if sender a is ahead of sender b in a receiver's queues
+static inline int _before(endpoint_t *a, endpoint_t *b) {
+    return a->post_time < b->post_time || (a->post_time == b->post_time && a < b);
+}
+
+/* Finds the receiver's list for a tag
+ * @params:
+ *   r      : receiver endpoint (locked)
+ *   tag    : tag
+ *   create : add the list if it is not there
+ * @returns:
+ *   the list, or NULL if it is not there and create is 0
+ */
+static tag_list_t *_tag_list(endpoint_t *r, int tag, int create) {
+    /* At half load the table is rebuilt with only the lists that still hold senders, at most a quarter
+     * full, so a receiver that sees many distinct tags over time keeps a table sized for the senders
+     * waiting on it, and the rebuilds stay O(1) per list created on average
+     */
+    if (create && (r->tags_used + 1) * 2 > r->tags_cap) {
+        int live = 0;
+        for (int i = 0; i < r->tags_cap; i++) {
+            live += r->tags[i].used && r->tags[i].head;
+        }
+        int cap = 8;
+        while (live * 4 >= cap) cap *= 2;
+
+        tag_list_t *old = r->tags;
+        r->tags = calloc(cap, sizeof(tag_list_t));
+        assert(r->tags);
+        for (int i = 0; i < r->tags_cap; i++) {
+            if (!old[i].used || !old[i].head) continue;
+            unsigned h = (unsigned)old[i].tag * 2654435761u & (cap - 1);
+            while (r->tags[h].used) h = (h + 1) & (cap - 1);
+            r->tags[h] = old[i];
+        }
+        free(old);
+        r->tags_cap = cap;
+        r->tags_used = live;
+    }
+    if (!r->tags_cap) {
+        return NULL;
+    }
+
+    unsigned h = (unsigned)tag * 2654435761u & (r->tags_cap - 1);
+    while (r->tags[h].used) {
+        if (r->tags[h].tag == tag) {
+            return &r->tags[h];
+        }
+        h = (h + 1) & (r->tags_cap - 1);
+    }
+    if (!create) {
+        return NULL;
+    }
+    r->tags[h].used = 1;
+    r->tags[h].tag = tag;
+    r->tags_used++;
+    return &r->tags[h];
+}
+
+//queue a sender that starts waiting on receiver r; callers hold both locks.
+//senders of one tick arrive in any order, so each is walked back from the tail to its place
+static void _enqueue_sender(endpoint_t *r, endpoint_t *s) {
+    endpoint_t *after = r->uq_tail;
+    while (after && _before(s, after)) after = after->uq_prev;
+    s->uq_prev = after;
+    s->uq_next = after ? after->uq_next : r->uq_head;
+    if (s->uq_next) s->uq_next->uq_prev = s; else r->uq_tail = s;
+    if (after) after->uq_next = s; else r->uq_head = s;
+
+    tag_list_t *tl = _tag_list(r, s->tag, 1);
+    after = tl->tail;
+    while (after && _before(s, after)) after = after->tq_prev;
+    s->tq_prev = after;
+    s->tq_next = after ? after->tq_next : tl->head;
+    if (s->tq_next) s->tq_next->tq_prev = s; else tl->tail = s;
+    if (after) after->tq_next = s; else tl->head = s;
+}
+
+//take a matched sender out of receiver r's queues; callers hold both locks
+static void _dequeue_sender(endpoint_t *r, endpoint_t *s) {
+    if (s->uq_prev) s->uq_prev->uq_next = s->uq_next; else r->uq_head = s->uq_next;
+    if (s->uq_next) s->uq_next->uq_prev = s->uq_prev; else r->uq_tail = s->uq_prev;
+    s->uq_prev = s->uq_next = NULL;
+
+    tag_list_t *tl = _tag_list(r, s->tag, 0);
+    assert(tl);
+    if (s->tq_prev) s->tq_prev->tq_next = s->tq_next; else tl->head = s->tq_next;
+    if (s->tq_next) s->tq_next->tq_prev = s->tq_prev; else tl->tail = s->tq_prev;
+    s->tq_prev = s->tq_next = NULL;
+}
+
+//first sender waiting on r whose tag matches, in (post_time, address) order; r is locked
+static endpoint_t *_first_sender(endpoint_t *r, int tag) {
+    if (tag == MSG_ANY) {
+        return r->uq_head;
+    }
+    tag_list_t *tl = _tag_list(r, tag, 0);
+    return tl ? tl->head : NULL;
+}
+
+//add or remove a receiver on its node's list of RECV ANY waiters (owner thread only)
+static void _any_link(endpoint_t *r) {
+    pernode_t *pn = &pernode[r->node_id];
+    r->any_prev = NULL;
+    r->any_next = pn->any_head;
+    if (pn->any_head) pn->any_head->any_prev = r;
+    pn->any_head = r;
+}
 
-    int same = (saddr == receiver_addr); //if the sender and receiver are the same
+static void _any_unlink(endpoint_t *r) {
+    pernode_t *pn = &pernode[r->node_id];
+    if (r->any_prev) r->any_prev->any_next = r->any_next; else pn->any_head = r->any_next;
+    if (r->any_next) r->any_next->any_prev = r->any_prev;
+    r->any_prev = r->any_next = NULL;
+}
 
-    //if receiver is already waiting for this sender, both are completed
-    if (re->waiting_type == 2 && re->partner_addr == saddr && re->ctx) {
+/* Completes sender se and receiver re if re already waits in RECV for it, otherwise queues se on re
+ * Callers hold both locks.
+ * @params:
+ *   se, saddr  : sender endpoint and address
+ *   re, raddr  : receiver endpoint and address
+ *   tag, size  : the SEND's tag and size
+ *   clock_time : tick of the SEND
+ *   by         : node whose outbox tells a sender on another shard of the match
+ * @returns:
+ *   the delivery tick if they were matched, 0 otherwise
+ */
+static int _post_send(endpoint_t *se, int saddr, endpoint_t *re, int raddr, int tag, int size, int clock_time, int by) {
+    int matched = 0;
+
+    //if receiver is already waiting for this sender and tag, both are completed.
+    //a receiver in RECV ANY is matched by its own node at the start of the next tick instead
+    if (re->waiting_type == 2 && re->partner_addr == saddr && re->ctx &&
+        (re->tag == MSG_ANY || re->tag == tag)) {
         //mark send as done
-        re->waiting_type = 0;
-        re->partner_addr = 0;
+        _clear_waiting(re);
 
         //adjust the count for send and receive
-        sender->send_count++;
         re->ctx->recv_count++;
 
-        _push_done(sender);
-        _push_done(re->ctx);
+        matched = _deliver_at(clock_time, se->node_id, re->node_id, size);
+        _sender_done(se, matched, by);
+        _push_done(re->ctx, matched);
     } else {
-        // sender should be waiting for receiver
-        se->waiting_type = 1;
-        se->partner_addr = receiver_addr;
+        // sender should be waiting for receiver, queued where its RECVs look
+        se->size = size;
+        se->tag = tag;
+        se->post_time = clock_time;
+        _set_waiting(se, 1, raddr);
+        _enqueue_sender(re, se);
+    }
+    return matched;
+}
+
+//this method handles sending the message, returns the delivery tick if the receiver was already waiting
+int msg_send(context *sender, int receiver_addr, int tag, int size, int clock_time) {
+    int saddr = _addr_of(sender); //sender's address
+
+    assert(sender->addr);
+    assert(receiver_addr >= 0 && receiver_addr < MSG_MAX_ADDR);
+
+    _init_ep(&EP(saddr));
+    endpoint_t *se = &EP(saddr);
+
+    //a receiver run by another shard gets the SEND there once the tick's SEND/RECVs are all in;
+    //the sender waits until it hears back
+    if (shard_on && shard_remote(receiver_addr)) {
+        INSTR_LOCK(&se->lock, INSTR_LOCK_ENDPOINT);
+        se->size = size;
+        se->tag = tag;
+        se->post_time = clock_time;
+        _set_waiting(se, 1, receiver_addr);
+        pthread_mutex_unlock(&se->lock);
+        shard_send(se->node_id, saddr, se->node_id, receiver_addr, tag, size, clock_time);
+        return 0;
     }
 
-    _unlock_two(se, re, same);
+    _init_ep(&EP(receiver_addr));
+    endpoint_t *re = &EP(receiver_addr);
+
+    _lock_two(se, saddr, re, receiver_addr);
+    int matched = _post_send(se, saddr, re, receiver_addr, tag, size, clock_time, se->node_id);
+    _unlock_two(se, re, saddr == receiver_addr);
+    return matched;
+}
+
+//a SEND made on another shard to a receiver here, applied once the tick's SEND/RECVs are all in
+void msg_remote_send(int saddr, int snode, int raddr, int tag, int size, int clock_time) {
+    assert(saddr > 0 && saddr < MSG_MAX_ADDR && raddr >= 0 && raddr < MSG_MAX_ADDR);
+    _init_ep(&EP(saddr));
+    _init_ep(&EP(raddr));
+
+    endpoint_t *se = &EP(saddr);
+    endpoint_t *re = &EP(raddr);
+
+    _lock_two(se, saddr, re, raddr);
+    se->remote = 1;
+    se->node_id = snode;
+    _post_send(se, saddr, re, raddr, tag, size, clock_time, 0);
+    _unlock_two(se, re, 0);
 }
 
+//the receiver's shard matched this shard's sender at saddr
+void msg_remote_match(int saddr, int deliver) {
+    endpoint_t *se = &EP(saddr);
+    assert(se->init && se->ctx && se->waiting_type == 1);
 
+    INSTR_LOCK(&se->lock, INSTR_LOCK_ENDPOINT);
+    _clear_waiting(se);
+    _sender_done(se, deliver, 0);
+    pthread_mutex_unlock(&se->lock);
+}
 
-//this method handles receiving messages
-void msg_recv(context *receiver, int sender_addr) {
+//ticks the slowest transfer of a completed collective takes under the interconnect model.
+//an ALLREDUCE is modeled as a reduction to its lowest address followed by a broadcast from there
+static int _coll_cost(collective_t *c) {
+    if (!net_on) {
+        return 0;
+    }
+    int root = c->root;
+    if (c->op == OP_ALLREDUCE) {
+        root = c->members[0];
+        for (int i = 1; i < c->count; i++) {
+            if (c->members[i] < root) root = c->members[i];
+        }
+    }
+
+    //the root keeps its address if it migrated, so its node is looked up when it took part
+    int rnode = root / 100;
+    for (int i = 0; i < c->count; i++) {
+        if (c->members[i] == root) rnode = EP(root).node_id;
+    }
+
+    int to = 0, from = 0;
+    for (int i = 0; i < c->count; i++) {
+        int node = EP(c->members[i]).node_id;
+        int cost = net_cost(rnode, node, c->size);
+        if (cost > to) to = cost;
+        cost = net_cost(node, rnode, c->size);
+        if (cost > from) from = cost;
+    }
+    return c->op == OP_BCAST ? to : c->op == OP_GATHER ? from : from + to;
+}
+
+//a BCAST or GATHER only completes with its root among the processes in
+static int _coll_rooted(collective_t *c) {
+    if (c->op == OP_ALLREDUCE) {
+        return 1;
+    }
+    for (int i = 0; i < c->arrived; i++) {
+        if (c->members[i] == c->root) return 1;
+    }
+    return 0;
+}
+
+//what a member's stats count a collective as: the root of a BCAST and the others of a GATHER give
+//their data (a send), the others get it (a recv); an ALLREDUCE is both
+static void _coll_count(collective_t *c, context *p) {
+    int root = _addr_of(p) == c->root;
+    p->send_count += c->op == OP_ALLREDUCE || (c->op == OP_BCAST) == root;
+    p->recv_count += c->op == OP_ALLREDUCE || (c->op == OP_GATHER) == root;
+}
+
+/* The processes of a collective arrive on one instance, counted in as they come; the last one to
+ * arrive completes every one of them, so no per-pair rendezvous is made. An instance is found by
+ * what its processes named: those of a group go through its collectives together, so an instance
+ * never gets more than its count and which processes fill it does not depend on thread timing.
+ * A BCAST or GATHER that fills without its root never completes: it stays full, so a root that
+ * comes later starts an instance of its own, and the deadlock report names the missing root.
+ */
+int msg_collective(context *proc, int clock_time) {
+    int addr = _addr_of(proc);
+    int op = context_cur_op(proc);
+    int root = context_cur_duration(proc);
+    int count = context_cur_count(proc);
+    int group = context_cur_tag(proc);
+
+    assert(proc->addr);
+    assert(op == OP_BCAST || op == OP_GATHER || op == OP_ALLREDUCE);
+    assert(root == MSG_ANY || (root >= 0 && root < MSG_MAX_ADDR));
+
+    _init_ep(&EP(addr));
+    endpoint_t *e = &EP(addr);
+
+    pthread_mutex_lock(&coll_lock);
+    collective_t **at = &colls;
+    while (*at && !((*at)->op == op && (*at)->root == root && (*at)->count == count && (*at)->group == group &&
+                    (*at)->arrived < count)) {
+        at = &(*at)->next;
+    }
+    collective_t *c = *at;
+    if (!c) {
+        c = calloc(1, sizeof(collective_t));
+        assert(c);
+        c->members = malloc(count * sizeof(int));
+        assert(c->members);
+        c->op = op;
+        c->root = root;
+        c->count = count;
+        c->group = group;
+        c->next = colls;
+        colls = c;
+        at = &colls;
+    }
+    c->members[c->arrived++] = addr;
+    if (context_cur_size(proc) > c->size) {
+        c->size = context_cur_size(proc);
+    }
+
+    if (c->arrived < c->count || !_coll_rooted(c)) {
+        INSTR_LOCK(&e->lock, INSTR_LOCK_ENDPOINT);
+        e->tag = group;
+        e->post_time = clock_time;
+        _set_waiting(e, 3, root);
+        pthread_mutex_unlock(&e->lock);
+        pthread_mutex_unlock(&coll_lock);
+        return 0;
+    }
+
+    //the last one in: everyone is delivered at the same tick, in PID order on each node
+    *at = c->next;
+    int deliver = clock_time + 1 + _coll_cost(c);
+    for (int i = 0; i < c->count; i++) {
+        endpoint_t *me = &EP(c->members[i]);
+        INSTR_LOCK(&me->lock, INSTR_LOCK_ENDPOINT);
+        _clear_waiting(me);
+        _coll_count(c, me->ctx);
+        _push_done(me->ctx, deliver);
+        pthread_mutex_unlock(&me->lock);
+
+        if (critpath_on && c->members[i] != addr) {
+            critpath_release(c->members[i], proc->thread, proc->id, clock_time);
+        }
+    }
+    pthread_mutex_unlock(&coll_lock);
+
+    free(c->members);
+    free(c);
+    return deliver;
+}
+
+/* RECV ANY: takes the first matching sender that was already waiting before this tick, since those
+ * are the same whatever the thread timing; otherwise the receiver waits and its node matches it
+ * at the start of a later tick (msg_match_any)
+ */
+static int _recv_any(context *receiver, int tag, int clock_time, int *from) {
+    int raddr = _addr_of(receiver);
+    endpoint_t *re = &EP(raddr);
+    _init_ep(re);
+
+    INSTR_LOCK(&re->lock, INSTR_LOCK_ENDPOINT);
+    endpoint_t *se = _first_sender(re, tag);
+    if (!se || se->post_time >= clock_time) {
+        re->tag = tag;
+        re->post_time = clock_time;
+        _set_waiting(re, 2, MSG_ANY);
+        pthread_mutex_unlock(&re->lock);
+        _any_link(re);
+        return 0;
+    }
+    pthread_mutex_unlock(&re->lock);
+
+    //only this receiver takes senders off its queues, so se is still the one after relocking in order
+    int saddr = _ep_addr(se);
+    _lock_two(re, raddr, se, saddr);
+    assert(_first_sender(re, tag) == se && se->waiting_type == 1);
+    _dequeue_sender(re, se);
+    _clear_waiting(se);
+
+    receiver->recv_count++;
+
+    int deliver = _deliver_at(clock_time, se->node_id, re->node_id, se->size);
+    _push_done(receiver, deliver);
+    _sender_done(se, deliver, re->node_id);
+    _unlock_two(re, se, 0);
+
+    *from = saddr;
+    return deliver;
+}
+
+//this method handles receiving messages, returns the delivery tick if the sender was already waiting
+int msg_recv(context *receiver, int sender_addr, int tag, int clock_time, int *from) {
     int raddr = _addr_of(receiver);
+    assert(receiver->addr);
+    *from = sender_addr;
+    if (sender_addr == MSG_ANY) {
+        return _recv_any(receiver, tag, clock_time, from);
+    }
     assert(sender_addr >= 0 && sender_addr < MSG_MAX_ADDR);
 
-    _init_ep(&ep[raddr]);
-    _init_ep(&ep[sender_addr]);
+    _init_ep(&EP(raddr));
+    _init_ep(&EP(sender_addr));
 
-    endpoint_t *re = &ep[raddr];
-    endpoint_t *se = &ep[sender_addr];
+    endpoint_t *re = &EP(raddr);
+    endpoint_t *se = &EP(sender_addr);
 
     _lock_two(re, raddr, se, sender_addr);
     int same = (raddr == sender_addr);
+    int matched = 0;
 
-    //If sender is already waiting for this receiver, both are completed
-    if (se->waiting_type == 1 && se->partner_addr == raddr && se->ctx) {
-        se->waiting_type = 0;
-        se->partner_addr = 0;
+    //If sender is already waiting for this receiver with a matching tag, both are completed
+    if (se->waiting_type == 1 && se->partner_addr == raddr && _alive(se) && (tag == MSG_ANY || se->tag == tag)) {
+        _dequeue_sender(re, se);
+        _clear_waiting(se);
 
         receiver->recv_count++;
-        se->ctx->send_count++;
 
-        _push_done(receiver);
-        _push_done(se->ctx);
+        matched = _deliver_at(clock_time, se->node_id, re->node_id, se->size);
+        _push_done(receiver, matched);
+        _sender_done(se, matched, re->node_id);
     } else {
         //otherwise receiver waits for a specific sender
-        re->waiting_type = 2;
-        re->partner_addr = sender_addr;
+        re->tag = tag;
+        re->post_time = clock_time;
+        _set_waiting(re, 2, sender_addr);
     }
 
     _unlock_two(re, se, same);
+    return matched;
 }
 
-// pulls completions for thi node in ascending order of their pid
-int msg_collect_ready(int node_id, context **out, int maxn) {
+/* Every node runs this for its own RECV ANY waiters before collecting completions. Senders only
+ * queue on a receiver during Step 2, so here the queues are complete up to the previous tick and
+ * the first matching sender is the same in every run. The pair completes on the tick after.
+ */
+int msg_match_any(int node_id, int clock_time, msg_match_t *out, int maxn) {
+    int n = 0;
     _init_node(node_id);
-    pthread_mutex_lock(&pernode[node_id].lock);
+
+    endpoint_t *next;
+    for (endpoint_t *re = pernode[node_id].any_head; re && n < maxn; re = next) {
+        next = re->any_next;
+        int raddr = _ep_addr(re);
+
+        INSTR_LOCK(&re->lock, INSTR_LOCK_ENDPOINT);
+        endpoint_t *se = _first_sender(re, re->tag);
+        pthread_mutex_unlock(&re->lock);
+        if (!se || !_alive(se)) {
+            continue;
+        }
+
+        int saddr = _ep_addr(se);
+        _lock_two(re, raddr, se, saddr);
+        _dequeue_sender(re, se);
+        _clear_waiting(se);
+        _clear_waiting(re);
+
+        re->ctx->recv_count++;
+
+        int deliver = _deliver_at(clock_time, se->node_id, re->node_id, se->size);
+        _push_done(re->ctx, deliver);
+        _sender_done(se, deliver, node_id);
+
+        //the one that came last made the rendezvous
+        int sender_last = se->post_time > re->post_time;
+        out[n].sender_addr = saddr;
+        out[n].receiver_addr = raddr;
+        out[n].deliver = deliver;
+        out[n].time = sender_last ? se->post_time : re->post_time;
+        out[n].waiter_addr = sender_last ? raddr : saddr;
+        out[n].matcher_node = sender_last ? se->node_id : re->node_id;
+        out[n].matcher_pid = sender_last ? (se->remote ? saddr % 100 : se->ctx->id) : re->ctx->id;
+        n++;
+
+        _unlock_two(re, se, 0);
+        _any_unlink(re);
+    }
+    return n;
+}
+
+// pulls completions for thi node that are due by clock_time, in ascending order of their address
+int msg_collect_ready(int node_id, int clock_time, context **out, int maxn) {
+    _init_node(node_id);
+    INSTR_LOCK(&pernode[node_id].lock, INSTR_LOCK_PERNODE);
 
     int n = 0;
+    prio_q_t *ready = pernode[node_id].ready;
 
-    while (n < maxn  && !prio_q_empty(pernode[node_id].ready)) {
+    while (n < maxn && !prio_q_empty(ready) && ready->head->priority / MSG_MAX_ADDR <= clock_time) {
         out[n++] = (context*) prio_q_remove(pernode[node_id].ready);
     }
 
@@ -210,26 +803,217 @@ int msg_collect_ready(int node_id, context **out, int maxn) {
 int msg_has_blocked_or_ready(int node_id) {
     _init_node(node_id);
 
-    // Any completions queued for this node?
-    pthread_mutex_lock( &pernode[node_id].lock);
-    int has = !prio_q_empty(pernode[node_id].ready);
+    //Any completions queued for this node, or addresses on it still waiting on a SEND/RECV?
+    INSTR_LOCK(&pernode[node_id].lock, INSTR_LOCK_PERNODE);
+    int has = !prio_q_empty(pernode[node_id].ready) || pernode[node_id].waiting > 0;
     pthread_mutex_unlock(&pernode[node_id].lock);
 
-    if (has) return 1;
+    return has;
+}
 
-    //Any addresses on this node currently waiting on a SEND/RECV left?
-    for (int addr = 0;  addr < MSG_MAX_ADDR; ++addr) {
-        if (!ep[addr].init)  continue;
-        pthread_mutex_lock(&ep[addr].lock);
+//how many of this node's processes are blocked in SEND and in RECV right now
+void msg_waiting_counts(int node_id, int *sends, int *recvs) {
+    _init_node(node_id);
+    INSTR_LOCK(&pernode[node_id].lock, INSTR_LOCK_PERNODE);
+    *sends = pernode[node_id].waiting_send;
+    *recvs = pernode[node_id].waiting_recv;
+    pthread_mutex_unlock(&pernode[node_id].lock);
+}
+
+//report this node's state for the tick; only touches the global counters when the status changes
+void msg_tick_state(int node_id, int busy, int clock_time) {
+    _init_node(node_id);
+    pernode_t *pn = &pernode[node_id];
+
+    //a RECV ANY with a sender waiting is matched next tick, so the node still makes progress
+    for (endpoint_t *re = pn->any_head; re && !busy; re = re->any_next) {
+        INSTR_LOCK(&re->lock, INSTR_LOCK_ENDPOINT);
+        busy = _first_sender(re, re->tag) != NULL;
+        pthread_mutex_unlock(&re->lock);
+    }
 
+    INSTR_LOCK(&pn->lock, INSTR_LOCK_PERNODE);
+    int status = NODE_DONE;
+    if (busy || !prio_q_empty(pn->ready)) {
+        status = NODE_BUSY;
+    } else if (pn->waiting > 0) {
+        status = NODE_STUCK;
+    }
+    pthread_mutex_unlock(&pn->lock);
+
+    pn->clock_time = clock_time;
+    if (status == pn->status) return;
+
+    pthread_mutex_lock(&dl_lock);
+    dl_busy  -= pn->status == NODE_BUSY;
+    dl_stuck -= pn->status == NODE_STUCK;
+    dl_busy  += status == NODE_BUSY;
+    dl_stuck += status == NODE_STUCK;
+    pthread_mutex_unlock(&dl_lock);
 
-        if (ep[addr].ctx && ep[addr].ctx->thread == node_id && ep[addr].waiting_type != 0) {
-            pthread_mutex_unlock(&ep[addr].lock);
+    pn->status = status;
+}
+
+//true while some node reported being able to make progress on its own in the last tick
+int msg_any_busy(void) {
+    pthread_mutex_lock(&dl_lock);
+    int busy = (dl_shared ? dl_all_busy : dl_busy) > 0;
+    pthread_mutex_unlock(&dl_lock);
+    return busy;
+}
+
+//true if no node can make progress but some processes are still blocked on messages
+int msg_deadlocked(void) {
+    pthread_mutex_lock(&dl_lock);
+    int dead = dl_shared ? dl_all_busy == 0 && dl_all_stuck > 0 : dl_busy == 0 && dl_stuck > 0;
+    pthread_mutex_unlock(&dl_lock);
+    return dead;
+}
+
+//how many of this process' nodes reported being busy and stuck on messages
+void msg_dl_counts(int *busy, int *stuck) {
+    pthread_mutex_lock(&dl_lock);
+    *busy = dl_busy;
+    *stuck = dl_stuck;
+    pthread_mutex_unlock(&dl_lock);
+}
+
+//from now on the wait-for summary is the one given, summed over every shard
+void msg_dl_set(int busy, int stuck) {
+    pthread_mutex_lock(&dl_lock);
+    dl_shared = 1;
+    dl_all_busy = busy;
+    dl_all_stuck = stuck;
+    pthread_mutex_unlock(&dl_lock);
+}
+
+//the wait-for edges of the processes run here, stand-ins for other shards' senders left out
+int msg_export_waits(msg_wait_t *out, int maxn) {
+    int n = 0;
+    for (int addr = 0; addr < MSG_MAX_ADDR && n < maxn; addr++) {
+        endpoint_t *e = &EP(addr);
+        if (!e->init || e->remote || e->waiting_type == 0) continue;
+        out[n].node_id = e->node_id;
+        out[n].clock_time = pernode[e->node_id].clock_time;
+        out[n].addr = addr;
+        out[n].type = e->waiting_type;
+        out[n].partner_addr = e->partner_addr;
+        n++;
+    }
+    return n;
+}
 
-            return 1;
+//adds a wait-for edge reported by a shard, whose node is then stuck as of clock_time
+void msg_import_wait(const msg_wait_t *w) {
+    assert(w->addr >= 0 && w->addr < MSG_MAX_ADDR && w->node_id >= 0 && w->node_id <= MSG_MAX_THREADS);
+    endpoint_t *e = &EP(w->addr);
+    _init_ep(e);
+    e->node_id = w->node_id;
+    e->waiting_type = w->type;
+    e->partner_addr = w->partner_addr;
+    pernode[w->node_id].status = NODE_STUCK;
+    pernode[w->node_id].clock_time = w->clock_time;
+}
+
+//print an address as NN.PP, the same way the summary names processes
+static void _print_addr(FILE *fout, int addr) {
+    fprintf(fout, "%2.2d.%2.2d", addr / 100, addr % 100);
+}
+
+//the collective a waiting process is in
+static collective_t *_coll_of(int addr) {
+    for (collective_t *c = colls; c; c = c->next) {
+        for (int i = 0; i < c->arrived; i++) {
+            if (c->members[i] == addr) return c;
         }
+    }
+    return NULL;
+}
 
-        pthread_mutex_unlock(&ep [addr].lock);
+static const char *_coll_name(int op) {
+    return op == OP_BCAST ? "bcast" : op == OP_GATHER ? "gather" : "allreduce";
+}
+
+//walk the wait-for graph (each waiting endpoint has exactly one outgoing edge) and
+//print every cycle once, plus every process waiting on a finished or unknown partner
+//or in a collective that can no longer fill
+void msg_report_deadlock(FILE *fout) {
+    char *color = calloc(MSG_MAX_ADDR, 1);   /* 0 unvisited, 1 on current path, 2 done */
+    assert(color);
+
+    int when = 0;
+    for (int n = 0; n <= MSG_MAX_THREADS; n++) {
+        if (pernode[n].status == NODE_STUCK && pernode[n].clock_time > when) {
+            when = pernode[n].clock_time;
+        }
     }
-    return 0;
+
+    //a process in a collective waits on no one in particular; SEND/RECV chains that reach it end there
+    for (int addr = 0; addr < MSG_MAX_ADDR; addr++) {
+        if (!EP(addr).init || EP(addr).waiting_type != 3) continue;
+        collective_t *c = _coll_of(addr);
+        assert(c);
+        fprintf(fout, "| %5.5d | Deadlock | Proc ", when);
+        _print_addr(fout, addr);
+        if (c->arrived < c->count) {
+            fprintf(fout, " blocked (%s) in group %d with %d of %d in\n", _coll_name(c->op), c->group,
+                    c->arrived, c->count);
+        } else {
+            fprintf(fout, " blocked (%s) in group %d without its root ", _coll_name(c->op), c->group);
+            _print_addr(fout, c->root);
+            fprintf(fout, "\n");
+        }
+        color[addr] = 2;
+    }
+
+    for (int start = 0; start < MSG_MAX_ADDR; start++) {
+        if (color[start] || !EP(start).init || EP(start).waiting_type == 0) continue;
+
+        //follow partner links until we leave the waiting set or revisit something
+        int addr = start;
+        while (addr >= 0 && addr < MSG_MAX_ADDR && EP(addr).init && EP(addr).waiting_type != 0 &&
+               !color[addr]) {
+            color[addr] = 1;
+            addr = EP(addr).partner_addr;
+        }
+
+        if (addr >= 0 && addr < MSG_MAX_ADDR && color[addr] == 1) {
+            //found a new cycle through addr; print it starting from its lowest address
+            int low = addr;
+            for (int a = EP(addr).partner_addr; a != addr; a = EP(a).partner_addr) {
+                if (a < low) low = a;
+            }
+
+            fprintf(fout, "| %5.5d | Deadlock | cycle ", when);
+            int a = low;
+            do {
+                _print_addr(fout, a);
+                fprintf(fout, " -(%s)-> ", EP(a).waiting_type == 1 ? "send" : "recv");
+                a = EP(a).partner_addr;
+            } while (a != low);
+            _print_addr(fout, low);
+            fprintf(fout, "\n");
+        } else if (!(addr >= 0 && addr < MSG_MAX_ADDR && color[addr] == 2)) {
+            //the chain ends at a partner that is not waiting: it finished or never existed
+            int last = start;
+            while (EP(last).partner_addr != addr) last = EP(last).partner_addr;
+
+            fprintf(fout, "| %5.5d | Deadlock | Proc ", when);
+            _print_addr(fout, last);
+            if (addr == MSG_ANY) {
+                fprintf(fout, " blocked (recv) on any source\n");
+            } else {
+                fprintf(fout, " blocked (%s) on finished or unknown ", EP(last).waiting_type == 1 ? "send" : "recv");
+                _print_addr(fout, addr);
+                fprintf(fout, "\n");
+            }
+        }
+
+        //everything on this path has now been reported
+        for (addr = start; addr >= 0 && addr < MSG_MAX_ADDR && color[addr] == 1; addr = EP(addr).partner_addr) {
+            color[addr] = 2;
+        }
+    }
+
+    free(color);
 }
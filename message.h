@@ -4,6 +4,7 @@
 #ifndef PROSIM_MESSAGE_H
 #define PROSIM_MESSAGE_H
 
+#include <stdio.h>
 #include "context.h"
 
 
@@ -14,14 +15,84 @@ void msg_init(void);
 //this registers a process' node and pid for address mapping once it has a PID
 void msg_register(int node_id, context *proc);
 
-//synchronous primitives - called by a process currently running on its ticks
-void msg_send(context *sender, int receiver_addr);
-void msg_recv(context *receiver, int sender_addr);
+//this drops a finished process' address mapping so its context can be freed
+void msg_unregister(context *proc);
 
-//this method collects locally completed send/recvs (ordered by PID). returns the count
-int msg_collect_ready(int node_id, context **out, int maxn);
+//a process migrated to node_id but keeps its address; completions go to its new node from now on
+void msg_migrate(context *proc, int node_id);
 
-//this method returns true if this node has any msg-completions pending or procs blocked in SEND/RECV
+//synchronous primitives - called by a process currently running on its ticks.
+//if the partner was already waiting, the rendezvous happens in this call and both partners are
+//delivered at the returned tick (the next one, plus the interconnect cost if a model is loaded); 0 otherwise.
+//a RECV takes sender_addr or MSG_ANY, and tag or MSG_ANY; from is set to the sender it matched
+int msg_send(context *sender, int receiver_addr, int tag, int size, int clock_time);
+int msg_recv(context *receiver, int sender_addr, int tag, int clock_time, int *from);
+
+//collectives - called by a process currently running its BCAST, GATHER or ALLREDUCE.
+//it waits on the instance named by the op's root, count and group until count processes are in; the one
+//that completes it delivers them all at the returned tick (the next one, plus the slowest transfer the
+//collective makes if a model is loaded), 0 is returned to the others
+int msg_collective(context *proc, int clock_time);
+
+//a rendezvous made by msg_match_any
+typedef struct msg_match {
+    int sender_addr, receiver_addr;
+    int deliver;          /* tick both are delivered */
+    int time;             /* tick the later of the two started waiting */
+    int waiter_addr;      /* the earlier of the two */
+    int matcher_node;     /* node and pid of the later one */
+    int matcher_pid;
+} msg_match_t;
+
+//matches this node's processes waiting in RECV ANY with senders that queued on them before this tick.
+//called at the start of each tick, before msg_collect_ready. returns the count
+int msg_match_any(int node_id, int clock_time, msg_match_t *out, int maxn);
+
+//this method collects the send/recvs completed for this node by clock_time (ordered by PID). returns the count
+int msg_collect_ready(int node_id, int clock_time, context **out, int maxn);
+
+//this method returns true if this node has any msg-completions pending or procs blocked in SEND/RECV or a collective
 int msg_has_blocked_or_ready(int node_id);
 
+//gives the number of processes on this node blocked in SEND and in RECV, kept up to date incrementally
+void msg_waiting_counts(int node_id, int *sends, int *recvs);
+
+//reports whether this node did any work this tick (running, ready or timer-blocked processes).
+//called once per tick before the last barrier so every node sees the same wait-for summary
+void msg_tick_state(int node_id, int busy, int clock_time);
+
+//true while some node reported being able to make progress on its own in the last tick
+int msg_any_busy(void);
+
+//true once every remaining process is blocked in a SEND/RECV cycle, on a dead partner or in a collective that
+//can no longer fill
+int msg_deadlocked(void);
+
+//prints the cycles and dead-partner waits found in the wait-for graph
+void msg_report_deadlock(FILE *fout);
+
+/* Sharded runs (see shard.h). A SEND to a receiver run by another shard only marks the sender as
+ * waiting; it is applied on the receiver's shard with msg_remote_send once the tick's SEND/RECVs
+ * are all in, where a stand-in for the sender is queued and matched like any local one. The
+ * receiver's shard makes every match and tells the sender's shard through msg_remote_match, in
+ * time for the sender to be delivered at the same tick as in a threaded run.
+ */
+void msg_remote_send(int sender_addr, int sender_node, int receiver_addr, int tag, int size, int clock_time);
+void msg_remote_match(int sender_addr, int deliver);
+
+//this process' share of the wait-for summary, and the summary over every shard once it is known
+void msg_dl_counts(int *busy, int *stuck);
+void msg_dl_set(int busy, int stuck);
+
+//a waiting process' edge in the wait-for graph, as shipped from a shard after a deadlock
+typedef struct msg_wait {
+    int node_id, clock_time;  /* its node, and the node's clock when it last reported */
+    int addr, type;           /* its address; 1 SEND, 2 RECV */
+    int partner_addr;
+} msg_wait_t;
+
+//the edges of the processes waiting here, returns the count; and adding one from another shard
+int msg_export_waits(msg_wait_t *out, int maxn);
+void msg_import_wait(const msg_wait_t *w);
+
 #endif
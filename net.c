@@ -0,0 +1,96 @@
+//filename: net.c
+//Description: interconnect model for SEND/RECV, see net.h
+
+#include <stdio.h>
+#include <string.h>
+
+#include "net.h"
+
+#define NET_MAX_NODES 101
+
+typedef struct link {
+    int latency;        /* ticks before the first unit arrives */
+    int bandwidth;      /* size units per tick, 0 = unlimited */
+} link_t;
+
+//resolved cost of every node pair, filled from the defaults and then the overrides
+static link_t links[NET_MAX_NODES][NET_MAX_NODES];
+int net_on = 0;
+
+//latency and optional bandwidth at the end of a line; both must be non-negative
+static int _parse_link(const char *s, link_t *l) {
+    l->bandwidth = 0;
+    int n = sscanf(s, "%d %d", &l->latency, &l->bandwidth);
+    return n >= 1 && l->latency >= 0 && l->bandwidth >= 0;
+}
+
+//reads the file, applying intra/inter first so that link lines win wherever they appear
+int net_load(const char *path) {
+    FILE *fin = fopen(path, "r");
+    if (!fin) {
+        perror(path);
+        return 0;
+    }
+
+    link_t intra = {0, 0}, inter = {0, 0};
+    static struct { int a, b; link_t l; } over[NET_MAX_NODES * NET_MAX_NODES];
+    int num_over = 0;
+    char line[256];
+    int lineno = 0, ok = 1;
+
+    while (ok && fgets(line, sizeof(line), fin)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char key[16];
+        int used;
+        if (sscanf(line, "%15s %n", key, &used) < 1) {
+            continue;       /* blank or comment */
+        }
+        if (!strcmp(key, "intra")) {
+            ok = _parse_link(line + used, &intra);
+        } else if (!strcmp(key, "inter")) {
+            ok = _parse_link(line + used, &inter);
+        } else if (!strcmp(key, "link") && num_over < (int)(sizeof(over) / sizeof(over[0]))) {
+            int a, b, n;
+            ok = sscanf(line + used, "%d %d %n", &a, &b, &n) == 2 &&
+                 a > 0 && a < NET_MAX_NODES && b > 0 && b < NET_MAX_NODES &&
+                 _parse_link(line + used + n, &over[num_over].l);
+            over[num_over].a = a;
+            over[num_over].b = b;
+            num_over++;
+        } else {
+            ok = 0;
+        }
+    }
+    fclose(fin);
+    if (!ok) {
+        fprintf(stderr, "%s:%d: expecting intra/inter latency [bandwidth] or link a b latency [bandwidth]\n",
+                path, lineno);
+        return 0;
+    }
+
+    for (int i = 0; i < NET_MAX_NODES; i++) {
+        for (int j = 0; j < NET_MAX_NODES; j++) {
+            links[i][j] = i == j ? intra : inter;
+        }
+    }
+    for (int k = 0; k < num_over; k++) {
+        links[over[k].a][over[k].b] = over[k].l;
+        links[over[k].b][over[k].a] = over[k].l;
+    }
+
+    net_on = 1;
+    return 1;
+}
+
+//latency plus ceil(size / bandwidth)
+int net_cost(int from, int to, int size) {
+    const link_t *l = &links[from][to];
+    int cost = l->latency;
+    if (l->bandwidth > 0 && size > 0) {
+        cost += (size + l->bandwidth - 1) / l->bandwidth;
+    }
+    return cost;
+}
@@ -0,0 +1,35 @@
+//filename: net.h
+//Description: interconnect model for SEND/RECV. A message takes a latency plus its size over the
+//bandwidth to arrive, with separate defaults for partners on the same node and on different nodes
+//and per-link overrides. Without a model every rendezvous completes on the next tick, as before.
+//
+//Model file, one setting per line ('#' starts a comment):
+//  intra latency [bandwidth]       partners on the same node
+//  inter latency [bandwidth]       partners on different nodes
+//  link a b latency [bandwidth]    nodes a and b, both directions
+//Latencies are in ticks, bandwidths in size units per tick (0 or missing = unlimited).
+#ifndef PROSIM_NET_H
+#define PROSIM_NET_H
+
+//non-zero once a model has been loaded
+extern int net_on;
+
+/* Loads an interconnect model
+ * @params:
+ *   path: model file
+ * @returns:
+ *   1 on success, 0 if the file cannot be read or has a bad line (reported on stderr)
+ */
+extern int net_load(const char *path);
+
+/* Extra ticks a message of the given size takes from one node to another
+ * @params:
+ *   from : sender's node
+ *   to   : receiver's node
+ *   size : message size (SEND's optional second operand, 0 if not given)
+ * @returns:
+ *   latency plus transfer time, rounded up to whole ticks
+ */
+extern int net_cost(int from, int to, int size);
+
+#endif
@@ -0,0 +1,305 @@
+//filename: place.c
+//Description: static workload cost estimation and load balancing node placement, see place.h
+//The partitioner is a greedy assignment in decreasing order of load, preferring the node a program
+//talks to most among those that stay within the balance limit, followed by passes that move single
+//programs to the node they talk to most while the limit still holds (in the style of Fiduccia-Mattheyses
+//refinement, without the tentative negative moves).
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "place.h"
+
+#define PLACE_MAX_PIDS   99         /* highest addressable pid on a node */
+#define PLACE_IMBALANCE  1.05       /* allowed load over the average */
+#define PLACE_PASSES     16
+
+typedef struct place_edge {
+    int to;                         /* program index */
+    long long weight;               /* # of messages */
+} place_edge_t;
+
+typedef struct place_prog {
+    long long cpu;                  /* ticks of DOOP, SEND and RECV */
+    long long block;                /* ticks of BLOCK */
+    int old_node, new_node;
+    int old_pid, new_pid;
+    int first, nedges;              /* slice of the adjacency array */
+} place_prog_t;
+
+/* Counts the cost of a program with loops multiplied out and reports every SEND/RECV target
+ * @params:
+ *   proc : program
+ *   p    : where to store the costs
+ *   peer : called with (target address, # of executions, arg) for every SEND/RECV, or NULL
+ * @returns:
+ *   none
+ */
+static void _cost(context *proc, place_prog_t *p,
+                  void (*peer)(int addr, long long times, void *arg), void *arg) {
+    long long mult[64];
+    int depth = 0;
+    long long times = 1;
+
+    p->cpu = p->block = 0;
+    for (int i = 0; proc->code[i].op != OP_HALT; i++) {
+        opcode *op = &proc->code[i];
+        switch (op->op) {
+            case OP_LOOP:
+                assert(depth < 64);
+                mult[depth++] = times;
+                times *= op->arg > 0 ? op->arg : 1;
+                break;
+            case OP_END:
+                if (depth > 0) times = mult[--depth];
+                break;
+            case OP_DOOP:
+                p->cpu += times * op->arg;
+                break;
+            case OP_BLOCK:
+                p->block += times * op->arg;
+                break;
+            case OP_SEND:
+            case OP_RECV:
+            case OP_BCAST:
+            case OP_GATHER:
+                p->cpu += times;
+                if (peer) peer(op->arg, times, arg);
+                break;
+            case OP_ALLREDUCE:
+                p->cpu += times;
+                break;
+        }
+    }
+}
+
+typedef struct place_graph {
+    int *addr_map;                  /* old address -> program index, -1 if none */
+    int max_addr;
+    int from;                       /* program whose code is being scanned */
+    int (*pairs)[2];                /* edge list, one entry per SEND/RECV op */
+    long long *weights;
+    int n, cap;
+} place_graph_t;
+
+//collects one edge of the message graph
+static void _add_edge(int addr, long long times, void *arg) {
+    place_graph_t *g = arg;
+    if (addr < 0 || addr >= g->max_addr || g->addr_map[addr] < 0 || g->addr_map[addr] == g->from) {
+        return;
+    }
+    if (g->n == g->cap) {
+        g->cap = g->cap ? 2 * g->cap : 256;
+        g->pairs = realloc(g->pairs, g->cap * sizeof(*g->pairs));
+        g->weights = realloc(g->weights, g->cap * sizeof(long long));
+        assert(g->pairs && g->weights);
+    }
+    g->pairs[g->n][0] = g->from;
+    g->pairs[g->n][1] = g->addr_map[addr];
+    g->weights[g->n++] = times;
+}
+
+//weight of the message edges that cross nodes under the given assignment
+static long long _cut(place_graph_t *g, place_prog_t *p, int use_new) {
+    long long cut = 0;
+    for (int e = 0; e < g->n; e++) {
+        place_prog_t *a = &p[g->pairs[e][0]], *b = &p[g->pairs[e][1]];
+        if ((use_new ? a->new_node != b->new_node : a->old_node != b->old_node)) {
+            cut += g->weights[e];
+        }
+    }
+    return cut;
+}
+
+//largest node load under the given assignment
+static long long _max_load(place_prog_t *p, int n, int num_threads, int use_new) {
+    long long load[num_threads + 1];
+    long long max = 0;
+    memset(load, 0, sizeof(load));
+    for (int i = 0; i < n; i++) {
+        int node = use_new ? p[i].new_node : p[i].old_node;
+        load[node] += p[i].cpu;
+        if (load[node] > max) max = load[node];
+    }
+    return max;
+}
+
+//programs in decreasing order of load, ties in input order
+static place_prog_t *sort_base;
+static int _cmp_load(const void *a, const void *b) {
+    const place_prog_t *x = &sort_base[*(const int *)a], *y = &sort_base[*(const int *)b];
+    if (x->cpu != y->cpu) return x->cpu > y->cpu ? -1 : 1;
+    return *(const int *)a - *(const int *)b;
+}
+
+extern void place_programs(context **procs, int num_procs, int num_threads, FILE *fout) {
+    place_prog_t *p = calloc(num_procs + 1, sizeof(place_prog_t));
+    assert(p);
+    place_graph_t g = {0};
+
+    /* Old addresses: pids follow input order on each node
+     */
+    g.max_addr = (num_threads + 1) * 100;
+    g.addr_map = malloc(g.max_addr * sizeof(int));
+    assert(g.addr_map);
+    memset(g.addr_map, -1, g.max_addr * sizeof(int));
+
+    int count[num_threads + 1];
+    memset(count, 0, sizeof(count));
+    for (int i = 0; i < num_procs; i++) {
+        p[i].old_node = procs[i]->thread;
+        p[i].old_pid = ++count[p[i].old_node];
+        if (p[i].old_pid <= PLACE_MAX_PIDS) {
+            g.addr_map[p[i].old_node * 100 + p[i].old_pid] = i;
+        }
+    }
+
+    /* Costs and the message graph, kept as adjacency lists both ways
+     */
+    for (int i = 0; i < num_procs; i++) {
+        g.from = i;
+        _cost(procs[i], &p[i], _add_edge, &g);
+    }
+    int *degree = calloc(num_procs + 1, sizeof(int));
+    place_edge_t *adj = malloc((2 * g.n + 1) * sizeof(place_edge_t));
+    assert(degree && adj);
+    for (int e = 0; e < g.n; e++) {
+        degree[g.pairs[e][0]]++;
+        degree[g.pairs[e][1]]++;
+    }
+    for (int i = 0, at = 0; i < num_procs; i++) {
+        p[i].first = at;
+        at += degree[i];
+    }
+    for (int e = 0; e < g.n; e++) {
+        for (int k = 0; k < 2; k++) {
+            place_prog_t *a = &p[g.pairs[e][k]];
+            adj[a->first + a->nedges++] = (place_edge_t){g.pairs[e][1 - k], g.weights[e]};
+        }
+    }
+
+    /* Balance limit: a little over the average, but never below the largest single program
+     */
+    long long total = 0, biggest = 0;
+    for (int i = 0; i < num_procs; i++) {
+        total += p[i].cpu;
+        if (p[i].cpu > biggest) biggest = p[i].cpu;
+    }
+    long long limit = (long long)(PLACE_IMBALANCE * total / num_threads) + 1;
+    if (limit < biggest) limit = biggest;
+    int slots = (num_procs + num_threads - 1) / num_threads;
+    if (slots < PLACE_MAX_PIDS) slots = PLACE_MAX_PIDS;
+
+    long long load[num_threads + 1];
+    long long aff[num_threads + 1];
+    memset(load, 0, sizeof(load));
+    memset(aff, 0, sizeof(aff));
+    memset(count, 0, sizeof(count));
+
+    /* Greedy: heaviest first, to the node it talks to most among those that fit
+     */
+    int *order = malloc((num_procs + 1) * sizeof(int));
+    assert(order);
+    for (int i = 0; i < num_procs; i++) {
+        order[i] = i;
+        p[i].new_node = 0;
+    }
+    sort_base = p;
+    qsort(order, num_procs, sizeof(int), _cmp_load);
+
+    for (int k = 0; k < num_procs; k++) {
+        place_prog_t *a = &p[order[k]];
+        for (int e = a->first; e < a->first + a->nedges; e++) {
+            aff[p[adj[e].to].new_node] += adj[e].weight;
+        }
+        int best = 0, fallback = 0;
+        for (int n = 1; n <= num_threads; n++) {
+            if (count[n] >= slots) continue;
+            if (!fallback || load[n] < load[fallback]) fallback = n;
+            if (load[n] + a->cpu > limit) continue;
+            if (!best || aff[n] > aff[best] || (aff[n] == aff[best] && load[n] < load[best])) best = n;
+        }
+        a->new_node = best ? best : fallback;
+        load[a->new_node] += a->cpu;
+        count[a->new_node]++;
+        for (int e = a->first; e < a->first + a->nedges; e++) {
+            aff[p[adj[e].to].new_node] = 0;
+        }
+        aff[0] = 0;
+    }
+
+    /* Refinement: move a program to the node it talks to more if the limit holds,
+     * or to an equally good node if that evens out the load. Every move lowers the cut or the imbalance.
+     */
+    for (int pass = 0; pass < PLACE_PASSES; pass++) {
+        int moved = 0;
+        for (int i = 0; i < num_procs; i++) {
+            place_prog_t *a = &p[i];
+            int from = a->new_node;
+            for (int e = a->first; e < a->first + a->nedges; e++) {
+                aff[p[adj[e].to].new_node] += adj[e].weight;
+            }
+            int best = from;
+            for (int n = 1; n <= num_threads; n++) {
+                if (n == from || count[n] >= slots || load[n] + a->cpu > limit) continue;
+                long long gain = aff[n] - aff[best];
+                if (gain > 0 || (gain == 0 && best == from && load[n] + a->cpu < load[from])) {
+                    best = n;
+                }
+            }
+            for (int e = a->first; e < a->first + a->nedges; e++) {
+                aff[p[adj[e].to].new_node] = 0;
+            }
+            if (best != from) {
+                load[from] -= a->cpu;
+                count[from]--;
+                load[best] += a->cpu;
+                count[best]++;
+                a->new_node = best;
+                moved++;
+            }
+        }
+        if (!moved) break;
+    }
+
+    /* New pids follow input order on the new nodes; then rewrite every SEND/RECV target and collective root
+     */
+    memset(count, 0, sizeof(count));
+    for (int i = 0; i < num_procs; i++) {
+        p[i].new_pid = ++count[p[i].new_node];
+    }
+    for (int i = 0; i < num_procs; i++) {
+        for (int k = 0; procs[i]->code[k].op != OP_HALT; k++) {
+            opcode *op = &procs[i]->code[k];
+            if ((op->op != OP_SEND && op->op != OP_RECV && op->op != OP_BCAST && op->op != OP_GATHER) ||
+                op->arg == MSG_ANY) continue;
+
+            int to = op->arg >= 0 && op->arg < g.max_addr ? g.addr_map[op->arg] : -1;
+            if (to >= 0 && p[to].new_pid <= PLACE_MAX_PIDS) {
+                op->arg = p[to].new_node * 100 + p[to].new_pid;
+            } else {
+                op->arg = op->arg % 100;
+            }
+        }
+        procs[i]->thread = p[i].new_node;
+    }
+
+    if (fout) {
+        fprintf(fout, "Placement: max node load %lld -> %lld (average %lld), cross-node SEND/RECV ops %lld -> %lld\n",
+                _max_load(p, num_procs, num_threads, 0), _max_load(p, num_procs, num_threads, 1),
+                total / num_threads, _cut(&g, p, 0), _cut(&g, p, 1));
+        for (int i = 0; i < num_procs; i++) {
+            fprintf(fout, "| %-10s | %2.2d.%2.2d -> %2.2d.%2.2d | cpu %lld | block %lld\n", procs[i]->name,
+                    p[i].old_node, p[i].old_pid, p[i].new_node, p[i].new_pid, p[i].cpu, p[i].block);
+        }
+    }
+
+    free(order);
+    free(adj);
+    free(degree);
+    free(g.pairs);
+    free(g.weights);
+    free(g.addr_map);
+    free(p);
+}
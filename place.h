@@ -0,0 +1,25 @@
+//filename: place.h
+//Description: static cost estimation and node placement. Opcode streams are static, so each program's
+//CPU and BLOCK time and its SEND/RECV traffic can be counted from its code before the run (loops are
+//multiplied out). The placement reassigns programs to nodes to balance CPU load while keeping
+//communicating programs together, and rewrites SEND/RECV addresses to the new node*100 + pid.
+#ifndef PROSIM_PLACE_H
+#define PROSIM_PLACE_H
+
+#include <stdio.h>
+#include "context.h"
+
+/* Reassign programs to nodes and rewrite their message addresses
+ * Programs keep their input order; on each node pids are given in that order, as the feed admits them.
+ * Addresses that named no program keep their pid but move to node 0, where nothing ever runs.
+ * @params:
+ *   procs       : every program, in input order, all on valid nodes
+ *   num_procs   : # of programs
+ *   num_threads : # of nodes
+ *   fout        : where to print the mapping and the load/cut before and after, or NULL
+ * @returns:
+ *   none
+ */
+extern void place_programs(context **procs, int num_procs, int num_threads, FILE *fout);
+
+#endif
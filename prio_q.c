@@ -2,6 +2,7 @@
 #include <string.h>
 #include <assert.h>
 #include "prio_q.h"
+#include "instr.h"
 
 /* Creates an empty priority queue and returns a pointer to it.
  * @params:
@@ -23,7 +24,7 @@ extern prio_q_t *prio_q_new() {
  * @returns:
  *   pointer to new node.
  */
-static node_t *new_node(prio_q_t *queue, void *contents, int priority) {
+static node_t *new_node(prio_q_t *queue, void *contents, long long priority) {
     assert(queue != NULL);
 
     /* If our free list has free nodes, use one of them
@@ -53,10 +54,12 @@ static node_t *new_node(prio_q_t *queue, void *contents, int priority) {
  * @returns:
  *   none
  */
-extern void prio_q_add(prio_q_t *list, void *contents, int priority) {
+extern void prio_q_add(prio_q_t *list, void *contents, long long priority) {
     /* Assume we successfully allocate a new node
      */
     node_t *node = new_node(list, contents, priority);
+    INSTR_COUNT(q_add);
+    list->count++;
 
     /* Deal with four cases
      * 1. queue is empty
@@ -77,7 +80,13 @@ extern void prio_q_add(prio_q_t *list, void *contents, int priority) {
         /* If case 4, need to walk the list to find where to insert
          */
         node_t *tmp;
+#ifdef PROSIM_INSTRUMENT
+        long long steps = 0;
+        for (tmp = list->head; tmp->next->priority <= priority; tmp = tmp->next, steps++);
+        INSTR_WALK(steps);
+#else
         for (tmp = list->head; tmp->next->priority <= priority; tmp = tmp->next );
+#endif
         node->next = tmp->next;
         tmp->next = node;
     }
@@ -94,6 +103,17 @@ extern int prio_q_empty(prio_q_t  *list) {
     return list->head == NULL;
 }
 
+/* Returns the number of items in the queue, in constant time
+ * @params:
+ *   queue : pointer to the priority queue
+ * @returns:
+ *   number of items in the queue
+ */
+extern int prio_q_size(prio_q_t *list) {
+    assert(list != NULL);
+    return list->count;
+}
+
 /* Removes and returns the item at the head of the queue.
  * @params:
  *   queue : pointer to the priority queue
@@ -103,9 +123,11 @@ extern int prio_q_empty(prio_q_t  *list) {
 extern void * prio_q_remove(prio_q_t *list) {
     assert(list != NULL);
     assert(list->head != NULL);
+    INSTR_COUNT(q_remove);
 
     node_t *node = list->head;
     list->head = list->head->next;
+    list->count--;
     if (list->head == NULL) {
         /* if the queue becomes empty, be sure head and tail are NULL
          */
@@ -119,6 +141,40 @@ extern void * prio_q_remove(prio_q_t *list) {
     return node->contents;
 }
 
+/* Removes and returns the first item that the predicate accepts
+ * @params:
+ *   queue : pointer to the priority queue
+ *   pred  : called with (item, arg), returns non-zero for the item wanted
+ *   arg   : passed to pred
+ * @returns:
+ *   pointer to the item or NULL if no item is accepted
+ */
+extern void * prio_q_remove_if(prio_q_t *list, int (*pred)(void *contents, void *arg), void *arg) {
+    assert(list != NULL);
+
+    node_t *prev = NULL;
+    for (node_t *node = list->head; node; prev = node, node = node->next) {
+        if (!pred(node->contents, arg)) {
+            continue;
+        }
+        INSTR_COUNT(q_remove);
+        if (prev) {
+            prev->next = node->next;
+        } else {
+            list->head = node->next;
+        }
+        if (list->tail == node) {
+            list->tail = prev;
+        }
+        list->count--;
+
+        node->next = list->free;
+        list->free = node;
+        return node->contents;
+    }
+    return NULL;
+}
+
 /* Returns but does not remove the item at the head of the queue.
  * @params:
  *   queue : pointer to the priority queue
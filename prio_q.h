@@ -11,7 +11,7 @@
 
 typedef struct node {
     struct node *next;    /* pointer to next node in the list */
-    int priority;         /* priority of item in the queue */
+    long long priority;   /* priority of item in the queue (wide enough for composite time keys) */
     void *contents;       /* pointer to item */
 } node_t;
 
@@ -19,6 +19,7 @@ typedef struct prio_q {
     node_t *head;         /* pointer to head node in list or null if empty */
     node_t *tail;         /* pointer to tail node in list of null if empty */
     node_t *free;         /* singly linked list of nodes that can be reused */
+    int count;            /* number of items in the queue */
 } prio_q_t;
 
 /* Creates an empty priority queue and returns a pointer to it.
@@ -37,7 +38,7 @@ extern prio_q_t *prio_q_new();
  * @returns:
  *   none
  */
-extern void prio_q_add(prio_q_t *queue, void *contents, int priotity);
+extern void prio_q_add(prio_q_t *queue, void *contents, long long priotity);
 
 /* Removes and returns the item at the head of the queue.
  * @params:
@@ -47,6 +48,16 @@ extern void prio_q_add(prio_q_t *queue, void *contents, int priotity);
  */
 extern void *prio_q_remove(prio_q_t *queue);
 
+/* Removes and returns the first item, in queue order, that the predicate accepts
+ * @params:
+ *   queue : pointer to the priority queue
+ *   pred  : called with (item, arg), returns non-zero for the item wanted
+ *   arg   : passed to pred
+ * @returns:
+ *   pointer to the item or NULL if no item is accepted
+ */
+extern void *prio_q_remove_if(prio_q_t *queue, int (*pred)(void *contents, void *arg), void *arg);
+
 /* Returns but does not remove the item at the head of the queue.
  * @params:
  *   queue : pointer to the priority queue
@@ -63,4 +74,12 @@ extern void *prio_q_peek(prio_q_t *queue);
  */
 extern int prio_q_empty(prio_q_t  *queue);
 
+/* Returns the number of items in the queue, in constant time
+ * @params:
+ *   queue : pointer to the priority queue
+ * @returns:
+ *   number of items in the queue
+ */
+extern int prio_q_size(prio_q_t *queue);
+
 #endif //PRIO_Q_H
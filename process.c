@@ -1,13 +1,34 @@
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 #include "process.h"
 #include "prio_q.h"
 #include "message.h"
+#include "feed.h"
+#include "instr.h"
+#include "report.h"
+#include "sampler.h"
+#include "trace.h"
+#include "timeline.h"
+#include "critpath.h"
+#include "steal.h"
+#include "device.h"
+#include "gang.h"
+#include "vtick.h"
+#include "cache.h"
+#include "live.h"
+#include "shard.h"
 
 #define MAX_PROCS   100
 #define MAX_THREADS 100
 
+/* Finished processes are ordered by (time, node, pid); pids are not bounded by MAX_PROCS
+ * once processes stream in, so they get their own wide field in the key.
+ */
+#define ORDER_PIDS  (1LL << 24)
+
 enum {
     PROC_NEW = 0,
     PROC_READY,
@@ -15,19 +36,57 @@ enum {
     PROC_BLOCKED,        //is process blocked for other reasons
     PROC_BLOCKED_SEND,   //process waiting for send
     PROC_BLOCKED_RECV,   //process waiting for receiving
-    PROC_FINISHED
+    PROC_FINISHED,
+    PROC_MIGRATING,      //stolen by another node, in transit
+    PROC_BLOCKED_IO,     //waiting on a device
+    PROC_BLOCKED_COLL    //waiting in a BCAST, GATHER or ALLREDUCE
 };
 
-static char *states[] = {"new", "ready", "running", "blocked", "blocked (send)", "blocked (recv)", "finished"};
+static char *states[] = {"new", "ready", "running", "blocked", "blocked (send)", "blocked (recv)", "finished",
+                        "migrating", "blocked (io)", "blocked (coll)"};
+//what each state counts as on the critical path
+static int cp_kinds[] = {CP_NONE, CP_QUEUE, CP_COMPUTE, CP_BLOCK, CP_MESSAGE, CP_MESSAGE, CP_NONE, CP_NONE, CP_BLOCK,
+                        CP_MESSAGE};
 static int quantum;
+static int num_cores = 1;          //cores per node
+static int overhead_on = 0;        //dispatch and switch costs are modeled
+static int dispatch_cost, switch_cost, cross_cost;
 static prio_q_t *finished;
+static pthread_mutex_t finished_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *summary_out = NULL;   //where summary rows are streamed during the run, if anywhere
 static barrier_t *gbarrier = NULL; //barrier var
+static long long events;           //# of process state changes, summed over nodes as they finish
+static int last_tick;              //latest clock reached by any node
 
 //Setting barrier for processes
 extern void process_set_barrier(barrier_t *b) {
     gbarrier = b;
 }
 
+//Set the number of cores per node
+extern void process_set_cores(int cores) {
+    num_cores = cores > 0 ? cores : 1;
+}
+
+//Set the dispatch, same-program switch and cross-program switch costs
+extern void process_set_overhead(int dispatch, int swtch, int cross) {
+    dispatch_cost = dispatch > 0 ? dispatch : 0;
+    switch_cost = swtch > 0 ? swtch : 0;
+    cross_cost = cross > 0 ? cross : 0;
+    overhead_on = 1;
+    context_overhead_stats = 1;
+}
+
+//Write state changes to a binary trace
+extern int process_set_trace(const char *path) {
+    return trace_open(path, states, PROC_BLOCKED_COLL + 1);
+}
+
+//Stream summary rows to fout as soon as they are final
+extern void process_set_summary(FILE *fout) {
+    summary_out = fout;
+}
+
 /* Initialize the simulation
  * @params:
  *   quantum: the CPU quantum to use in the situation
@@ -42,17 +101,27 @@ extern void process_init(int cpu_quantum) {
 
 /* Create a new node context
  * @params:
- *   None
+ *   node_id: the node's id, which selects its scheduling policy
  * @returns:
  *   pointer to new node context.
  */
-extern processor_t * process_new() {
+extern processor_t * process_new(int node_id) {
     processor_t * cpu = calloc(1, sizeof(processor_t));
     assert(cpu);
     cpu->blocked = prio_q_new();
-    cpu->ready = prio_q_new();
+    cpu->sched = sched_for(node_id);
+    cpu->ready = cpu->sched->create(quantum);
+    cpu->arrived = prio_q_new();
+    cpu->num_cores = num_cores;
+    cpu->cores = calloc(num_cores, sizeof(core_t));
+    assert(cpu->cores);
+    cpu->left = vtick_alloc(num_cores);
+    cpu->slice = vtick_alloc(num_cores);
+    cpu->lane = vtick_alloc(num_cores);
+    cpu->busy = vtick_alloc(num_cores);
+    cpu->attn = vtick_alloc(num_cores);
     cpu->next_proc_id = 1;
-    cpu->node_id = 0;
+    cpu->node_id = node_id;
     return cpu;
 }
 
@@ -65,12 +134,49 @@ extern processor_t * process_new() {
  */
 static void print_process(processor_t *cpu, context *proc) {
     static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
-    int result = pthread_mutex_lock(&lock);
-    assert(result == 0);
-    printf("[%2.2d] %5.5d: process %d %s\n", proc->thread, cpu->clock_time,
-           proc->id, states[proc->state]);
-    result = pthread_mutex_unlock(&lock);
-    assert(result == 0);
+    cpu->events++;
+
+    //close the timeline slice of the state being left; zero length slices are dropped
+    if (timeline_on) {
+        if (proc->state == PROC_NEW) {
+            timeline_process(cpu->node_id, proc->id, proc->name);
+        } else if (cpu->clock_time > proc->slice_start) {
+            timeline_slice(cpu->node_id, proc->id, states[proc->slice_state], proc->slice_start, cpu->clock_time);
+        }
+        proc->slice_state = proc->state;
+        proc->slice_start = cpu->clock_time;
+    }
+    if (critpath_on) {
+        critpath_state(cpu->node_id, proc->id, cp_kinds[proc->state], cpu->clock_time,
+                       proc->state == PROC_FINISHED);
+    }
+
+    //the binary trace is per node, so it needs neither formatting nor the output lock
+    if (trace_binary) {
+        trace_event(cpu->node_id, cpu->clock_time, proc->id, proc->state);
+        return;
+    }
+
+    //in a shard the coordinator prints the lines, which go out with the tick's exchanges
+    if (!shard_on) {
+        int result = INSTR_LOCK(&lock, INSTR_LOCK_OUTPUT);
+        assert(result == 0);
+        printf("[%2.2d] %5.5d: process %d %s\n", proc->thread, cpu->clock_time,
+               proc->id, states[proc->state]);
+        result = pthread_mutex_unlock(&lock);
+        assert(result == 0);
+    }
+
+    if (cache_on || shard_on) {
+        char line[64];
+        snprintf(line, sizeof(line), "[%2.2d] %5.5d: process %d %s", proc->thread, cpu->clock_time,
+                 proc->id, states[proc->state]);
+        if (cache_on) {
+            cache_line(cpu->node_id, cpu->clock_time, line);
+        } else {
+            shard_line(cpu->node_id, line);
+        }
+    }
 }
 
 /* Add process to finished queue when they are done
@@ -81,33 +187,75 @@ static void print_process(processor_t *cpu, context *proc) {
  *   returns 1
  */
 static void process_finished(processor_t *cpu, context *proc) {
-    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
-
     /* Need to protect shared queue global lock
      * threads are ordered by time, thread id, proc id.
      */
     proc->finished = cpu->clock_time;
-    int result = pthread_mutex_lock(&lock);
+    cpu->finished++;
+    cpu->guests -= proc->node != proc->thread;
+
+    //nothing can rendezvous with a finished process, so drop its address
+    msg_unregister(proc);
+
+    if (report_on) {
+        report_finish(cpu->node_id, proc);
+    }
+    if (proc->gang >= 0) {
+        gang_finish(proc->gang);
+    }
+
+    int result = pthread_mutex_lock(&finished_lock);
     assert(result == 0);
-    int order = cpu->clock_time * MAX_PROCS * MAX_THREADS + proc->thread * MAX_PROCS + proc->id;
+    long long order = ((long long)cpu->clock_time * (MAX_THREADS + 1) + proc->thread) * ORDER_PIDS + proc->id;
     prio_q_add(finished, proc, order);
-    result = pthread_mutex_unlock(&lock);
+    result = pthread_mutex_unlock(&finished_lock);
     assert(result == 0);
 }
 
-/* Compute priority of process, depending on whether SJF or priority based scheduling is used
+/* Output and free the finished processes that completed before the watermark
+ * Caller holds finished_lock. With the cache, the replayed groups' lines and rows are merged in;
+ * in a shard the rows go to the coordinator, which merges those of every shard.
  * @params:
- *   proc: process' context
+ *   watermark: no process can still finish before this time on any node
+ *   fout : output file
  * @returns:
- *   priority of process
+ *   none
  */
-static int actual_priority(context *proc) {
-    if (proc->priority < 0) {
-        /* SJF means duration of current DOOP is the priority
-         */
-        return proc->duration;
+static void emit_finished(int watermark, FILE *fout) {
+    while (!prio_q_empty(finished)) {
+        context *proc = prio_q_peek(finished);
+        if (proc->finished >= watermark) {
+            break;
+        }
+        prio_q_remove(finished);
+        if (cache_on || shard_on) {
+            char *row = NULL;
+            size_t len = 0;
+            FILE *mem = open_memstream(&row, &len);
+            assert(mem);
+            context_stats(proc, mem);
+            fclose(mem);
+            if (shard_on) {
+                shard_row(proc->finished, proc->thread, proc->id, row);
+            } else {
+                cache_replay(proc->finished, proc->thread, proc->id, fout);
+                fputs(row, fout);
+                cache_row(proc, row);
+            }
+            free(row);
+        } else {
+            context_stats(proc, fout);
+        }
+        context_free(proc);
+    }
+    if (cache_on) {
+        cache_replay(watermark - 1, INT_MAX, INT_MAX, fout);
     }
-    return proc->priority;
+}
+
+//# of processes in the node's ready queue
+static int num_ready(processor_t *cpu) {
+    return cpu->sched->size(cpu->ready);
 }
 
 /* Insert process into appropriate queue based on the primitive it is performing
@@ -128,18 +276,25 @@ static void insert_in_queue(processor_t *cpu, context *proc, int next_op) {
 
     int op = context_cur_op(proc);
 
-    if (op == OP_DOOP || op == OP_SEND || op == OP_RECV) {
+    if (op == OP_DOOP || op == OP_SEND || op == OP_RECV || op == OP_BCAST || op == OP_GATHER || op == OP_ALLREDUCE) {
         proc->state = PROC_READY;
         /* duration meaning:
-           - DOOP : remaining ticks of DOOP
-           - SEND/RECV : treat as 1 for SJF purposes so they don't starve
+           - DOOP : remaining ticks of DOOP (a preempted DOOP keeps what it has left)
+           - SEND/RECV/collectives : treat as 1 for SJF purposes so they don't starve
         */
         if (op == OP_DOOP) {
-            proc->duration = context_cur_duration(proc);
+            if (next_op) {
+                proc->duration = context_cur_duration(proc);
+            }
         } else {
             proc->duration = 1; /* one CPU tick before it blocks on the message op */
         }
-        prio_q_add(cpu->ready, proc, actual_priority(proc));
+        //a new op gets its deadline, a preempted one keeps it
+        if (next_op) {
+            int deadline = context_cur_deadline(proc);
+            proc->deadline = cpu->clock_time + (deadline > 0 ? deadline : proc->duration);
+        }
+        cpu->sched->enqueue(cpu->ready, proc, cpu->clock_time);
         proc->wait_count++;
         proc->enqueue_time = cpu->clock_time;
     } else if (op == OP_BLOCK) {
@@ -148,6 +303,11 @@ static void insert_in_queue(processor_t *cpu, context *proc, int next_op) {
         proc->state = PROC_BLOCKED;
         proc->duration = cpu->clock_time + context_cur_duration(proc); /* wake-up time */
         prio_q_add(cpu->blocked, proc, proc->duration);
+    } else if (op == OP_IO) {
+        /* The device wakes it when the request is served
+         */
+        proc->state = PROC_BLOCKED_IO;
+        device_submit(cpu->node_id, proc, cpu->clock_time);
     } else {
         proc->state = PROC_FINISHED;
         process_finished(cpu, proc);
@@ -164,7 +324,10 @@ static void insert_in_queue(processor_t *cpu, context *proc, int next_op) {
  */
 extern int process_admit(processor_t *cpu, context *proc) {
     proc->id = cpu->next_proc_id++;
+    proc->node = cpu->node_id;
     proc->state = PROC_NEW;
+    proc->admitted = cpu->clock_time;
+    proc->first_run = -1;
     print_process(cpu, proc);
 
     //register this (node, pid) address for message passing
@@ -174,6 +337,325 @@ extern int process_admit(processor_t *cpu, context *proc) {
     return 1;
 }
 
+//true if the message op a process just completed got data: a RECV, a BCAST it is not the root of,
+//a GATHER it is the root of, or an ALLREDUCE
+static int receives(context *proc) {
+    int op = context_cur_op(proc);
+    int root = context_cur_duration(proc) == proc->addr;
+    return op == OP_RECV || op == OP_ALLREDUCE || (op == OP_BCAST && !root) || (op == OP_GATHER && root);
+}
+
+//ready queue entries that have not been stolen, the only ones a node gives away
+static int at_home(void *proc, void *arg) {
+    (void)arg;
+    return ((context *)proc)->node == ((context *)proc)->thread;
+}
+
+//a process that became ready this tick may preempt a running DOOP in Step 2
+static void note_arrival(processor_t *cpu, context *proc) {
+    if (proc->state == PROC_READY && cpu->running > 0) {
+        prio_q_add(cpu->arrived, proc, cpu->sched->key(cpu->ready, proc));
+    }
+}
+
+//a running DOOP that may be preempted, with its rank under the node's policy
+typedef struct candidate {
+    core_t *core;
+    long long key;
+} candidate_t;
+
+//worst running process last: highest rank, then the higher core
+static int cmp_worst(const void *a, const void *b) {
+    const candidate_t *x = a, *y = b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return x->core < y->core ? -1 : 1;
+}
+
+/* Decide which cores give up their DOOP to processes that became ready this tick
+ * Cores that are idle or are released this tick anyway will take the head of the ready queue, so the
+ * arrivals among those entries need no core. Each remaining arrival, best first, preempts the worst
+ * running DOOP if it beats it; cores still paying dispatch overhead are left alone. With one core:
+ * preempt if any arrival beats the running process. A preempted core leaves its lane, so run_core
+ * sees the preemption.
+ * @params:
+ *   cpu : node context
+ * @returns:
+ *   none
+ */
+static void mark_preemptions(processor_t *cpu) {
+    candidate_t cand[cpu->num_cores];
+    context *first[cpu->num_cores];
+    int free = 0, n = 0;
+
+    if (prio_q_empty(cpu->arrived)) {
+        return;
+    }
+    for (int k = 0; k < cpu->num_cores; k++) {
+        core_t *core = &cpu->cores[k];
+        if (core->cur && core->overhead > 0) {
+            continue;           /* a switch in progress is not interrupted */
+        }
+        if (core->cur && cpu->lane[k]) {
+            core->cur->duration = cpu->left[k];     /* the policy may rank by it */
+        }
+        if (!core->cur || context_cur_op(core->cur) != OP_DOOP ||
+            core->cur->duration <= 1 || cpu->slice[k] <= 1) {
+            free++;
+        } else {
+            cand[n].core = core;
+            cand[n++].key = cpu->sched->key(cpu->ready, core->cur);
+        }
+    }
+    if (n == 0) {
+        return;
+    }
+
+    //arrivals that the free cores will pick up are the first ones in arrival order of priority
+    int skip = 0;
+    int m = cpu->sched->head(cpu->ready, first, free);
+    for (int i = 0; i < m; i++) {
+        skip += first[i]->enqueue_time == cpu->clock_time;
+    }
+    while (skip-- > 0 && !prio_q_empty(cpu->arrived)) {
+        prio_q_remove(cpu->arrived);
+    }
+    if (prio_q_empty(cpu->arrived)) {
+        return;
+    }
+
+    qsort(cand, n, sizeof(candidate_t), cmp_worst);
+    while (n > 0 && !prio_q_empty(cpu->arrived)) {
+        context *proc = prio_q_remove(cpu->arrived);
+        if (!cpu->sched->should_preempt(cpu->ready, cand[n - 1].core->cur, proc)) {
+            break;
+        }
+        core_t *core = cand[--n].core;
+        core->preempt = 1;
+        cpu->lane[core - cpu->cores] = 0;
+    }
+}
+
+/* Work out what putting a process on a core costs: the dispatch cost, plus the switch cost if the
+ * core last ran another process of the same program, or the cross-program cost if it last ran
+ * another program or nothing (nothing of the program is in the core's caches)
+ * @params:
+ *   cpu  : node context
+ *   core : core the process is dispatched on
+ *   proc : the process
+ * @returns:
+ *   none
+ */
+static void charge_overhead(processor_t *cpu, core_t *core, context *proc) {
+    int cost = dispatch_cost;
+    int switched = core->last_id != proc->id;
+    if (switched) {
+        cost += strcmp(core->last_name, proc->name) ? cross_cost : switch_cost;
+        proc->switch_count++;
+        core->last_id = proc->id;
+        strcpy(core->last_name, proc->name);
+    }
+    core->overhead = cost;
+    if (report_on) {
+        report_overhead(cpu->node_id, switched, cost);
+    }
+}
+
+/* Take the process off core k; a DOOP on a lane gets its counter back first
+ * @params:
+ *   cpu  : node context
+ *   k    : core index
+ * @returns:
+ *   none
+ */
+static void release(processor_t *cpu, int k) {
+    if (cpu->lane[k]) {
+        cpu->cores[k].cur->duration = cpu->left[k];
+    }
+    cpu->cores[k].cur = NULL;
+    cpu->lane[k] = 0;
+    cpu->busy[k] = 0;
+    cpu->running--;
+}
+
+/* The DOOP on core k has run a tick: the core is given up when the DOOP or the quantum is over or the
+ * process was preempted, otherwise the DOOP goes on a lane if the policy has nothing to do per tick
+ * @params:
+ *   cpu  : node context
+ *   k    : core index
+ * @returns:
+ *   none
+ */
+static void doop_ran(processor_t *cpu, int k) {
+    core_t *core = &cpu->cores[k];
+    context *cur = core->cur;
+
+    if (cur->duration == 0 && report_on && context_cur_deadline(cur) > 0) {
+        report_deadline(cpu->node_id, cpu->clock_time + 1 > cur->deadline);
+    }
+    if (cur->duration == 0 || cpu->slice[k] == 0 || core->preempt) {
+        cpu->lane[k] = 0;
+        release(cpu, k);
+        insert_in_queue(cpu, cur, (cur->duration == 0));
+    } else if (!cpu->sched->tick) {
+        cpu->left[k] = cur->duration;
+        cpu->lane[k] = -1;
+    }
+}
+
+/* Run one core for a tick: a DOOP advances, a SEND/RECV is issued and blocks the process
+ * @params:
+ *   cpu  : node context
+ *   k    : core index
+ * @returns:
+ *   none
+ */
+static void run_core(processor_t *cpu, int k) {
+    core_t *core = &cpu->cores[k];
+    context *cur = core->cur;
+
+    //the core is still loading the process; it runs once the overhead is paid
+    if (core->overhead > 0) {
+        core->overhead--;
+        cur->overhead_time++;
+        return;
+    }
+    core->started = 1;
+    int op = context_cur_op(cur);
+    if (cpu->sched->tick) {
+        cpu->sched->tick(cpu->ready, cur);
+    }
+    if (op == OP_DOOP) {
+        cur->duration--;
+        cpu->slice[k]--;
+        doop_ran(cpu, k);
+    } else if (op == OP_SEND) {
+        cpu->slice[k]--;           /* consume this CPU tick */
+        cur->doop_time++;          /* count as running time (matches assignment examples) */
+        cur->msg_time = cpu->clock_time;
+        int deliver = msg_send(cur, context_cur_duration(cur), context_cur_tag(cur), context_cur_size(cur),
+                               cpu->clock_time);
+        if (deliver) {
+            if (timeline_on) {
+                timeline_flow(cpu->node_id, cpu->clock_time, deliver - 1, cur->addr,
+                              context_cur_duration(cur));
+            }
+            if (critpath_on) {
+                critpath_release(context_cur_duration(cur), cpu->node_id, cur->id, cpu->clock_time);
+            }
+        }
+        cur->state = PROC_BLOCKED_SEND;
+        cpu->msg_waiting++;
+        print_process(cpu, cur);
+        release(cpu, k);
+    } else if (op == OP_RECV) {
+        cpu->slice[k]--;           /* consume this CPU tick */
+        cur->doop_time++;          /* count as running time */
+        cur->msg_time = cpu->clock_time;
+        int from;
+        int deliver = msg_recv(cur, context_cur_duration(cur), context_cur_tag(cur), cpu->clock_time, &from);
+        if (deliver) {
+            if (timeline_on) {
+                timeline_flow(cpu->node_id, cpu->clock_time, deliver - 1, from, cur->addr);
+            }
+            if (critpath_on) {
+                critpath_release(from, cpu->node_id, cur->id, cpu->clock_time);
+            }
+        }
+        cur->state = PROC_BLOCKED_RECV;
+        cpu->msg_waiting++;
+        print_process(cpu, cur);
+        release(cpu, k);
+    } else if (op == OP_BCAST || op == OP_GATHER || op == OP_ALLREDUCE) {
+        cpu->slice[k]--;           /* consume this CPU tick */
+        cur->doop_time++;          /* count as running time */
+        cur->msg_time = cpu->clock_time;
+        msg_collective(cur, cpu->clock_time);
+        cur->state = PROC_BLOCKED_COLL;
+        cpu->msg_waiting++;
+        print_process(cpu, cur);
+        release(cpu, k);
+    } else {
+        //shouldn't run BLOCK/HALT here
+        assert(0 && "Invalid running op");
+    }
+}
+
+/* Put a ready process on an idle core, keeping track of how long it waited in the ready queue
+ * @params:
+ *   cpu  : node context
+ *   core : the idle core
+ *   cur  : the process, already taken off the ready queue
+ * @returns:
+ *   none
+ */
+static void dispatch(processor_t *cpu, core_t *core, context *cur) {
+    cur->wait_time += cpu->clock_time - cur->enqueue_time;
+    if (report_on) {
+        report_dispatch(cpu->node_id, cur, cpu->clock_time, cpu->clock_time - cur->enqueue_time);
+    }
+    int k = core - cpu->cores;
+    core->cur = cur;
+    core->started = 0;
+    core->preempt = 0;
+    cpu->slice[k] = cpu->sched->slice(cpu->ready, cur);
+    cpu->busy[k] = -1;
+    if (overhead_on) {
+        charge_overhead(cpu, core, cur);
+    }
+    cpu->running++;
+    cur->state = PROC_RUNNING;
+    print_process(cpu, cur);
+}
+
+//ready queue entries that belong to the gang pointed to by arg
+static int in_gang(void *proc, void *arg) {
+    return ((context *)proc)->gang == *(int *)arg;
+}
+
+/* Give the ready members of the gang holding the slot a core before anything else: idle cores first,
+ * then cores running a process of another gang or of none, which goes back to the ready queue with
+ * what is left of its DOOP. A process that has not run since it was dispatched (it is still paying the
+ * dispatch overhead, or was put there this tick) keeps its core, so every dispatch makes progress.
+ * @params:
+ *   cpu  : node context
+ *   gang : the gang holding the slot, -1 for none
+ * @returns:
+ *   none
+ */
+static void dispatch_gang(processor_t *cpu, int gang) {
+    if (gang < 0) {
+        return;
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        for (int k = 0; k < cpu->num_cores; k++) {
+            core_t *core = &cpu->cores[k];
+            if (pass == 0 ? core->cur != NULL : (core->cur->gang == gang || !core->started)) {
+                continue;
+            }
+            context *member = cpu->sched->remove_if(cpu->ready, in_gang, &gang);
+            if (!member) {
+                return;
+            }
+            if (pass == 1) {
+                context *out = core->cur;
+                release(cpu, k);
+                insert_in_queue(cpu, out, 0);
+            }
+            dispatch(cpu, core, member);
+            gang_dispatched(cpu->node_id, pass == 1);
+        }
+    }
+}
+
+//the node's gauges for prosim-top; everything here is the node's own, so no locks are taken
+static void publish_live(processor_t *cpu, int done) {
+    live_gauges_t g = {
+        cpu->clock_time, cpu->running, num_ready(cpu), prio_q_size(cpu->blocked) + device_pending(cpu->node_id),
+        cpu->msg_waiting, cpu->finished, cpu->matched
+    };
+    live_publish(cpu->node_id, &g, done);
+}
+
 /* Perform the simulation
  * @params:
  *   cpu : node context
@@ -181,27 +663,56 @@ extern int process_admit(processor_t *cpu, context *proc) {
  *   returns 1
  */
 extern int process_simulate(processor_t *cpu) {
-    context *cur = NULL;
-    int cpu_quantum = 0;
-
     //sync all nodes before starting simulation loop
     if (gbarrier) barrier_wait(gbarrier);
 
-    while (!prio_q_empty(cpu->ready) || !prio_q_empty(cpu->blocked) ||
-           cur != NULL || msg_has_blocked_or_ready(cpu->node_id)) {
-        int preempt = 0;
+    //with work stealing an idle node stays in while some other node may still have work to give
+    while (num_ready(cpu) > 0 || !prio_q_empty(cpu->blocked) || device_pending(cpu->node_id) ||
+           cpu->running > 0 || msg_has_blocked_or_ready(cpu->node_id) || feed_pending(cpu->node_id) ||
+           (steal_on && (steal_pending(cpu->node_id) || cpu->clock_time == 0 || msg_any_busy()))) {
+        INSTR_RESTART();
+
+        /* Step 0: Admit processes whose arrival time has come */
+        {
+            context *proc;
+            while ((proc = feed_next(cpu->node_id, cpu->clock_time)) != NULL) {
+                process_admit(cpu, proc);
+                note_arrival(cpu, proc);
+            }
+        }
+        INSTR_MARK(INSTR_ADMIT);
 
-        /* Step 1(a): Unblock processes that completed SEND/RECV */
+        /* Step 1(a): Match this node's RECV ANY waiters, then unblock processes that completed SEND/RECV */
         {
+            msg_match_t matched[128];
+            int m;
+            do {
+                m = msg_match_any(cpu->node_id, cpu->clock_time, matched, 128);
+                for (int i = 0; i < m; i++) {
+                    msg_match_t *mm = &matched[i];
+                    if (timeline_on) {
+                        timeline_flow(cpu->node_id, mm->time, mm->deliver - 1, mm->sender_addr, mm->receiver_addr);
+                    }
+                    if (critpath_on) {
+                        critpath_release(mm->waiter_addr, mm->matcher_node, mm->matcher_pid, mm->time);
+                    }
+                }
+            } while (m == 128);
+
             context *done[256];
-            int n = msg_collect_ready(cpu->node_id, done, 256);
+            int n = msg_collect_ready(cpu->node_id, cpu->clock_time, done, 256);
             for (int i = 0; i < n; i++) {
                 context *p = done[i];
+                if (report_on) {
+                    report_msg_wait(cpu->node_id, p, cpu->clock_time - p->msg_time);
+                }
+                cpu->msg_waiting--;
+                cpu->matched += receives(p);
                 insert_in_queue(cpu, p, 1); //treat like DOOP for queueing
-                preempt |= cur != NULL && p->state == PROC_READY &&
-                           actual_priority(cur) > actual_priority(p);
+                note_arrival(cpu, p);
             }
         }
+        INSTR_MARK(INSTR_STEP1A);
 
         //Step 1(b): Unblock processes whose BLOCK time expired
         while (!prio_q_empty(cpu->blocked)) {
@@ -211,72 +722,212 @@ extern int process_simulate(processor_t *cpu) {
             }
             prio_q_remove(cpu->blocked);
             insert_in_queue(cpu, proc, 1);
-            preempt |= cur != NULL && proc->state == PROC_READY &&
-                       actual_priority(cur) > actual_priority(proc);
+            note_arrival(cpu, proc);
         }
 
+        //and those whose IO request was served
+        if (device_pending(cpu->node_id)) {
+            context *done[256];
+            int n;
+            do {
+                n = device_collect(cpu->node_id, done, 256);
+                for (int i = 0; i < n; i++) {
+                    insert_in_queue(cpu, done[i], 1);
+                    note_arrival(cpu, done[i]);
+                }
+            } while (n == 256);
+        }
+        INSTR_MARK(INSTR_STEP1B);
+
         if (gbarrier) barrier_wait(gbarrier);
+        INSTR_RESTART();
 
-        /* Step 2: Update current running process */
-        if (cur != NULL) {
-            int op = context_cur_op(cur);
-            if (op == OP_DOOP) {
-                cur->duration--;
-                cpu_quantum--;
-                if (cur->duration == 0 || cpu_quantum == 0 || preempt) {
-                    insert_in_queue(cpu, cur, (cur->duration == 0));
-                    cur = NULL;
+        /* Step 2(a): Processes stolen by this node join its ready queue once they arrive.
+         * They keep their node and pid, and so their message address, and stay here until they finish.
+         */
+        if (steal_on) {
+            context *proc;
+            while ((proc = steal_take(cpu->node_id, cpu->clock_time)) != NULL) {
+                proc->node = cpu->node_id;
+                cpu->guests++;
+                msg_migrate(proc, cpu->node_id);
+                insert_in_queue(cpu, proc, 0);
+                note_arrival(cpu, proc);
+            }
+        }
+
+        /* Step 2: Update the running processes, after deciding which of them are preempted.
+         * The DOOPs on lanes all advance in vtick_run; run_core gets the other busy cores and the
+         * lanes that ran out, in core order as before.
+         */
+        if (cpu->running > 0) {
+            mark_preemptions(cpu);
+            if (report_on) {
+                for (int k = 0; k < cpu->num_cores; k++) {
+                    if (cpu->cores[k].cur) {
+                        report_busy(cpu->node_id, k);
+                    }
+                }
+            }
+            int n = vtick_run(cpu->left, cpu->slice, cpu->lane, cpu->busy, cpu->num_cores, cpu->attn);
+            for (int i = 0; i < n; i++) {
+                int k = cpu->attn[i];
+                if (cpu->lane[k]) {
+                    cpu->cores[k].cur->duration = cpu->left[k];
+                    doop_ran(cpu, k);
+                } else {
+                    run_core(cpu, k);
                 }
-            } else if (op == OP_SEND) {
-                cpu_quantum--;             /* consume this CPU tick */
-                cur->doop_time++;          /* count as running time (matches assignment examples) */
-                msg_send(cur, context_cur_duration(cur));
-                cur->state = PROC_BLOCKED_SEND;
-                print_process(cpu, cur);
-                cur = NULL;
-            } else if (op == OP_RECV) {
-                cpu_quantum--;             /* consume this CPU tick */
-                cur->doop_time++;          /* count as running time */
-                msg_recv(cur, context_cur_duration(cur));
-                cur->state = PROC_BLOCKED_RECV;
-                print_process(cpu, cur);
-                cur = NULL;
-            } else {
-                //shouldn't run BLOCK/HALT here
-                assert(0 && "Invalid running op");
             }
         }
+        while (!prio_q_empty(cpu->arrived)) {
+            prio_q_remove(cpu->arrived);
+        }
+        INSTR_MARK(INSTR_STEP2);
 
-        if (gbarrier) barrier_wait(gbarrier);
+        //in a shard, whoever completes the barrier trades the tick's SENDs with the other shards
+        if (gbarrier) barrier_wait_serial(gbarrier, shard_on ? shard_exchange_sends : NULL);
+        INSTR_RESTART();
+
+        /* Step 3: Give each idle core the next ready process, after the members of the gang whose slot it is
+         */
+        if (gang_on) {
+            dispatch_gang(cpu, gang_slot(cpu->clock_time, quantum));
+        }
+        for (int k = 0; k < cpu->num_cores && num_ready(cpu) > 0; k++) {
+            core_t *core = &cpu->cores[k];
+            if (!core->cur) {
+                dispatch(cpu, core, cpu->sched->pick(cpu->ready, cpu->clock_time));
+            }
+        }
 
-        /* Step 3: Select next ready process to run if none are running
-         * Be sure to keep track of how long it waited in the ready queue
+        //serve the devices now that every request of this tick is in
+        if (device_on) {
+            device_tick(cpu->node_id, cpu->clock_time);
+        }
+
+        //let the wait-for graph know whether this node can still make progress on its own
+        msg_tick_state(cpu->node_id, cpu->running > 0 || num_ready(cpu) > 0 || device_pending(cpu->node_id) ||
+                       !prio_q_empty(cpu->blocked) || !feed_exhausted() ||
+                       (steal_on && steal_pending(cpu->node_id)), cpu->clock_time);
+        if (steal_on) {
+            steal_publish(cpu->node_id, cpu->clock_time, num_ready(cpu) + steal_pending(cpu->node_id),
+                          num_ready(cpu) - cpu->guests);
+        }
+
+        //sample the gauges; queue lengths and message waits are all kept incrementally
+        if (sampler_every && cpu->clock_time % sampler_every == 0) {
+            int sends, recvs;
+            msg_waiting_counts(cpu->node_id, &sends, &recvs);
+            sampler_record(cpu->node_id, cpu->clock_time, cpu->running, num_ready(cpu),
+                           prio_q_size(cpu->blocked), sends, recvs);
+        }
+        if (live_on) {
+            publish_live(cpu, 0);
+        }
+        INSTR_MARK(INSTR_STEP3);
+
+        /* Step 4: barrier + increment clock
+         * After the barrier every node sees the same wait-for summary, so all of them stop together.
+         * Groups replayed from the cache would have kept their nodes busy until their last finish.
+         * In a shard the matches and the wait-for summary are traded first.
          */
-        if (cur == NULL && !prio_q_empty(cpu->ready)) {
-            cur = prio_q_remove(cpu->ready);
-            cur->wait_time += cpu->clock_time - cur->enqueue_time;
-            cpu_quantum = quantum;
-            cur->state = PROC_RUNNING;
-            print_process(cpu, cur);
+        if (gbarrier) barrier_wait_serial(gbarrier, shard_on ? shard_exchange_matches : NULL);
+        INSTR_RESTART();
+        if (msg_deadlocked() && cpu->clock_time >= cache_settle) {
+            break;
         }
 
-        /* Step 4: barrier + increment clock */
-        if (gbarrier) barrier_wait(gbarrier);
+        /* Step 5: Give processes to the nodes stealing from this one.
+         * Every node derives the same plan from the queue lengths published before the barrier.
+         */
+        if (steal_on) {
+            int thieves[STEAL_MAX_THIEVES];
+            int n = steal_plan(cpu->node_id, cpu->clock_time, thieves);
+            for (int i = 0; i < n; i++) {
+                context *proc = cpu->sched->remove_if(cpu->ready, at_home, NULL);
+                proc->wait_time += cpu->clock_time - proc->enqueue_time;
+                proc->state = PROC_MIGRATING;
+                print_process(cpu, proc);
+                steal_give(thieves[i], proc, cpu->clock_time + steal_cost());
+            }
+        }
+
+        /* Every node still running has now finished this tick and nodes that left are done,
+         * so the minimum clock across nodes is past clock_time and rows up to it are final.
+         * One node streams them out; if another already holds the lock it is doing the same.
+         */
+        if (summary_out && pthread_mutex_trylock(&finished_lock) == 0) {
+            emit_finished(cpu->clock_time + 1, summary_out);
+            pthread_mutex_unlock(&finished_lock);
+        }
         cpu->clock_time++;
+        INSTR_COUNT(ticks);
+        INSTR_MARK(INSTR_STEP4);
     }
 
+    if (report_on) {
+        report_node_done(cpu->node_id, cpu->clock_time);
+    }
+    if (live_on) {
+        publish_live(cpu, 1);
+    }
+    if (sampler_every) {
+        sampler_flush(cpu->node_id);
+    }
+    if (trace_binary) {
+        trace_flush(cpu->node_id);
+    }
+    if (timeline_on) {
+        timeline_flush(cpu->node_id);
+    }
+
+    pthread_mutex_lock(&finished_lock);
+    events += cpu->events;
+    if (cpu->clock_time > last_tick) {
+        last_tick = cpu->clock_time;
+    }
+    pthread_mutex_unlock(&finished_lock);
+
     return 1;
 }
 
+/* Report how much simulation was done, for throughput measurements
+ * @params:
+ *   num_events: set to the number of process state changes
+ *   num_ticks : set to the latest clock reached by any node
+ * @returns:
+ *   none
+ */
+extern void process_counts(long long *num_events, int *num_ticks) {
+    *num_events = events;
+    *num_ticks = last_tick;
+}
+
+//adds the counts of nodes run by a shard
+extern void process_add_counts(long long num_events, int num_ticks) {
+    events += num_events;
+    if (num_ticks > last_tick) {
+        last_tick = num_ticks;
+    }
+}
+
 /* Output process summary post execution
+ * Rows already streamed during the run are not repeated; this prints the rest.
+ * If the simulation stopped on a deadlock, only the finished processes are listed,
+ * followed by the wait-for cycles that stopped it.
  * @params:
  *   fout : output file
  * @returns:
  *   none
  */
 extern void process_summary(FILE *fout) {
-    while (!prio_q_empty(finished)) {
-        context *proc = prio_q_remove(finished);
-        context_stats(proc, fout);
+    pthread_mutex_lock(&finished_lock);
+    emit_finished(INT_MAX, fout);
+    pthread_mutex_unlock(&finished_lock);
+
+    //a shard's part of the wait-for graph is reported by the coordinator
+    if (msg_deadlocked() && !shard_on) {
+        msg_report_deadlock(fout);
     }
 }
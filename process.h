@@ -3,13 +3,39 @@
 #include "prio_q.h"
 #include "context.h"
 #include "barrier.h"
+#include "sched.h"
+
+typedef struct core {
+    context *cur;            /* process running on this core, NULL when idle */
+    int preempt;             /* the running DOOP gives up the core this tick */
+    int overhead;            /* ticks of dispatch/switch overhead left before cur runs */
+    int started;             /* cur has run at least one tick since it was dispatched */
+    int last_id;             /* pid of the process that last ran here, 0 if none */
+    char last_name[11];      /* and its program name */
+} core_t;
 
 typedef struct processor {
     prio_q_t *blocked;       /* queue for BLOCK primitives (time-based) */
-    prio_q_t *ready;         /* ready queue */
+    const sched_policy_t *sched; /* the node's scheduling policy */
+    void *ready;             /* ready queue, shared by the node's cores and kept by the policy */
+    prio_q_t *arrived;       /* processes that became ready this tick, best first (preemption candidates) */
+    core_t *cores;           /* the node's cores */
+    /* per core, in structure-of-arrays form for vtick_run (see vtick.h) */
+    int *left;               /* DOOP ticks left, kept here instead of cur->duration while the core is on a lane */
+    int *slice;              /* ticks left in the running process' quantum */
+    int *lane;               /* -1 while vtick_run advances the core's DOOP, else 0 */
+    int *busy;               /* -1 while the core has a process, else 0 */
+    int *attn;               /* cores vtick_run hands back to run_core this tick */
+    int num_cores;           /* # of cores */
+    int running;             /* # of busy cores */
     int clock_time;          /* local node time */
     int next_proc_id;        /* local node process counter */
     int node_id;             /* this processor's node id (thread id) */
+    long long events;        /* # of process state changes on this node */
+    long long finished;      /* # of processes finished on this node */
+    long long matched;       /* # of messages its processes received */
+    int msg_waiting;         /* # of its processes blocked in SEND/RECV */
+    int guests;              /* # of processes stolen by this node that have not finished */
 } processor_t;
 
 /* Initialize the simulation
@@ -20,13 +46,31 @@ typedef struct processor {
  */
 extern void process_init(int cpu_quantum);
 
+/* Set the number of cores every node gets (before any node is created)
+ * @params:
+ *   cores: cores per node, at least 1
+ * @returns:
+ *   none
+ */
+extern void process_set_cores(int cores);
+
+/* Set the overhead of putting a process on a core, in ticks
+ * @params:
+ *   dispatch: paid on every dispatch
+ *   swtch   : added when the core last ran another process of the same program
+ *   cross   : added instead when it last ran another program, or nothing (cold cache)
+ * @returns:
+ *   none
+ */
+extern void process_set_overhead(int dispatch, int swtch, int cross);
+
 /* Create a new node context
  * @params:
- *   None
+ *   node_id: the node's id, which selects its scheduling policy
  * @returns:
  *   pointer to new node context.
  */
-extern processor_t *process_new();
+extern processor_t *process_new(int node_id);
 
 /* Admit a process into the simulation
  * @params:
@@ -45,7 +89,15 @@ extern int process_admit(processor_t *cpu, context *proc);
  */
 extern int process_simulate(processor_t *cpu);
 
-/* Output process summary post execution
+/* Stream summary rows out during the run, as soon as no earlier completion can arrive
+ * @params:
+ *   fout : output file
+ * @returns:
+ *   none
+ */
+extern void process_set_summary(FILE *fout);
+
+/* Output process summary post execution (whatever was not already streamed)
  * @params:
  *   fout : output file
  * @returns:
@@ -53,6 +105,26 @@ extern int process_simulate(processor_t *cpu);
  */
 extern void process_summary(FILE *fout);
 
+/* Report how much simulation was done, for throughput measurements
+ * @params:
+ *   num_events: set to the number of process state changes
+ *   num_ticks : set to the latest clock reached by any node
+ * @returns:
+ *   none
+ */
+extern void process_counts(long long *num_events, int *num_ticks);
+
+//adds the events and latest clock of the nodes a shard ran (see shard.h)
+extern void process_add_counts(long long num_events, int num_ticks);
+
+/* Write state changes to a binary trace instead of stdout (decode with prosim-trace)
+ * @params:
+ *   path : trace file
+ * @returns:
+ *   1 on success, 0 if the file could not be created
+ */
+extern int process_set_trace(const char *path);
+
 /* provide the global barrier to the simulation layer */
 extern void process_set_barrier(barrier_t *b);
 
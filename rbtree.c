@@ -0,0 +1,252 @@
+//filename: rbtree.c
+//Description: red-black tree with parent links, following the insert and delete fix-ups of CLRS
+//with NULL standing for the black leaves
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "rbtree.h"
+#include "instr.h"
+
+//node a goes before node b
+static int _before(rb_node_t *a, rb_node_t *b) {
+    return a->key < b->key || (a->key == b->key && a->seq < b->seq);
+}
+
+static int _red(rb_node_t *n) {
+    return n && n->red;
+}
+
+//moves x's right child up into x's place
+static void _rotate_left(rb_tree_t *t, rb_node_t *x) {
+    rb_node_t *y = x->right;
+    x->right = y->left;
+    if (y->left) y->left->parent = x;
+    y->parent = x->parent;
+    if (!x->parent) t->root = y;
+    else if (x == x->parent->left) x->parent->left = y;
+    else x->parent->right = y;
+    y->left = x;
+    x->parent = y;
+}
+
+//moves x's left child up into x's place
+static void _rotate_right(rb_tree_t *t, rb_node_t *x) {
+    rb_node_t *y = x->left;
+    x->left = y->right;
+    if (y->right) y->right->parent = x;
+    y->parent = x->parent;
+    if (!x->parent) t->root = y;
+    else if (x == x->parent->right) x->parent->right = y;
+    else x->parent->left = y;
+    y->right = x;
+    x->parent = y;
+}
+
+//creates an empty tree
+rb_tree_t *rb_new(void) {
+    rb_tree_t *t = calloc(1, sizeof(rb_tree_t));
+    assert(t);
+    return t;
+}
+
+//the successor of node in key order
+rb_node_t *rb_next(rb_node_t *n) {
+    if (n->right) {
+        n = n->right;
+        while (n->left) n = n->left;
+        return n;
+    }
+    while (n->parent && n == n->parent->right) n = n->parent;
+    return n->parent;
+}
+
+//inserts as a red leaf, then restores the colour rules on the way up
+void rb_insert(rb_tree_t *t, void *contents, long long key) {
+    rb_node_t *z = t->free;
+    if (z) {
+        t->free = z->right;
+    } else {
+        z = malloc(sizeof(rb_node_t));
+        assert(z);
+    }
+    INSTR_COUNT(q_add);
+    z->key = key;
+    z->seq = t->seq++;
+    z->contents = contents;
+    z->left = z->right = NULL;
+    z->red = 1;
+
+    rb_node_t *p = NULL, *x = t->root;
+#ifdef PROSIM_INSTRUMENT
+    long long steps = 0;
+    for (; x; steps++) {
+        p = x;
+        x = _before(z, x) ? x->left : x->right;
+    }
+    INSTR_WALK(steps);
+#else
+    while (x) {
+        p = x;
+        x = _before(z, x) ? x->left : x->right;
+    }
+#endif
+    z->parent = p;
+    if (!p) t->root = z;
+    else if (_before(z, p)) p->left = z;
+    else p->right = z;
+    if (!t->first || _before(z, t->first)) t->first = z;
+    t->count++;
+
+    while (_red(z->parent)) {
+        rb_node_t *g = z->parent->parent;
+        if (z->parent == g->left) {
+            rb_node_t *u = g->right;
+            if (_red(u)) {
+                z->parent->red = u->red = 0;
+                g->red = 1;
+                z = g;
+            } else {
+                if (z == z->parent->right) {
+                    z = z->parent;
+                    _rotate_left(t, z);
+                }
+                z->parent->red = 0;
+                g->red = 1;
+                _rotate_right(t, g);
+            }
+        } else {
+            rb_node_t *u = g->left;
+            if (_red(u)) {
+                z->parent->red = u->red = 0;
+                g->red = 1;
+                z = g;
+            } else {
+                if (z == z->parent->left) {
+                    z = z->parent;
+                    _rotate_right(t, z);
+                }
+                z->parent->red = 0;
+                g->red = 1;
+                _rotate_left(t, g);
+            }
+        }
+    }
+    t->root->red = 0;
+}
+
+//puts v where u was (u's subtrees are the caller's business)
+static void _transplant(rb_tree_t *t, rb_node_t *u, rb_node_t *v) {
+    if (!u->parent) t->root = v;
+    else if (u == u->parent->left) u->parent->left = v;
+    else u->parent->right = v;
+    if (v) v->parent = u->parent;
+}
+
+//unlinks the node, then fixes the black heights if a black node left the tree
+void *rb_erase(rb_tree_t *t, rb_node_t *z) {
+    INSTR_COUNT(q_remove);
+    if (t->first == z) t->first = rb_next(z);
+
+    rb_node_t *y = z, *x, *xp;
+    int y_red = y->red;
+    if (!z->left) {
+        x = z->right;
+        xp = z->parent;
+        _transplant(t, z, z->right);
+    } else if (!z->right) {
+        x = z->left;
+        xp = z->parent;
+        _transplant(t, z, z->left);
+    } else {
+        y = z->right;
+#ifdef PROSIM_INSTRUMENT
+        long long steps = 0;
+        for (; y->left; y = y->left, steps++);
+        INSTR_WALK(steps);
+#else
+        while (y->left) y = y->left;
+#endif
+        y_red = y->red;
+        x = y->right;
+        if (y->parent == z) {
+            xp = y;
+        } else {
+            xp = y->parent;
+            _transplant(t, y, y->right);
+            y->right = z->right;
+            y->right->parent = y;
+        }
+        _transplant(t, z, y);
+        y->left = z->left;
+        y->left->parent = y;
+        y->red = z->red;
+    }
+
+    if (!y_red) {
+        while (x != t->root && !_red(x)) {
+            if (x == xp->left) {
+                rb_node_t *w = xp->right;
+                if (_red(w)) {
+                    w->red = 0;
+                    xp->red = 1;
+                    _rotate_left(t, xp);
+                    w = xp->right;
+                }
+                if (!_red(w->left) && !_red(w->right)) {
+                    w->red = 1;
+                    x = xp;
+                    xp = x->parent;
+                } else {
+                    if (!_red(w->right)) {
+                        w->left->red = 0;
+                        w->red = 1;
+                        _rotate_right(t, w);
+                        w = xp->right;
+                    }
+                    w->red = xp->red;
+                    xp->red = 0;
+                    if (w->right) w->right->red = 0;
+                    _rotate_left(t, xp);
+                    x = t->root;
+                }
+            } else {
+                rb_node_t *w = xp->left;
+                if (_red(w)) {
+                    w->red = 0;
+                    xp->red = 1;
+                    _rotate_right(t, xp);
+                    w = xp->left;
+                }
+                if (!_red(w->left) && !_red(w->right)) {
+                    w->red = 1;
+                    x = xp;
+                    xp = x->parent;
+                } else {
+                    if (!_red(w->left)) {
+                        w->right->red = 0;
+                        w->red = 1;
+                        _rotate_left(t, w);
+                        w = xp->left;
+                    }
+                    w->red = xp->red;
+                    xp->red = 0;
+                    if (w->left) w->left->red = 0;
+                    _rotate_right(t, xp);
+                    x = t->root;
+                }
+            }
+        }
+        if (x) x->red = 0;
+    }
+
+    t->count--;
+    z->right = t->free;
+    t->free = z;
+    return z->contents;
+}
+
+//the leftmost node is cached, so this is the erase alone
+void *rb_remove_first(rb_tree_t *t) {
+    return t->first ? rb_erase(t, t->first) : NULL;
+}
@@ -0,0 +1,62 @@
+//filename: rbtree.h
+//Description: red-black tree ordered by a 64-bit key, for the ready queues of the schedulers (see sched.h).
+//Like prio_q, lower keys come first, ties are kept in insertion order, items are pointers that are not
+//copied and nodes are recycled through a free list; unlike prio_q, insertion and removal are O(log n).
+#ifndef PROSIM_RBTREE_H
+#define PROSIM_RBTREE_H
+
+typedef struct rb_node {
+    struct rb_node *left, *right, *parent;
+    int red;                /* colour, 1 for red */
+    long long key;          /* item's key */
+    long long seq;          /* insertion number, breaks ties */
+    void *contents;         /* pointer to item */
+} rb_node_t;
+
+typedef struct rb_tree {
+    rb_node_t *root;
+    rb_node_t *first;       /* leftmost node, the next item out, NULL if empty */
+    rb_node_t *free;        /* nodes that can be reused, linked through right */
+    long long seq;          /* insertions so far */
+    int count;              /* # of items in the tree */
+} rb_tree_t;
+
+/* Creates an empty tree
+ * @params:
+ *   none
+ * @returns:
+ *   pointer to the new tree
+ */
+extern rb_tree_t *rb_new(void);
+
+/* Inserts an item, after the items already in the tree with the same key
+ * @params:
+ *   tree     : the tree
+ *   contents : pointer to the item
+ *   key      : item's key
+ * @returns:
+ *   none
+ */
+extern void rb_insert(rb_tree_t *tree, void *contents, long long key);
+
+/* Removes a node from the tree
+ * @params:
+ *   tree : the tree
+ *   node : a node of the tree, from rb_first/rb_next
+ * @returns:
+ *   pointer to the node's item
+ */
+extern void *rb_erase(rb_tree_t *tree, rb_node_t *node);
+
+/* Removes and returns the item with the lowest key
+ * @params:
+ *   tree : the tree
+ * @returns:
+ *   pointer to the item or NULL if the tree is empty
+ */
+extern void *rb_remove_first(rb_tree_t *tree);
+
+//the node that comes after node in key order, NULL at the end; start from tree->first
+extern rb_node_t *rb_next(rb_node_t *node);
+
+#endif
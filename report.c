@@ -0,0 +1,267 @@
+//filename: report.c
+//Description: run analytics: turnaround and response time per process, ready-queue latency per
+//wait episode, and busy/idle time per node
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "report.h"
+#include "hist.h"
+#include "steal.h"
+#include "device.h"
+#include "gang.h"
+#include "sched.h"
+
+#define REPORT_MAX_NODES 101
+
+typedef struct report_node {
+    hist_t turnaround;      /* finish - admission, per process */
+    hist_t response;        /* first dispatch - admission, per process */
+    hist_t ready_wait;      /* ticks spent in the ready queue, per wait episode */
+    long long busy;         /* core ticks with a process running */
+    long long *core_busy;   /* busy ticks per core, when there is more than one */
+    long long switches;     /* dispatches that switched to another process */
+    long long overhead;     /* core ticks spent on dispatch and switch overhead */
+    long long dispatches;   /* # of dispatches */
+    long long finished;     /* # of processes that finished here */
+    long long msgs;         /* SEND/RECVs completed */
+    long long msg_wait;     /* ticks they kept their process blocked */
+    long long gang_msgs;    /* the same for members of a gang */
+    long long gang_msg_wait;
+    long long deadlines;    /* DOOPs with a deadline done */
+    long long missed;       /* of which late */
+    int ticks;              /* node clock when it left the simulation */
+    int used;               /* node took part in the run */
+} __attribute__((aligned(64))) report_node_t;
+
+static report_node_t nodes[REPORT_MAX_NODES];
+static int cores = 1;
+static int overhead_seen = 0;      /* overhead costs are modeled, so their table is printed */
+static long long base_finished = -1; /* throughput of the run without -w and -g, if known */
+static int base_makespan;
+static long long base_msg_wait;    /* and its message wait */
+int report_on = 0;
+
+//turns on collection
+void report_enable(void) {
+    memset(nodes, 0, sizeof(nodes));
+    report_on = 1;
+}
+
+//a dispatch ends a wait episode, and the first one gives the response time
+void report_dispatch(int node_id, context *proc, int clock_time, int waited) {
+    report_node_t *n = &nodes[node_id];
+    n->dispatches++;
+    hist_add(&n->ready_wait, waited);
+    if (proc->first_run < 0) {
+        proc->first_run = clock_time;
+        hist_add(&n->response, clock_time - proc->admitted);
+    }
+}
+
+//dispatch and switch costs paid on the node
+void report_overhead(int node_id, int switched, int ticks) {
+    nodes[node_id].switches += switched;
+    nodes[node_id].overhead += ticks;
+    overhead_seen = 1;
+}
+
+//message waits, split out for gang members
+void report_msg_wait(int node_id, context *proc, int waited) {
+    report_node_t *n = &nodes[node_id];
+    n->msgs++;
+    n->msg_wait += waited;
+    if (proc->gang >= 0) {
+        n->gang_msgs++;
+        n->gang_msg_wait += waited;
+    }
+}
+
+//deadlines are only counted for DOOPs that gave one
+void report_deadline(int node_id, int missed) {
+    nodes[node_id].deadlines++;
+    nodes[node_id].missed += missed;
+}
+
+//turnaround is measured from admission, which is the arrival time for streamed processes
+void report_finish(int node_id, context *proc) {
+    hist_add(&nodes[node_id].turnaround, proc->finished - proc->admitted);
+    nodes[node_id].finished++;
+}
+
+//cores per node, set before the run
+void report_set_cores(int num_cores) {
+    cores = num_cores > 0 ? num_cores : 1;
+}
+
+//one more busy tick; per core counts are only kept for multi-core nodes
+void report_busy(int node_id, int core) {
+    report_node_t *n = &nodes[node_id];
+    n->busy++;
+    if (cores > 1) {
+        if (!n->core_busy) {
+            n->core_busy = calloc(cores, sizeof(long long));
+            assert(n->core_busy);
+        }
+        n->core_busy[core]++;
+    }
+}
+
+//the node's clock at exit is its length of the run
+void report_node_done(int node_id, int clock_time) {
+    nodes[node_id].ticks = clock_time;
+    nodes[node_id].used = 1;
+}
+
+//merge the per node data and print it
+//summed over the nodes, the makespan is the last node's clock
+void report_throughput(long long *finished, int *makespan, long long *msg_wait) {
+    *finished = 0;
+    *makespan = 0;
+    *msg_wait = 0;
+    for (int i = 0; i < REPORT_MAX_NODES; i++) {
+        if (!nodes[i].used) continue;
+        *finished += nodes[i].finished;
+        *msg_wait += nodes[i].msg_wait;
+        if (nodes[i].ticks > *makespan) *makespan = nodes[i].ticks;
+    }
+}
+
+//handed over by the baseline run, before report_print
+void report_set_baseline(long long finished, int makespan, long long msg_wait) {
+    base_finished = finished;
+    base_makespan = makespan;
+    base_msg_wait = msg_wait;
+}
+
+void report_print(FILE *fout) {
+    static report_node_t all;
+    memset(&all, 0, sizeof(all));
+    //what the baseline run went without
+    const char *without = steal_on && gang_on ? "-w and -g" : steal_on ? "-w" : "-g";
+
+    fprintf(fout, "Node  ticks  busy  idle  utilization  dispatches\n");
+    for (int i = 0; i < REPORT_MAX_NODES; i++) {
+        report_node_t *n = &nodes[i];
+        if (!n->used) continue;
+
+        long long idle = (long long)n->ticks * cores - n->busy;
+        fprintf(fout, "%2.2d  %d  %lld  %lld  %.1f%%  %lld\n", i, n->ticks, n->busy, idle,
+                n->ticks ? 100.0 * n->busy / ((long long)n->ticks * cores) : 0.0, n->dispatches);
+
+        hist_merge(&all.turnaround, &n->turnaround);
+        hist_merge(&all.response, &n->response);
+        hist_merge(&all.ready_wait, &n->ready_wait);
+        all.busy += n->busy;
+        all.ticks += n->ticks;
+        all.dispatches += n->dispatches;
+    }
+    fprintf(fout, "All  %d  %lld  %lld  %.1f%%  %lld\n", all.ticks, all.busy, (long long)all.ticks * cores - all.busy,
+            all.ticks ? 100.0 * all.busy / ((long long)all.ticks * cores) : 0.0, all.dispatches);
+
+    //with several cores per node, how evenly the work spread over them
+    if (cores > 1) {
+        fprintf(fout, "Core  busy  utilization\n");
+        for (int i = 0; i < REPORT_MAX_NODES; i++) {
+            report_node_t *n = &nodes[i];
+            if (!n->used) continue;
+            for (int k = 0; k < cores; k++) {
+                long long busy = n->core_busy ? n->core_busy[k] : 0;
+                fprintf(fout, "%2.2d.%2.2d  %lld  %.1f%%\n", i, k, busy, n->ticks ? 100.0 * busy / n->ticks : 0.0);
+            }
+        }
+    }
+
+    //what dispatching and switching cost each node, as a share of its core time
+    if (overhead_seen) {
+        long long switches = 0, overhead = 0;
+        fprintf(fout, "Node  switches  overhead  overhead_share\n");
+        for (int i = 0; i < REPORT_MAX_NODES; i++) {
+            report_node_t *n = &nodes[i];
+            if (!n->used) continue;
+            fprintf(fout, "%2.2d  %lld  %lld  %.1f%%\n", i, n->switches, n->overhead,
+                    n->ticks ? 100.0 * n->overhead / ((long long)n->ticks * cores) : 0.0);
+            switches += n->switches;
+            overhead += n->overhead;
+        }
+        fprintf(fout, "All  %lld  %lld  %.1f%%\n", switches, overhead,
+                all.ticks ? 100.0 * overhead / ((long long)all.ticks * cores) : 0.0);
+    }
+
+    /* With work stealing, show where processes went and the throughput it bought, against the same
+     * run without -w when main simulated that too
+     */
+    if (steal_on) {
+        long long moved = 0, finished, msg_wait;
+        int makespan;
+        fprintf(fout, "Node  migrated_out  migrated_in\n");
+        for (int i = 0; i < REPORT_MAX_NODES; i++) {
+            if (!nodes[i].used) continue;
+            long long out, in;
+            steal_counts(i, &out, &in);
+            fprintf(fout, "%2.2d  %lld  %lld\n", i, out, in);
+            moved += out;
+        }
+        report_throughput(&finished, &makespan, &msg_wait);
+        double rate = makespan ? 1000.0 * finished / makespan : 0.0;
+        fprintf(fout, "Migrations %lld (cost %d ticks), throughput %lld processes in %d ticks (%.2f per 1000 ticks)\n",
+                moved, steal_cost(), finished, makespan, rate);
+        if (base_finished >= 0) {
+            double base = base_makespan ? 1000.0 * base_finished / base_makespan : 0.0;
+            fprintf(fout, "Without %s: throughput %lld processes in %d ticks (%.2f per 1000 ticks), change %+.1f%%\n",
+                    without, base_finished, base_makespan, base, base ? 100.0 * (rate - base) / base : 0.0);
+        }
+    }
+
+    //device contention: utilization over the makespan and how long requests queued
+    if (device_on) {
+        int makespan = 0;
+        for (int i = 0; i < REPORT_MAX_NODES; i++) {
+            if (nodes[i].used && nodes[i].ticks > makespan) makespan = nodes[i].ticks;
+        }
+        device_print(fout, makespan);
+    }
+
+    /* How long SEND/RECVs kept their process blocked and, with -g, what gang scheduling saved against
+     * the same run without it when main simulated that too
+     */
+    for (int i = 0; i < REPORT_MAX_NODES; i++) {
+        all.msgs += nodes[i].msgs;
+        all.msg_wait += nodes[i].msg_wait;
+        all.gang_msgs += nodes[i].gang_msgs;
+        all.gang_msg_wait += nodes[i].gang_msg_wait;
+    }
+    if (all.msgs > 0) {
+        fprintf(fout, "Message wait %lld ticks over %lld SEND/RECV (mean %.2f)", all.msg_wait, all.msgs,
+                (double)all.msg_wait / all.msgs);
+        if (gang_on) {
+            fprintf(fout, ", gang members %lld over %lld (mean %.2f)", all.gang_msg_wait, all.gang_msgs,
+                    all.gang_msgs ? (double)all.gang_msg_wait / all.gang_msgs : 0.0);
+        }
+        fprintf(fout, "\n");
+        if (gang_on && base_finished >= 0) {
+            fprintf(fout, "Message wait saved by %s: %lld ticks (%.1f%%)\n", without, base_msg_wait - all.msg_wait,
+                    base_msg_wait ? 100.0 * (base_msg_wait - all.msg_wait) / base_msg_wait : 0.0);
+        }
+    }
+    if (gang_on) {
+        gang_print(fout);
+    }
+
+    //the policies and, for DOOPs that gave a deadline, how many were late
+    sched_print(fout);
+    for (int i = 0; i < REPORT_MAX_NODES; i++) {
+        all.deadlines += nodes[i].deadlines;
+        all.missed += nodes[i].missed;
+    }
+    if (all.deadlines > 0) {
+        fprintf(fout, "Deadlines %lld, missed %lld (%.1f%%)\n", all.deadlines, all.missed,
+                100.0 * all.missed / all.deadlines);
+    }
+
+    fprintf(fout, "Distributions in ticks (bucket lower bounds, within 1/8 of the value):\n");
+    hist_print(&all.turnaround, "turnaround", fout);
+    hist_print(&all.response, "response", fout);
+    hist_print(&all.ready_wait, "ready wait", fout);
+}
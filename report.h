@@ -0,0 +1,50 @@
+//filename: report.h
+//Description: run analytics. Each node aggregates into its own histograms and counters while it
+//simulates (no locks, O(1) per event); the report merges them once at the end.
+#ifndef PROSIM_REPORT_H
+#define PROSIM_REPORT_H
+
+#include <stdio.h>
+#include "context.h"
+
+//non-zero once report_enable has been called; hooks are skipped otherwise
+extern int report_on;
+
+//turns on collection for the run
+extern void report_enable(void);
+
+//a process was dispatched on node after waiting `waited` ticks in the ready queue
+extern void report_dispatch(int node_id, context *proc, int clock_time, int waited);
+
+//a process was put on a core of node at a cost of `ticks`, switching from another process or not
+extern void report_overhead(int node_id, int switched, int ticks);
+
+//a SEND/RECV of a process on node completed after the process was blocked `waited` ticks
+extern void report_msg_wait(int node_id, context *proc, int waited);
+
+//a DOOP with a deadline operand finished on node, on time or not
+extern void report_deadline(int node_id, int missed);
+
+//a process finished on node
+extern void report_finish(int node_id, context *proc);
+
+//the node has this many cores (called before the run)
+extern void report_set_cores(int cores);
+
+//core k of the node was busy for one tick
+extern void report_busy(int node_id, int core);
+
+//the node left the simulation at clock_time
+extern void report_node_done(int node_id, int clock_time);
+
+//# of processes finished, the makespan so far and the ticks SEND/RECVs kept their process blocked,
+//for a baseline run to hand over
+extern void report_throughput(long long *finished, int *makespan, long long *msg_wait);
+
+//the same of the run without work stealing and gang scheduling, to print the changes against
+extern void report_set_baseline(long long finished, int makespan, long long msg_wait);
+
+//prints the turnaround, response and ready-wait distributions and per-node utilization
+extern void report_print(FILE *fout);
+
+#endif
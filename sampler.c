@@ -0,0 +1,90 @@
+//filename: sampler.c
+//Description: time series sampling of queue depths, see sampler.h
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sampler.h"
+
+#define SAMPLER_MAX_NODES 101
+#define SAMPLER_BUF       (64 * 1024)
+#define SAMPLER_ROW_MAX   96           /* longest possible row */
+
+typedef struct sampler_node {
+    char buf[SAMPLER_BUF];     /* formatted rows not written yet */
+    int len;                   /* bytes used in buf */
+} __attribute__((aligned(64))) sampler_node_t;
+
+static sampler_node_t nodes[SAMPLER_MAX_NODES];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *out;
+int sampler_every = 0;
+
+//appends a non-negative integer and a separator, returns the new end
+static char *_put(char *p, int v, char sep) {
+    char tmp[12];
+    int n = 0;
+    if (v < 0) v = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n) *p++ = tmp[--n];
+    *p++ = sep;
+    return p;
+}
+
+//opens the file ("-" for stdout) and writes the header
+int sampler_open(const char *path, int every) {
+    out = strcmp(path, "-") ? fopen(path, "w") : stdout;
+    if (!out) {
+        return 0;
+    }
+    fputs("time,node,running,ready,blocked,send_blocked,recv_blocked\n", out);
+    sampler_every = every > 0 ? every : 1;
+    return 1;
+}
+
+//formats one row into the node's buffer, flushing first if it might not fit
+void sampler_record(int node_id, int clock_time, int running, int ready, int blocked,
+                    int send_blocked, int recv_blocked) {
+    sampler_node_t *n = &nodes[node_id];
+    if (n->len + SAMPLER_ROW_MAX > SAMPLER_BUF) {
+        sampler_flush(node_id);
+    }
+
+    char *p = n->buf + n->len;
+    p = _put(p, clock_time, ',');
+    p = _put(p, node_id, ',');
+    p = _put(p, running, ',');
+    p = _put(p, ready, ',');
+    p = _put(p, blocked, ',');
+    p = _put(p, send_blocked, ',');
+    p = _put(p, recv_blocked, '\n');
+    n->len = (int)(p - n->buf);
+}
+
+//appends the node's buffer to the file
+void sampler_flush(int node_id) {
+    sampler_node_t *n = &nodes[node_id];
+    if (!out || n->len == 0) {
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    fwrite(n->buf, 1, n->len, out);
+    pthread_mutex_unlock(&lock);
+    n->len = 0;
+}
+
+//closes the file once every node has flushed
+void sampler_close(void) {
+    if (out) {
+        if (out == stdout) {
+            fflush(out);
+        } else {
+            fclose(out);
+        }
+        out = NULL;
+    }
+}
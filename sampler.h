@@ -0,0 +1,24 @@
+//filename: sampler.h
+//Description: per-tick time series of each node's queue gauges, written as CSV
+//(time,node,running,ready,blocked,send_blocked,recv_blocked). Each node formats its rows into its own
+//buffer and appends whole buffers to the file, so sampling costs no locks between flushes.
+#ifndef PROSIM_SAMPLER_H
+#define PROSIM_SAMPLER_H
+
+//sample every this many ticks, 0 when sampling is off
+extern int sampler_every;
+
+//opens the output file ("-" for stdout) and writes the CSV header. returns 0 if the file cannot be opened
+extern int sampler_open(const char *path, int every);
+
+//records one row for a node
+extern void sampler_record(int node_id, int clock_time, int running, int ready, int blocked,
+                           int send_blocked, int recv_blocked);
+
+//writes out whatever the node still has buffered (called when the node leaves the simulation)
+extern void sampler_flush(int node_id);
+
+//closes the output file
+extern void sampler_close(void);
+
+#endif
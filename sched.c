@@ -0,0 +1,336 @@
+//filename: sched.c
+//Description: the built-in scheduling policies, see sched.h. prio, CFS and EDF keep their ready queue
+//in a red-black tree keyed by their rank, so ties go in arrival order as they did with prio_q;
+//MLFQ keeps one FIFO per level.
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sched.h"
+#include "rbtree.h"
+#include "prio_q.h"
+
+#define CFS_NICE_0      1024        /* weight of nice 0 */
+#define CFS_WAKEUP_GRAN 1024        /* vruntime an arrival must be ahead by to preempt: one tick at nice 0 */
+
+//load weight for nice 0..19, as in Linux (each step is about 10% less CPU)
+static const int cfs_weights[] = {
+    1024, 820, 655, 526, 423, 335, 272, 215, 172, 137,
+    110, 87, 70, 56, 45, 36, 29, 23, 18, 15
+};
+
+typedef struct tree_rq {
+    rb_tree_t *tree;
+    int quantum;
+    long long min_vruntime;         /* CFS: never decreases, woken processes start no lower */
+} tree_rq_t;
+
+typedef struct mlfq_rq {
+    prio_q_t *level[SCHED_MLFQ_LEVELS]; /* FIFO per level, top first */
+    int quantum;
+    int epoch;                      /* boosts so far + 1; a process from an older epoch is back at the top */
+    int next_boost;                 /* tick of the next boost */
+    int count;
+} mlfq_rq_t;
+
+/* Tree backed ready queues, shared by prio, CFS and EDF
+ */
+static void *tree_create(int quantum) {
+    tree_rq_t *rq = calloc(1, sizeof(tree_rq_t));
+    assert(rq);
+    rq->tree = rb_new();
+    rq->quantum = quantum;
+    return rq;
+}
+
+static context *tree_pick(void *q, int clock_time) {
+    return rb_remove_first(((tree_rq_t *)q)->tree);
+}
+
+static int tree_head(void *q, context **out, int n) {
+    int i = 0;
+    for (rb_node_t *node = ((tree_rq_t *)q)->tree->first; node && i < n; node = rb_next(node)) {
+        out[i++] = node->contents;
+    }
+    return i;
+}
+
+static context *tree_remove_if(void *q, int (*pred)(void *, void *), void *arg) {
+    rb_tree_t *tree = ((tree_rq_t *)q)->tree;
+    for (rb_node_t *node = tree->first; node; node = rb_next(node)) {
+        if (pred(node->contents, arg)) {
+            return rb_erase(tree, node);
+        }
+    }
+    return NULL;
+}
+
+static int tree_size(void *q) {
+    return ((tree_rq_t *)q)->tree->count;
+}
+
+static int quantum_slice(void *q, context *proc) {
+    return ((tree_rq_t *)q)->quantum;
+}
+
+/* prio: the program priority, or for SJF the ticks left in the current DOOP
+ */
+static long long prio_key(void *q, context *proc) {
+    return proc->priority < 0 ? proc->duration : proc->priority;
+}
+
+static void prio_enqueue(void *q, context *proc, int clock_time) {
+    rb_insert(((tree_rq_t *)q)->tree, proc, prio_key(q, proc));
+}
+
+static int prio_preempt(void *q, context *running, context *arrival) {
+    return prio_key(q, arrival) < prio_key(q, running);
+}
+
+/* CFS: virtual runtime, which grows more slowly for programs of a lower nice value
+ */
+static int cfs_weight(context *proc) {
+    int nice = proc->priority < 0 ? 0 : proc->priority > 19 ? 19 : proc->priority;
+    return cfs_weights[nice];
+}
+
+static long long cfs_key(void *q, context *proc) {
+    return proc->vruntime;
+}
+
+//a process that slept (or is new) starts at the queue's minimum, so it cannot hog the core to catch up
+static void cfs_enqueue(void *q, context *proc, int clock_time) {
+    tree_rq_t *rq = q;
+    if (proc->vruntime < rq->min_vruntime) {
+        proc->vruntime = rq->min_vruntime;
+    }
+    rb_insert(rq->tree, proc, proc->vruntime);
+}
+
+static context *cfs_pick(void *q, int clock_time) {
+    tree_rq_t *rq = q;
+    context *proc = rb_remove_first(rq->tree);
+    if (proc && proc->vruntime > rq->min_vruntime) {
+        rq->min_vruntime = proc->vruntime;
+    }
+    return proc;
+}
+
+static void cfs_tick(void *q, context *proc) {
+    proc->vruntime += (long long)CFS_NICE_0 * CFS_NICE_0 / cfs_weight(proc);
+}
+
+static int cfs_preempt(void *q, context *running, context *arrival) {
+    return arrival->vruntime + CFS_WAKEUP_GRAN < running->vruntime;
+}
+
+/* EDF: the absolute deadline of the current op, set when it became ready
+ */
+static long long edf_key(void *q, context *proc) {
+    return proc->deadline;
+}
+
+static void edf_enqueue(void *q, context *proc, int clock_time) {
+    rb_insert(((tree_rq_t *)q)->tree, proc, proc->deadline);
+}
+
+static int edf_preempt(void *q, context *running, context *arrival) {
+    return arrival->deadline < running->deadline;
+}
+
+/* MLFQ
+ */
+static void *mlfq_create(int quantum) {
+    mlfq_rq_t *rq = calloc(1, sizeof(mlfq_rq_t));
+    assert(rq);
+    for (int l = 0; l < SCHED_MLFQ_LEVELS; l++) {
+        rq->level[l] = prio_q_new();
+    }
+    rq->quantum = quantum;
+    rq->epoch = 1;
+    rq->next_boost = SCHED_MLFQ_BOOST * quantum;
+    return rq;
+}
+
+//ticks a process may use at a level before it drops to the next
+static int mlfq_allotment(mlfq_rq_t *rq, int level) {
+    return rq->quantum << level;
+}
+
+//a process last seen before the latest boost starts again at the top
+static void mlfq_refresh(mlfq_rq_t *rq, context *proc) {
+    if (proc->level_epoch != rq->epoch) {
+        proc->level_epoch = rq->epoch;
+        proc->level = 0;
+        proc->level_used = 0;
+    }
+}
+
+/* Moves every queued process to the top level when a boost is due, keeping the levels' order.
+ * The FIFOs are spliced together, so this is O(levels); every process, queued or not, catches up
+ * through the epoch when it is next seen.
+ */
+static void mlfq_boost(mlfq_rq_t *rq, int clock_time) {
+    if (clock_time < rq->next_boost) {
+        return;
+    }
+    rq->next_boost = clock_time + SCHED_MLFQ_BOOST * rq->quantum;
+    rq->epoch++;
+
+    prio_q_t *top = rq->level[0];
+    for (int l = 1; l < SCHED_MLFQ_LEVELS; l++) {
+        prio_q_t *q = rq->level[l];
+        if (!q->head) {
+            continue;
+        }
+        if (top->tail) {
+            top->tail->next = q->head;
+        } else {
+            top->head = q->head;
+        }
+        top->tail = q->tail;
+        top->count += q->count;
+        q->head = q->tail = NULL;
+        q->count = 0;
+    }
+}
+
+static void mlfq_enqueue(void *q, context *proc, int clock_time) {
+    mlfq_rq_t *rq = q;
+    mlfq_boost(rq, clock_time);
+    mlfq_refresh(rq, proc);
+    prio_q_add(rq->level[proc->level], proc, 0);
+    rq->count++;
+}
+
+static context *mlfq_pick(void *q, int clock_time) {
+    mlfq_rq_t *rq = q;
+    mlfq_boost(rq, clock_time);
+    for (int l = 0; l < SCHED_MLFQ_LEVELS; l++) {
+        if (!prio_q_empty(rq->level[l])) {
+            rq->count--;
+            return prio_q_remove(rq->level[l]);
+        }
+    }
+    return NULL;
+}
+
+static int mlfq_head(void *q, context **out, int n) {
+    mlfq_rq_t *rq = q;
+    int i = 0;
+    for (int l = 0; l < SCHED_MLFQ_LEVELS; l++) {
+        for (node_t *node = rq->level[l]->head; node && i < n; node = node->next) {
+            out[i++] = node->contents;
+        }
+    }
+    return i;
+}
+
+static context *mlfq_remove_if(void *q, int (*pred)(void *, void *), void *arg) {
+    mlfq_rq_t *rq = q;
+    for (int l = 0; l < SCHED_MLFQ_LEVELS; l++) {
+        context *proc = prio_q_remove_if(rq->level[l], pred, arg);
+        if (proc) {
+            rq->count--;
+            return proc;
+        }
+    }
+    return NULL;
+}
+
+static int mlfq_size(void *q) {
+    return ((mlfq_rq_t *)q)->count;
+}
+
+//using up the allotment at a level drops the process a level, however often it gave up the core meanwhile
+static void mlfq_tick(void *q, context *proc) {
+    mlfq_rq_t *rq = q;
+    mlfq_refresh(rq, proc);
+    if (++proc->level_used >= mlfq_allotment(rq, proc->level) && proc->level < SCHED_MLFQ_LEVELS - 1) {
+        proc->level++;
+        proc->level_used = 0;
+    }
+}
+
+//what is left of the allotment, so the quantum runs out when the process drops a level
+static int mlfq_slice(void *q, context *proc) {
+    mlfq_rq_t *rq = q;
+    mlfq_refresh(rq, proc);
+    int left = mlfq_allotment(rq, proc->level) - proc->level_used;
+    return left > 0 ? left : rq->quantum;
+}
+
+static long long mlfq_key(void *q, context *proc) {
+    mlfq_refresh(q, proc);
+    return proc->level;
+}
+
+static int mlfq_preempt(void *q, context *running, context *arrival) {
+    return mlfq_key(q, arrival) < mlfq_key(q, running);
+}
+
+static const sched_policy_t policies[] = {
+    { "prio", tree_create, prio_enqueue, tree_pick, tree_head, tree_remove_if, tree_size,
+      NULL, quantum_slice, prio_key, prio_preempt },
+    { "mlfq", mlfq_create, mlfq_enqueue, mlfq_pick, mlfq_head, mlfq_remove_if, mlfq_size,
+      mlfq_tick, mlfq_slice, mlfq_key, mlfq_preempt },
+    { "cfs", tree_create, cfs_enqueue, cfs_pick, tree_head, tree_remove_if, tree_size,
+      cfs_tick, quantum_slice, cfs_key, cfs_preempt },
+    { "edf", tree_create, edf_enqueue, tree_pick, tree_head, tree_remove_if, tree_size,
+      NULL, quantum_slice, edf_key, edf_preempt },
+    { NULL }
+};
+
+static const sched_policy_t *node_policy[SCHED_MAX_NODES];
+static int custom;                  /* some node is not on prio */
+
+//one word per node, the last one repeated for the nodes left
+int sched_assign(const char *line) {
+    char copy[1024];
+    strncpy(copy, line, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = '\0';
+
+    int node = 1;
+    const sched_policy_t *last = NULL;
+    for (char *tok = strtok(copy, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+        last = NULL;
+        for (int i = 0; policies[i].name; i++) {
+            if (!strcmp(tok, policies[i].name)) last = &policies[i];
+        }
+        if (!last) {
+            fprintf(stderr, "Bad input: unknown scheduling policy %s in the header\n", tok);
+            return 0;
+        }
+        if (node < SCHED_MAX_NODES) {
+            node_policy[node++] = last;
+        }
+        custom |= last != &policies[0];
+    }
+    while (last && node < SCHED_MAX_NODES) {
+        node_policy[node++] = last;
+    }
+    return 1;
+}
+
+//prio unless the header said otherwise
+const sched_policy_t *sched_for(int node_id) {
+    return node_policy[node_id] ? node_policy[node_id] : &policies[0];
+}
+
+//one line, only when the header chose policies other than the default
+void sched_print(FILE *fout) {
+    if (!custom) {
+        return;
+    }
+    fprintf(fout, "Policies");
+    const sched_policy_t *prev = NULL;
+    for (int i = 1; i < SCHED_MAX_NODES; i++) {
+        if (!node_policy[i] || node_policy[i] == prev) {
+            continue;
+        }
+        fprintf(fout, " %2.2d %s", i, node_policy[i]->name);
+        prev = node_policy[i];
+    }
+    fprintf(fout, "\n");
+}
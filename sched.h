@@ -0,0 +1,55 @@
+//filename: sched.h
+//Description: scheduling policies. Every node has a policy, which owns the node's ready queue and
+//decides the order processes are dispatched in, how long they may run and which arrivals preempt a
+//running process. The policies are picked per node by the words after the header's three numbers:
+//  8 3 3 mlfq            every node runs MLFQ
+//  8 3 3 prio cfs edf    node 1 prio, node 2 CFS, node 3 (and any further node) EDF
+//
+//  prio : static priority, or SJF for programs with a negative priority (the default)
+//  mlfq : multi-level feedback queue; a process that uses up its allotment at a level drops a level,
+//         and every level goes back to the top every SCHED_MLFQ_BOOST quanta
+//  cfs  : lowest virtual runtime first; runtime is weighted by the program priority taken as a nice value
+//  edf  : earliest deadline first; DOOP n d must be done d ticks after it becomes ready (n if not given),
+//         and SEND/RECV one tick after
+//
+//Queue operations are O(log n) or better (O(1) for MLFQ), except remove_if and head which walk the queue.
+#ifndef PROSIM_SCHED_H
+#define PROSIM_SCHED_H
+
+#include <stdio.h>
+#include "context.h"
+
+#define SCHED_MAX_NODES   101
+#define SCHED_MLFQ_LEVELS 3
+#define SCHED_MLFQ_BOOST  16        /* quanta between two boosts to the top level */
+
+typedef struct sched_policy {
+    const char *name;
+    void *(*create)(int quantum);                               /* new empty ready queue */
+    void (*enqueue)(void *rq, context *proc, int clock_time);   /* proc became ready */
+    context *(*pick)(void *rq, int clock_time);                 /* removes the process to run next, NULL if none */
+    int (*head)(void *rq, context **out, int n);                /* the next n to be picked, in order; returns the count */
+    context *(*remove_if)(void *rq, int (*pred)(void *proc, void *arg), void *arg); /* first match in queue order */
+    int (*size)(void *rq);                                      /* # of ready processes */
+    void (*tick)(void *rq, context *proc);                      /* proc ran for a tick; NULL if nothing to do,
+                                                                   which lets the node batch its DOOPs (vtick.h) */
+    int (*slice)(void *rq, context *proc);                      /* ticks proc may run once dispatched */
+    long long (*key)(void *rq, context *proc);                  /* rank, lower runs first */
+    int (*should_preempt)(void *rq, context *running, context *arrival);
+} sched_policy_t;
+
+/* Sets the policies of the nodes from the rest of the header line
+ * @params:
+ *   line : policy names, one for every node in order; the last one given applies to the nodes after it
+ * @returns:
+ *   1 on success, 0 on an unknown name (reported on stderr)
+ */
+extern int sched_assign(const char *line);
+
+//the policy of node_id
+extern const sched_policy_t *sched_for(int node_id);
+
+//prints the nodes' policies, if any node is not on the default one
+extern void sched_print(FILE *fout);
+
+#endif
@@ -0,0 +1,581 @@
+//filename: shard.c
+//Description: sharded runs: the shard processes, the coordinator and the links between them (see shard.h)
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/futex.h>
+
+#include "shard.h"
+#include "message.h"
+#include "process.h"
+#include "prio_q.h"
+
+#define SHARD_MAX_NODES 100
+#define RING_BYTES      (1 << 20)
+#define RING_SPINS      4096        /* polls of a ring before sleeping on it, when there are CPUs to spare */
+#define RING_NAP_MS     50          /* how often a sleeping coordinator checks its shard is still there */
+
+int shard_procs = 0;
+int shard_on = 0;
+static int use_sockets = 0;
+static int ring_spins;              /* polls before sleeping; none if polling would hold up the other end */
+
+//one direction of a shared-memory link: one writer, one reader
+typedef struct ring {
+    unsigned long long head __attribute__((aligned(64)));  /* bytes taken by the reader */
+    unsigned long long tail __attribute__((aligned(64)));  /* bytes put by the writer */
+    unsigned seq __attribute__((aligned(64)));             /* bumped whenever head or tail moves, slept on */
+    unsigned sleepers;                                     /* ends sleeping on seq */
+    char data[RING_BYTES];
+} ring_t;
+
+//a shard's connection to the coordinator, from either end
+typedef struct link {
+    ring_t *in, *out;     /* shared-memory rings, or */
+    int fd;               /* a Unix socket */
+    pid_t pid;            /* the shard's process (coordinator's end) */
+    int first, last;      /* the nodes it runs */
+    int gone;             /* it has left (coordinator's end) */
+    int reaped, status;   /* its exit status, once waited for (coordinator's end) */
+} link_t;
+
+//a growing byte buffer
+typedef struct buf {
+    char *data;
+    size_t len, cap;
+} buf_t;
+
+//a SEND for a receiver on another shard, or a match for a sender on another shard
+enum { REC_SEND = 1, REC_MATCH };
+
+typedef struct shard_rec {
+    int kind;
+    int to;               /* the receiver (SEND) or the sender (MATCH) */
+    int from, node;       /* the sender and its node (SEND) */
+    int tag, size;
+    int time;             /* tick of the SEND, or delivery tick of the match */
+} shard_rec_t;
+
+//what a shard sends at every exchange and when it leaves, followed by its records, state lines,
+//summary rows (each a row_head_t and its text) and wait-for edges
+typedef struct up_head {
+    int leave;            /* the shard's nodes are done; its last frame */
+    int recs, text, rows, waits;
+    int busy, stuck;      /* its part of the wait-for summary, after Step 3 */
+    int ticks;            /* when leaving: its latest clock and # of state changes */
+    long long events;
+} up_head_t;
+
+//what the coordinator sends back, followed by the records
+typedef struct down_head {
+    int recs;
+    int busy, stuck;      /* the wait-for summary over every shard, after Step 3 */
+} down_head_t;
+
+typedef struct row_head {
+    int time, node, pid, len;
+} row_head_t;
+
+//records and lines queued by one node between exchanges (owner thread only)
+typedef struct outbox {
+    buf_t recs, text;
+} __attribute__((aligned(64))) outbox_t;
+
+static int num_nodes;
+static int num_shards;
+static link_t *links;                          /* coordinator: one per shard */
+static link_t up;                              /* shard: its link to the coordinator */
+static int node_shard[SHARD_MAX_NODES + 1];    /* which shard runs a node */
+static outbox_t box[SHARD_MAX_NODES + 1];      /* shard: per node, 0 for the exchange's own */
+static buf_t rows;                             /* shard: summary rows not shipped yet */
+static buf_t frame, in;
+
+static void _put(buf_t *b, const void *p, size_t n) {
+    if (b->len + n > b->cap) {
+        b->cap = b->cap ? b->cap : 4096;
+        while (b->len + n > b->cap) b->cap *= 2;
+        b->data = realloc(b->data, b->cap);
+        assert(b->data);
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static long _futex(unsigned *addr, int op, unsigned val, const struct timespec *ts) {
+    return syscall(SYS_futex, addr, op, val, ts, NULL, 0);
+}
+
+//the other end may be waiting for head or tail to move
+static void _ring_kick(ring_t *r) {
+    __atomic_fetch_add(&r->seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->sleepers, __ATOMIC_SEQ_CST)) {
+        _futex(&r->seq, FUTEX_WAKE, INT_MAX, NULL);
+    }
+}
+
+/* Waits for the other end to move the ring on from seq value seen: polls for a while, then sleeps
+ * @params:
+ *   l    : the link
+ *   r    : one of its rings
+ *   seen : seq when the ring was last looked at
+ * @returns:
+ *   0 if the shard at the other end has exited, 1 otherwise. A shard dies with the coordinator.
+ */
+static int _ring_wait(link_t *l, ring_t *r, unsigned seen) {
+    for (int i = 0; i < ring_spins; i++) {
+        if (__atomic_load_n(&r->seq, __ATOMIC_SEQ_CST) != seen) {
+            return 1;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    struct timespec nap = {0, RING_NAP_MS * 1000000L};
+    long rc = 0;
+    __atomic_fetch_add(&r->sleepers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->seq, __ATOMIC_SEQ_CST) == seen) {
+        rc = _futex(&r->seq, FUTEX_WAIT, seen, &nap);
+    }
+    __atomic_fetch_sub(&r->sleepers, 1, __ATOMIC_SEQ_CST);
+
+    //a shard that has exited is reaped here, so keep its status for shard_coordinate
+    if (rc == -1 && errno == ETIMEDOUT && l->pid && !l->reaped && waitpid(l->pid, &l->status, WNOHANG) != 0) {
+        l->reaped = 1;
+    }
+    return !l->reaped;
+}
+
+//reads n bytes from the link; 0 if the other end went away first
+static int _link_read(link_t *l, void *p, size_t n) {
+    char *dst = p;
+    if (!l->in) {
+        while (n > 0) {
+            ssize_t k = recv(l->fd, dst, n, 0);
+            if (k < 0 && errno == EINTR) continue;
+            if (k <= 0) return 0;
+            dst += k;
+            n -= k;
+        }
+        return 1;
+    }
+
+    ring_t *r = l->in;
+    while (n > 0) {
+        unsigned seen = __atomic_load_n(&r->seq, __ATOMIC_SEQ_CST);
+        unsigned long long head = r->head;
+        unsigned long long tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        if (tail == head) {
+            //what a shard wrote before exiting is still there to read
+            if (!_ring_wait(l, r, seen) && __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == head) {
+                return 0;
+            }
+            continue;
+        }
+        size_t off = head % RING_BYTES;
+        size_t k = tail - head;
+        if (k > n) k = n;
+        if (k > RING_BYTES - off) k = RING_BYTES - off;
+        memcpy(dst, r->data + off, k);
+        __atomic_store_n(&r->head, head + k, __ATOMIC_RELEASE);
+        _ring_kick(r);
+        dst += k;
+        n -= k;
+    }
+    return 1;
+}
+
+//writes n bytes to the link; 0 if the other end went away
+static int _link_write(link_t *l, const void *p, size_t n) {
+    const char *src = p;
+    if (!l->out) {
+        while (n > 0) {
+            ssize_t k = send(l->fd, src, n, MSG_NOSIGNAL);
+            if (k < 0 && errno == EINTR) continue;
+            if (k <= 0) return 0;
+            src += k;
+            n -= k;
+        }
+        return 1;
+    }
+
+    ring_t *r = l->out;
+    while (n > 0) {
+        unsigned seen = __atomic_load_n(&r->seq, __ATOMIC_SEQ_CST);
+        unsigned long long tail = r->tail;
+        unsigned long long head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        if (tail - head == RING_BYTES) {
+            if (!_ring_wait(l, r, seen)) {
+                return 0;
+            }
+            continue;
+        }
+        size_t off = tail % RING_BYTES;
+        size_t k = RING_BYTES - (tail - head);
+        if (k > n) k = n;
+        if (k > RING_BYTES - off) k = RING_BYTES - off;
+        memcpy(r->data + off, src, k);
+        __atomic_store_n(&r->tail, tail + k, __ATOMIC_RELEASE);
+        _ring_kick(r);
+        src += k;
+        n -= k;
+    }
+    return 1;
+}
+
+//reads a frame's body of n bytes into in
+static int _read_body(link_t *l, size_t n) {
+    if (n > in.cap) {
+        in.cap = n;
+        in.data = realloc(in.data, n);
+        assert(in.data);
+    }
+    in.len = n;
+    return _link_read(l, in.data, n);
+}
+
+int shard_parse(const char *arg) {
+    char mode[8] = "";
+    int n = 0;
+    if (sscanf(arg, "%d,%7s", &n, mode) < 1 || n < 1 || (mode[0] && strcmp(mode, "sock"))) {
+        fprintf(stderr, "Bad shard count %s, expecting n[,sock]\n", arg);
+        return 0;
+    }
+    shard_procs = n;
+    use_sockets = mode[0] != 0;
+    return 1;
+}
+
+//a shared ring, or NULL if it cannot be mapped
+static ring_t *_ring_new(void) {
+    ring_t *r = mmap(NULL, sizeof(ring_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return r == MAP_FAILED ? NULL : r;
+}
+
+int shard_fork(int nodes, int *first, int *last) {
+    if (nodes > SHARD_MAX_NODES) {
+        fprintf(stderr, "Shards can run at most %d nodes\n", SHARD_MAX_NODES);
+        return -1;
+    }
+    num_nodes = nodes;
+    num_shards = shard_procs < nodes ? shard_procs : nodes;
+    if (num_shards < 1) {
+        num_shards = 1;
+    }
+    ring_spins = sysconf(_SC_NPROCESSORS_ONLN) > num_shards ? RING_SPINS : 0;
+
+    //every link is made before the first fork; a shard keeps only its own
+    links = calloc(num_shards, sizeof(link_t));
+    int *far = calloc(num_shards, sizeof(int));
+    assert(links && far);
+    for (int i = 0; i < num_shards; i++) {
+        link_t *l = &links[i];
+        l->first = i * nodes / num_shards + 1;
+        l->last = (i + 1) * nodes / num_shards;
+        for (int n = l->first; n <= l->last; n++) {
+            node_shard[n] = i;
+        }
+        l->fd = far[i] = -1;
+        if (!use_sockets && (l->in = _ring_new()) && (l->out = _ring_new())) {
+            continue;
+        }
+        //no shared memory: this link falls back on a socket
+        if (l->in) munmap(l->in, sizeof(ring_t));
+        l->in = l->out = NULL;
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+            perror("socketpair");
+            return -1;
+        }
+        l->fd = sv[0];
+        far[i] = sv[1];
+    }
+
+    fflush(NULL);
+    pid_t parent = getpid();
+    for (int i = 0; i < num_shards; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            for (int j = 0; j < i; j++) {
+                kill(links[j].pid, SIGKILL);
+            }
+            return -1;
+        }
+        if (pid == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            if (getppid() != parent) {
+                _exit(1);
+            }
+            for (int j = 0; j < num_shards; j++) {
+                if (links[j].fd >= 0) close(links[j].fd);
+                if (j != i && far[j] >= 0) close(far[j]);
+            }
+            up.in = links[i].out;
+            up.out = links[i].in;
+            up.fd = far[i];
+            *first = up.first = links[i].first;
+            *last = up.last = links[i].last;
+            shard_on = 1;
+            return 1;
+        }
+        links[i].pid = pid;
+    }
+
+    for (int i = 0; i < num_shards; i++) {
+        if (far[i] >= 0) close(far[i]);
+    }
+    free(far);
+    return 0;
+}
+
+int shard_remote(int addr) {
+    int node = addr / 100;
+    return node >= 1 && node <= num_nodes && (node < up.first || node > up.last);
+}
+
+void shard_send(int by, int sender_addr, int sender_node, int receiver_addr, int tag, int size, int clock_time) {
+    shard_rec_t r = {REC_SEND, receiver_addr, sender_addr, sender_node, tag, size, clock_time};
+    _put(&box[by].recs, &r, sizeof(r));
+}
+
+void shard_match(int by, int sender_addr, int deliver) {
+    shard_rec_t r = {REC_MATCH, sender_addr, 0, 0, 0, 0, deliver};
+    _put(&box[by].recs, &r, sizeof(r));
+}
+
+void shard_line(int node_id, const char *line) {
+    _put(&box[node_id].text, line, strlen(line));
+    _put(&box[node_id].text, "\n", 1);
+}
+
+void shard_row(int clock_time, int node_id, int pid, const char *row) {
+    row_head_t h = {clock_time, node_id, pid, strlen(row)};
+    _put(&rows, &h, sizeof(h));
+    _put(&rows, row, h.len);
+}
+
+//starts a frame with h, then adds every outbox's records, every outbox's lines and the rows, emptying them
+static void _frame_up(up_head_t *h) {
+    frame.len = 0;
+    _put(&frame, h, sizeof(*h));
+    for (int pass = 0; pass < 2; pass++) {
+        //the exchange's own outbox, then the nodes'
+        for (int n = up.first - 1; n <= up.last; n++) {
+            outbox_t *b = n < up.first ? &box[0] : &box[n];
+            buf_t *part = pass == 0 ? &b->recs : &b->text;
+            _put(&frame, part->data, part->len);
+            if (pass == 0) {
+                h->recs += part->len / sizeof(shard_rec_t);
+            } else {
+                h->text += part->len;
+            }
+            part->len = 0;
+        }
+    }
+    _put(&frame, rows.data, rows.len);
+    h->rows = rows.len;
+    rows.len = 0;
+}
+
+/* One exchange with the coordinator, run by the thread completing the shard's barrier
+ * @params:
+ *   matches : 0 after Step 2 (the SENDs), 1 after Step 3 (the matches they made and the wait-for summary)
+ * @returns:
+ *   none; the shard exits if the coordinator has gone
+ */
+static void _exchange(int matches) {
+    up_head_t h = {0};
+    if (matches) {
+        msg_dl_counts(&h.busy, &h.stuck);
+    }
+    _frame_up(&h);
+    memcpy(frame.data, &h, sizeof(h));
+
+    down_head_t d;
+    if (!_link_write(&up, frame.data, frame.len) || !_link_read(&up, &d, sizeof(d)) ||
+        !_read_body(&up, d.recs * sizeof(shard_rec_t))) {
+        _exit(1);
+    }
+    //matches made by the SENDs applied here go out with the next exchange, from outbox 0
+    shard_rec_t *r = (shard_rec_t *)in.data;
+    for (int i = 0; i < d.recs; i++, r++) {
+        if (r->kind == REC_SEND) {
+            msg_remote_send(r->from, r->node, r->to, r->tag, r->size, r->time);
+        } else {
+            msg_remote_match(r->to, r->time);
+        }
+    }
+    if (matches) {
+        msg_dl_set(d.busy, d.stuck);
+    }
+}
+
+void shard_exchange_sends(void) {
+    _exchange(0);
+}
+
+void shard_exchange_matches(void) {
+    _exchange(1);
+}
+
+void shard_leave(void) {
+    up_head_t h = {0};
+    h.leave = 1;
+    process_counts(&h.events, &h.ticks);
+    _frame_up(&h);
+
+    if (msg_deadlocked()) {
+        int maxn = (SHARD_MAX_NODES + 2) * 100;
+        msg_wait_t *w = calloc(maxn, sizeof(msg_wait_t));
+        assert(w);
+        h.waits = msg_export_waits(w, maxn);
+        _put(&frame, w, h.waits * sizeof(msg_wait_t));
+        free(w);
+    }
+    memcpy(frame.data, &h, sizeof(h));
+    _exit(_link_write(&up, frame.data, frame.len) ? 0 : 1);
+}
+
+//rows are merged in the order a threaded run prints them: (time, node, pid)
+static long long _row_key(int time, int node, int pid) {
+    return ((long long)time * (SHARD_MAX_NODES + 1) + node) * (1LL << 24) + pid;
+}
+
+//prints the pending rows of processes that finished before watermark
+static void _emit(prio_q_t *pending, int watermark, FILE *fout) {
+    while (!prio_q_empty(pending) && pending->head->priority < _row_key(watermark, 0, 0)) {
+        char *row = prio_q_remove(pending);
+        fputs(row, fout);
+        free(row);
+    }
+}
+
+int shard_coordinate(FILE *fout) {
+    prio_q_t *pending = prio_q_new();
+    buf_t *down = calloc(num_shards, sizeof(buf_t));
+    buf_t *text = calloc(num_shards, sizeof(buf_t));
+    int *busy = calloc(num_shards, sizeof(int));
+    int *stuck = calloc(num_shards, sizeof(int));
+    assert(pending && down && text && busy && stuck);
+
+    long long events = 0;
+    int ticks = 0;
+    int active = num_shards;
+    int tick = 0, matches = 0;
+    int ok = 1;
+
+    while (active > 0 && ok) {
+        for (int s = 0; s < num_shards && ok; s++) {
+            link_t *l = &links[s];
+            if (l->gone) continue;
+
+            up_head_t h;
+            if (!_link_read(l, &h, sizeof(h)) || (h.leave && matches) ||
+                !_read_body(l, h.recs * sizeof(shard_rec_t) + h.text + h.rows + h.waits * sizeof(msg_wait_t))) {
+                fprintf(stderr, "Shard %d (nodes %d-%d) stopped before the end of the run\n", s + 1, l->first, l->last);
+                ok = 0;
+                break;
+            }
+
+            char *p = in.data;
+            for (int i = 0; i < h.recs; i++, p += sizeof(shard_rec_t)) {
+                int to = node_shard[((shard_rec_t *)p)->to / 100];
+                _put(&down[to], p, sizeof(shard_rec_t));
+            }
+            _put(&text[s], p, h.text);
+            p += h.text;
+            for (char *end = p + h.rows; p < end;) {
+                row_head_t *r = (row_head_t *)p;
+                char *row = strndup(p + sizeof(row_head_t), r->len);
+                assert(row);
+                prio_q_add(pending, row, _row_key(r->time, r->node, r->pid));
+                p += sizeof(row_head_t) + r->len;
+            }
+            for (int i = 0; i < h.waits; i++, p += sizeof(msg_wait_t)) {
+                msg_import_wait((msg_wait_t *)p);
+            }
+
+            if (matches) {
+                busy[s] = h.busy;
+                stuck[s] = h.stuck;
+            }
+            if (h.leave) {
+                l->gone = 1;
+                active--;
+                events += h.events;
+                if (h.ticks > ticks) ticks = h.ticks;
+            }
+        }
+        if (!ok) break;
+
+        //the rows of the last tick came with the SENDs of this one; they go before this tick's lines
+        if (!matches) {
+            _emit(pending, tick, fout);
+        }
+        for (int s = 0; s < num_shards; s++) {
+            fwrite(text[s].data, 1, text[s].len, fout);
+            text[s].len = 0;
+        }
+
+        //a shard that left keeps its nodes' last word in the wait-for summary
+        down_head_t d = {0, 0, 0};
+        for (int s = 0; s < num_shards; s++) {
+            d.busy += busy[s];
+            d.stuck += stuck[s];
+        }
+        if (matches) {
+            msg_dl_set(d.busy, d.stuck);
+        }
+        for (int s = 0; s < num_shards && ok; s++) {
+            //a SEND for a shard that has left has no receiver there any more
+            if (!links[s].gone) {
+                d.recs = down[s].len / sizeof(shard_rec_t);
+                frame.len = 0;
+                _put(&frame, &d, sizeof(d));
+                _put(&frame, down[s].data, down[s].len);
+                if (!_link_write(&links[s], frame.data, frame.len)) {
+                    fprintf(stderr, "Shard %d (nodes %d-%d) stopped before the end of the run\n", s + 1,
+                            links[s].first, links[s].last);
+                    ok = 0;
+                }
+            }
+            down[s].len = 0;
+        }
+        tick += matches;
+        matches ^= 1;
+    }
+
+    if (ok) {
+        _emit(pending, INT_MAX, fout);
+        if (msg_deadlocked()) {
+            msg_report_deadlock(fout);
+        }
+        process_add_counts(events, ticks);
+    }
+    for (int s = 0; s < num_shards; s++) {
+        if (!ok && !links[s].gone && !links[s].reaped) {
+            kill(links[s].pid, SIGKILL);
+        }
+        if (!links[s].reaped && waitpid(links[s].pid, &links[s].status, 0) == links[s].pid) {
+            links[s].reaped = 1;
+        }
+        //a shard that sent all of its rows but then failed to exit cleanly still fails the run
+        if (ok && links[s].reaped && !(WIFEXITED(links[s].status) && WEXITSTATUS(links[s].status) == 0)) {
+            fprintf(stderr, "Shard %d (nodes %d-%d) did not exit cleanly\n", s + 1, links[s].first, links[s].last);
+            ok = 0;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,80 @@
+//filename: shard.h
+//Description: sharded runs (prosim -M n). The nodes are split into n blocks of consecutive nodes, each
+//run by its own OS process (a shard) with the usual node threads, so that a run is not bound to one
+//address space and a shard that crashes is reported rather than taking the others with it. The process
+//that read the input stays on as the coordinator: shards only talk to it, over a pair of shared-memory
+//rings each, or over a Unix socket (-M n,sock, or when the rings cannot be mapped).
+//
+//The ticks stay in lockstep through two exchanges a tick, each run by the node thread that completes
+//the shard's barrier while the others are held there:
+//  after Step 2: the SENDs made to receivers on other shards, and the matches made for senders on
+//                other shards. The receiver's shard makes every match; a SEND arriving here is
+//                queued or matched as if it had been made locally (msg_remote_send)
+//  after Step 3: the matches made by those SENDs, and each shard's part of the wait-for summary,
+//                which comes back summed so all shards stop on a deadlock at the same tick
+//Both partners of a rendezvous are then delivered at the same tick as in a threaded run. State lines
+//and summary rows travel with the exchanges and are printed by the coordinator, rows merged in
+//(time, node, pid) order, so the summary is the same as a threaded run's.
+//
+//A frame is a header struct followed by its records and text, in the host's own layout; a socket
+//link is the piece a run spread over several hosts would build on.
+#ifndef PROSIM_SHARD_H
+#define PROSIM_SHARD_H
+
+#include <stdio.h>
+
+//# of shard processes asked for, 0 for a threaded run
+extern int shard_procs;
+
+//non-zero in a shard process
+extern int shard_on;
+
+/* Parses -M n[,sock]
+ * @params:
+ *   arg : # of shards, optionally followed by ,sock to use Unix sockets instead of shared memory
+ * @returns:
+ *   1 on success, 0 on a bad argument (reported on stderr)
+ */
+extern int shard_parse(const char *arg);
+
+/* Starts the shards, after the input has been read (at most one per node)
+ * @params:
+ *   num_nodes   : # of nodes
+ *   first, last : set, in a shard, to the nodes it runs
+ * @returns:
+ *   1 in a shard, 0 in the coordinator, -1 if the shards could not be started (reported on stderr)
+ */
+extern int shard_fork(int num_nodes, int *first, int *last);
+
+/* Runs the coordinator until every shard is done, printing the state lines, the summary rows and
+ * the deadlock report if the run stopped on one
+ * @params:
+ *   fout : output file
+ * @returns:
+ *   1 on success, 0 if a shard died or broke the protocol (reported on stderr)
+ */
+extern int shard_coordinate(FILE *fout);
+
+//true if the address belongs to a node another shard runs
+extern int shard_remote(int addr);
+
+//queues a SEND for another shard's receiver, or a match for another shard's sender, on node by's
+//outbox (by owner thread only; by 0 is the exchange's own)
+extern void shard_send(int by, int sender_addr, int sender_node, int receiver_addr, int tag, int size, int clock_time);
+extern void shard_match(int by, int sender_addr, int deliver);
+
+//a state line printed by node_id (owner thread only)
+extern void shard_line(int node_id, const char *line);
+
+//the summary row of a process that finished at clock_time on node_id (under the summary lock)
+extern void shard_row(int clock_time, int node_id, int pid, const char *row);
+
+//the two exchanges of a tick, passed to barrier_wait_serial by the node threads
+extern void shard_exchange_sends(void);
+extern void shard_exchange_matches(void);
+
+//once the shard's nodes are done: ships its last rows, its counts and, after a deadlock, its
+//wait-for edges to the coordinator, then exits the process
+extern void shard_leave(void);
+
+#endif
@@ -0,0 +1,128 @@
+//filename: steal.c
+//Description: work stealing and process migration between nodes, see steal.h
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "steal.h"
+#include "prio_q.h"
+
+#define STEAL_MAX_NODES 101
+
+typedef struct steal_node {
+    pthread_mutex_t lock;       /* protects inbox */
+    prio_q_t *inbox;            /* processes in transit to this node, by arrival time */
+    int ready;                  /* published ready queue length, with processes in transit */
+    int home;                   /* published # of those that may be given away */
+    int idle;                   /* ticks in a row the published ready length has been 0 */
+    int tick;                   /* tick of the publication, so nodes that left are skipped */
+    int pending;                /* processes announced to this node and not taken yet (owner only) */
+    long long out, in;          /* migrations (owner only) */
+} __attribute__((aligned(64))) steal_node_t;
+
+static steal_node_t nodes[STEAL_MAX_NODES];
+static int cost = 1;
+int steal_on = 0;
+
+//turns work stealing on
+void steal_enable(int migration_cost) {
+    cost = migration_cost > 0 ? migration_cost : 1;
+    for (int i = 0; i < STEAL_MAX_NODES; i++) {
+        pthread_mutex_init(&nodes[i].lock, NULL);
+        nodes[i].inbox = prio_q_new();
+        nodes[i].tick = -1;
+    }
+    steal_on = 1;
+}
+
+//ticks in transit
+int steal_cost(void) {
+    return cost;
+}
+
+//only the owner writes its slot, before the barrier the plan is read after
+void steal_publish(int node_id, int clock_time, int ready, int home) {
+    steal_node_t *n = &nodes[node_id];
+    n->idle = ready ? 0 : n->idle + 1;
+    n->ready = ready;
+    n->home = home;
+    n->tick = clock_time;
+}
+
+/* Every node runs the same computation over the same published numbers, so they agree on the plan
+ * without talking to each other. Thieves are served in node order; each takes from the node that has
+ * the most processes it may give away at that point (the lowest id on ties), as long as that leaves it
+ * at least one. A queue has to stay empty for STEAL_IDLE ticks before its node steals, so one that
+ * empties for a tick between arrivals does not pull work over.
+ */
+int steal_plan(int node_id, int clock_time, int *thieves) {
+    int home[STEAL_MAX_NODES];
+    int n = 0;
+
+    for (int i = 0; i < STEAL_MAX_NODES; i++) {
+        home[i] = nodes[i].tick == clock_time ? nodes[i].home : -1;
+    }
+
+    for (int t = 1; t < STEAL_MAX_NODES; t++) {
+        if (nodes[t].tick != clock_time || nodes[t].ready != 0 || nodes[t].idle < STEAL_IDLE) {
+            continue;
+        }
+        int victim = 0;
+        for (int v = 1; v < STEAL_MAX_NODES; v++) {
+            if (home[v] > home[victim]) victim = v;
+        }
+        if (home[victim] < 2) {
+            break;
+        }
+        home[victim]--;
+
+        if (t == node_id) {
+            nodes[node_id].pending++;
+        }
+        if (victim == node_id && n < STEAL_MAX_THIEVES) {
+            thieves[n++] = t;
+            nodes[node_id].out++;
+        }
+    }
+    return n;
+}
+
+//called by the victim between the last barrier of a tick and the first of the next
+void steal_give(int thief, context *proc, int arrive_time) {
+    pthread_mutex_lock(&nodes[thief].lock);
+    prio_q_add(nodes[thief].inbox, proc, arrive_time);
+    pthread_mutex_unlock(&nodes[thief].lock);
+}
+
+//called by the thief after the first barrier, when every give of the previous tick is done
+context *steal_take(int node_id, int clock_time) {
+    steal_node_t *n = &nodes[node_id];
+    context *proc = NULL;
+
+    pthread_mutex_lock(&n->lock);
+    if (!prio_q_empty(n->inbox)) {
+        //the priority of the head is its arrival time
+        if (n->inbox->head->priority <= clock_time) {
+            proc = prio_q_remove(n->inbox);
+        }
+    }
+    pthread_mutex_unlock(&n->lock);
+
+    if (proc) {
+        n->pending--;
+        n->in++;
+    }
+    return proc;
+}
+
+//processes announced to this node that have not arrived yet
+int steal_pending(int node_id) {
+    return nodes[node_id].pending;
+}
+
+//migration counts, read after the run
+void steal_counts(int node_id, long long *out, long long *in) {
+    *out = nodes[node_id].out;
+    *in = nodes[node_id].in;
+}
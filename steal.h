@@ -0,0 +1,57 @@
+//filename: steal.h
+//Description: work stealing between nodes. At the end of every tick each node publishes the length of
+//its ready queue; after the last barrier all nodes derive the same plan from those numbers, in which
+//every node whose ready queue has been empty for STEAL_IDLE ticks takes one READY process from the
+//node with the most processes left to give. Stolen processes are in transit for the migration cost and
+//then join the thief's ready queue, keeping their node and pid; they are never stolen again, so a
+//process cannot go back to where it came from or bounce between nodes.
+#ifndef PROSIM_STEAL_H
+#define PROSIM_STEAL_H
+
+#include "context.h"
+
+#define STEAL_MAX_THIEVES 100
+#define STEAL_IDLE        2         /* ticks a ready queue must stay empty before its node steals */
+
+//non-zero when work stealing is on
+extern int steal_on;
+
+//turns work stealing on, with processes taking cost ticks (at least 1) to move between nodes
+extern void steal_enable(int cost);
+
+//ticks a migrating process is in transit
+extern int steal_cost(void);
+
+/* Publishes the node's load for this tick (called before the last barrier)
+ * @params:
+ *   node_id    : calling node
+ *   clock_time : current tick
+ *   ready      : ready queue length, counting the processes on their way to the node
+ *   home       : ready processes that were never stolen (a lower bound is enough)
+ */
+extern void steal_publish(int node_id, int clock_time, int ready, int home);
+
+/* Works out this tick's plan (called by every node after the last barrier)
+ * A node that will receive a process counts it as pending work from now on.
+ * @params:
+ *   node_id    : calling node
+ *   clock_time : current tick
+ *   thieves    : filled with the nodes this node gives one process each, in order
+ * @returns:
+ *   # of processes this node has to give away
+ */
+extern int steal_plan(int node_id, int clock_time, int *thieves);
+
+//hands a process to a thief; it arrives at arrive_time
+extern void steal_give(int thief, context *proc, int arrive_time);
+
+//next process that has arrived at this node by clock_time, or NULL
+extern context *steal_take(int node_id, int clock_time);
+
+//# of processes on their way to this node
+extern int steal_pending(int node_id);
+
+//# of processes that left and joined a node
+extern void steal_counts(int node_id, long long *out, long long *in);
+
+#endif
@@ -4,7 +4,18 @@ export LC_ALL=C
 echo ======================================================
 echo ====================== TEST $1 =======================
 echo ======================================================
-if timeout 10 ./$2/$3 < tests/test.$1.in > tests/test.$1.raw; then 
+# optional simulator arguments come from an ARGS: line in the cfg file; a RUN: line gives a whole
+# shell command to run instead (other tools, output files), with $D set to the build directory
+ARGS=$(sed -n 's/^ARGS://p' tests/test.$1.cfg)
+RUN=$(sed -n 's/^RUN://p' tests/test.$1.cfg)
+run() {
+  if [ -n "$RUN" ]; then
+    D=./$2 timeout 10 sh -c "$RUN" < tests/test.$1.in
+  else
+    timeout 10 ./$2/$3 $ARGS < tests/test.$1.in
+  fi
+}
+if run $1 $2 $3 > tests/test.$1.raw; then 
   cat tests/test.$1.raw | sort > tests/test.$1.out
   if diff -b tests/test.$1.out tests/test.$1.expected > /dev/null; then
     if grep "IS_CONCURRENT" tests/test.$1.cfg > /dev/null; then
@@ -16,7 +27,7 @@ if timeout 10 ./$2/$3 < tests/test.$1.in > tests/test.$1.raw; then
             exit 1
           else 
             echo RETRYING: Output is correct, but no concurrency is apparent
-            timeout 10 ./$2/$3 < tests/test.$1.in > tests/test.$1.raw
+            run $1 $2 $3 > tests/test.$1.raw
           fi
         else 
           break
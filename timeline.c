@@ -0,0 +1,112 @@
+//filename: timeline.c
+//Description: Chrome/Perfetto trace-event export, see timeline.h
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "timeline.h"
+
+#define TIMELINE_MAX_NODES 101
+#define TIMELINE_BUF       (64 * 1024)
+#define TIMELINE_EVENT_MAX 256          /* longest possible event */
+
+typedef struct timeline_node {
+    char buf[TIMELINE_BUF];     /* formatted events not written yet */
+    int len;                    /* bytes used in buf */
+} __attribute__((aligned(64))) timeline_node_t;
+
+static timeline_node_t nodes[TIMELINE_MAX_NODES];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *out;
+int timeline_on = 0;
+
+//makes room for one more event in the node's buffer
+static char *_reserve(int node_id) {
+    timeline_node_t *n = &nodes[node_id];
+    if (n->len + TIMELINE_EVENT_MAX > TIMELINE_BUF) {
+        timeline_flush(node_id);
+    }
+    return n->buf + n->len;
+}
+
+//opens the file; the header already holds the node names, so every later event starts with a comma
+int timeline_open(const char *path, int num_nodes) {
+    if (num_nodes < 1) {
+        return 0;
+    }
+    out = fopen(path, "w");
+    if (!out) {
+        return 0;
+    }
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", out);
+    for (int i = 1; i <= num_nodes; i++) {
+        fprintf(out, "%s{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"args\":{\"name\":\"node %2.2d\"}}",
+                i > 1 ? ",\n" : "", i, i);
+        fprintf(out, ",\n{\"ph\":\"M\",\"name\":\"process_sort_index\",\"pid\":%d,\"args\":{\"sort_index\":%d}}", i, i);
+    }
+
+    timeline_on = 1;
+    return 1;
+}
+
+//thread name and sort order for the process' track
+void timeline_process(int node_id, int pid, const char *name) {
+    char *p = _reserve(node_id);
+    char safe[32];
+    int i;
+
+    //program names come from the input, keep only what needs no escaping
+    for (i = 0; name[i] && i < (int)sizeof(safe) - 1; i++) {
+        safe[i] = (name[i] == '"' || name[i] == '\\' || name[i] < ' ') ? '_' : name[i];
+    }
+    safe[i] = '\0';
+
+    nodes[node_id].len += snprintf(p, TIMELINE_EVENT_MAX,
+        ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%d %s\"}}"
+        ",\n{\"ph\":\"M\",\"name\":\"thread_sort_index\",\"pid\":%d,\"tid\":%d,\"args\":{\"sort_index\":%d}}",
+        node_id, pid, pid, safe, node_id, pid, pid);
+}
+
+//a complete ("X") event for one state interval
+void timeline_slice(int node_id, int pid, const char *state, int start, int end) {
+    char *p = _reserve(node_id);
+    nodes[node_id].len += snprintf(p, TIMELINE_EVENT_MAX,
+        ",\n{\"ph\":\"X\",\"name\":\"%s\",\"cat\":\"state\",\"pid\":%d,\"tid\":%d,\"ts\":%d,\"dur\":%d}",
+        state, node_id, pid, start, end - start);
+}
+
+//a flow start on the sender's track and its end on the receiver's, both bound to the enclosing slices.
+//a sender is in one rendezvous at a time, so its address and the tick name the flow whichever node
+//made the match
+void timeline_flow(int node_id, int clock_time, int arrive_time, int sender_addr, int receiver_addr) {
+    char *p = _reserve(node_id);
+    long long id = (long long)sender_addr << 32 | (unsigned)clock_time;
+
+    nodes[node_id].len += snprintf(p, TIMELINE_EVENT_MAX,
+        ",\n{\"ph\":\"s\",\"name\":\"message\",\"cat\":\"msg\",\"id\":%lld,\"pid\":%d,\"tid\":%d,\"ts\":%d}"
+        ",\n{\"ph\":\"f\",\"bp\":\"e\",\"name\":\"message\",\"cat\":\"msg\",\"id\":%lld,\"pid\":%d,\"tid\":%d,\"ts\":%d}",
+        id, sender_addr / 100, sender_addr % 100, clock_time,
+        id, receiver_addr / 100, receiver_addr % 100, arrive_time);
+}
+
+//appends the node's buffer to the file
+void timeline_flush(int node_id) {
+    timeline_node_t *n = &nodes[node_id];
+    if (!out || n->len == 0) {
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    fwrite(n->buf, 1, n->len, out);
+    pthread_mutex_unlock(&lock);
+    n->len = 0;
+}
+
+//closes the file once every node has flushed
+void timeline_close(void) {
+    if (out) {
+        fputs("\n]}\n", out);
+        fclose(out);
+        out = NULL;
+    }
+}
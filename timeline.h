@@ -0,0 +1,33 @@
+//filename: timeline.h
+//Description: Chrome/Perfetto trace-event JSON export (open in ui.perfetto.dev or chrome://tracing).
+//Each node is a process in the viewer and each simulated process a thread under it, with one slice per
+//state interval and a flow arrow from sender to receiver at every SEND/RECV rendezvous.
+//One tick is shown as one microsecond. Events are formatted into per-node buffers and appended to the
+//file in blocks, so memory use does not grow with the length of the run.
+#ifndef PROSIM_TIMELINE_H
+#define PROSIM_TIMELINE_H
+
+//non-zero when the export is on
+extern int timeline_on;
+
+//opens the output file and writes the header and node names. returns 0 if the file cannot be opened
+extern int timeline_open(const char *path, int num_nodes);
+
+//names the track of a newly admitted process
+extern void timeline_process(int node_id, int pid, const char *name);
+
+//records that process pid on node_id was in state from start to end (end > start)
+extern void timeline_slice(int node_id, int pid, const char *state, int start, int end);
+
+//records a rendezvous at clock_time between the sender and receiver addresses (node*100 + pid),
+//arriving at arrive_time (the same tick unless the interconnect model delays it);
+//written by the node of the process that completed it
+extern void timeline_flow(int node_id, int clock_time, int arrive_time, int sender_addr, int receiver_addr);
+
+//writes out whatever the node still has buffered
+extern void timeline_flush(int node_id);
+
+//terminates the JSON and closes the file
+extern void timeline_close(void);
+
+#endif
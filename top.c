@@ -0,0 +1,131 @@
+//filename: top.c
+//Description: prosim-top, a live view of a simulation started with prosim -S name (see live.h).
+//It maps the segment read-only and redraws one line per node every interval: clock, ticks per second
+//since the last redraw, busy cores, ready, blocked and message-blocked processes, processes finished
+//and messages received. It exits with a last redraw once the simulation ends, or after one redraw with -1.
+//
+//usage: prosim-top [-i interval ms] [-1] name
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "live.h"
+
+/* Copies a node's gauges under its seqlock
+ * @params:
+ *   n   : the node's slot in the segment
+ *   out : where the gauges go
+ * @returns:
+ *   non-zero if the node has left; retries until it gets a copy no write overlapped
+ */
+static int _read_node(const live_node_t *n, live_gauges_t *out) {
+    const long long *src = (const long long *)&n->g;
+    long long *dst = (long long *)out;
+    for (;;) {
+        unsigned before = __atomic_load_n(&n->seq, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            continue;
+        }
+        for (size_t i = 0; i < LIVE_WORDS; i++) {
+            dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+        }
+        int done = __atomic_load_n(&n->done, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&n->seq, __ATOMIC_RELAXED) == before) {
+            return done;
+        }
+    }
+}
+
+static double _now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-i interval ms] [-1] name\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int interval = 1000;
+    int once = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:1")) != -1) {
+        switch (opt) {
+            case 'i':
+                interval = atoi(optarg);
+                if (interval <= 0) _usage(argv[0]);
+                break;
+            case '1':
+                once = 1;
+                break;
+            default:
+                _usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1) {
+        _usage(argv[0]);
+    }
+
+    const char *name = argv[optind];
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        perror(name);
+        return 1;
+    }
+    const live_segment_t *seg = mmap(NULL, sizeof(live_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg == MAP_FAILED) {
+        perror(name);
+        return 1;
+    }
+    if (__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) != LIVE_MAGIC || seg->version != LIVE_VERSION) {
+        fprintf(stderr, "%s is not a prosim gauge segment of version %d\n", name, LIVE_VERSION);
+        return 1;
+    }
+
+    int num_nodes = seg->num_nodes;
+    live_gauges_t prev[LIVE_MAX_NODES], cur;
+    double prev_time = _now();
+    for (int i = 1; i <= num_nodes; i++) {
+        _read_node(&seg->node[i], &prev[i]);
+    }
+
+    for (;;) {
+        usleep(interval * 1000);
+        int ended = __atomic_load_n(&seg->done, __ATOMIC_ACQUIRE);
+        double now = _now(), secs = now - prev_time;
+
+        if (!once) {
+            printf("\033[H\033[J");
+        }
+        printf("%s%s\n", name, ended ? " (ended)" : "");
+        printf("node %10s %12s %5s %7s %7s %7s %9s %10s\n",
+               "clock", "ticks/s", "busy", "ready", "blocked", "msg", "finished", "received");
+        long long finished = 0, received = 0;
+        for (int i = 1; i <= num_nodes; i++) {
+            int done = _read_node(&seg->node[i], &cur);
+            printf("%4d %10lld %12.1f %5lld %7lld %7lld %7lld %9lld %10lld%s\n", i, cur.clock_time,
+                   (cur.clock_time - prev[i].clock_time) / secs, cur.running, cur.ready, cur.blocked,
+                   cur.msg_wait, cur.finished, cur.matched, done ? "  done" : "");
+            finished += cur.finished;
+            received += cur.matched;
+            prev[i] = cur;
+        }
+        printf("all  %10s %12s %5s %7s %7s %7s %9lld %10lld\n", "", "", "", "", "", "", finished, received);
+        fflush(stdout);
+        prev_time = now;
+
+        if (once || ended) {
+            break;
+        }
+    }
+    return 0;
+}
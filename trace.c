@@ -0,0 +1,109 @@
+//filename: trace.c
+//Description: writer for the binary process trace, see trace.h
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+#define TRACE_MAX_NODES 101
+#define TRACE_REC_MAX   11              /* two 5 byte varints and the state byte */
+
+typedef struct trace_node {
+    unsigned char buf[TRACE_BLOCK];     /* payload of the block being built */
+    int len;                            /* bytes used in buf */
+    int count;                          /* records in buf */
+    int first_time;                     /* time of the first record in buf */
+    int last_time;                      /* time of the last record in buf */
+} __attribute__((aligned(64))) trace_node_t;
+
+static trace_node_t nodes[TRACE_MAX_NODES];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *out;
+int trace_binary = 0;
+
+//LEB128 encoding, returns the new end
+static unsigned char *_varint(unsigned char *p, unsigned v) {
+    while (v >= 0x80) {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+//opens the file and writes the header
+int trace_open(const char *path, char **state_names, int num_states) {
+    unsigned char hdr[16];
+
+    out = fopen(path, "wb");
+    if (!out) {
+        return 0;
+    }
+
+    fwrite(TRACE_MAGIC, 1, 4, out);
+    fputc(TRACE_VERSION, out);
+    fwrite(hdr, 1, _varint(hdr, num_states) - hdr, out);
+    for (int i = 0; i < num_states; i++) {
+        int len = (int)strlen(state_names[i]);
+        fwrite(hdr, 1, _varint(hdr, len) - hdr, out);
+        fwrite(state_names[i], 1, len, out);
+    }
+
+    trace_binary = 1;
+    return 1;
+}
+
+//appends one record to the node's block, flushing first if it might not fit
+void trace_event(int node_id, int clock_time, int pid, int state) {
+    trace_node_t *n = &nodes[node_id];
+    if (n->len + TRACE_REC_MAX > TRACE_BLOCK) {
+        trace_flush(node_id);
+    }
+    if (n->count == 0) {
+        n->first_time = n->last_time = clock_time;
+    }
+
+    unsigned char *p = n->buf + n->len;
+    p = _varint(p, (unsigned)(clock_time - n->last_time));
+    p = _varint(p, (unsigned)pid);
+    *p++ = (unsigned char)state;
+
+    n->len = (int)(p - n->buf);
+    n->count++;
+    n->last_time = clock_time;
+}
+
+//writes the node's block with its header in one go
+void trace_flush(int node_id) {
+    trace_node_t *n = &nodes[node_id];
+    unsigned char hdr[32];
+
+    if (!out || n->count == 0) {
+        return;
+    }
+
+    unsigned char *p = hdr;
+    *p++ = 'B';
+    p = _varint(p, (unsigned)node_id);
+    p = _varint(p, (unsigned)n->first_time);
+    p = _varint(p, (unsigned)n->count);
+    p = _varint(p, (unsigned)n->len);
+
+    pthread_mutex_lock(&lock);
+    fwrite(hdr, 1, p - hdr, out);
+    fwrite(n->buf, 1, n->len, out);
+    pthread_mutex_unlock(&lock);
+
+    n->len = 0;
+    n->count = 0;
+}
+
+//closes the file once every node has flushed
+void trace_close(void) {
+    if (out) {
+        fclose(out);
+        out = NULL;
+    }
+}
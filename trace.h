@@ -0,0 +1,32 @@
+//filename: trace.h
+//Description: compact binary process trace. Instead of one formatted line per state change, each node
+//appends (time delta, pid, state) records as varints to its own buffer and writes the buffer out as one
+//block. prosim-trace (tracedump.c) decodes, filters and turns it back into the textual trace.
+//
+//File layout:  "PSTR" version(1) varint(#states) { varint(len) name }...
+//              then blocks: 'B' varint(node) varint(first time) varint(#records) varint(payload bytes)
+//              payload: { varint(time - previous time) varint(pid) byte(state) }...
+//Blocks of one node appear in time order; blocks of different nodes are interleaved.
+#ifndef PROSIM_TRACE_H
+#define PROSIM_TRACE_H
+
+#define TRACE_MAGIC    "PSTR"
+#define TRACE_VERSION  1
+#define TRACE_BLOCK    (64 * 1024)
+
+//non-zero when state changes go to the binary trace instead of the textual one
+extern int trace_binary;
+
+//opens the binary trace and writes the header with the state names. returns 0 on failure
+extern int trace_open(const char *path, char **state_names, int num_states);
+
+//records a state change of process pid on node at clock_time
+extern void trace_event(int node_id, int clock_time, int pid, int state);
+
+//writes out whatever the node still has buffered
+extern void trace_flush(int node_id);
+
+//closes the binary trace
+extern void trace_close(void);
+
+#endif
@@ -0,0 +1,363 @@
+//filename: tracedump.c
+//Description: prosim-trace, the decoder for binary traces written by prosim -b (see trace.h).
+//It filters by node, pid, state and time range and prints the canonical textual trace:
+//by default in the order `sort` gives the textual output (node, time, then line text),
+//or with -c in time order, merging the nodes' blocks.
+//
+//usage: prosim-trace [-n node] [-p pid] [-s state] [-f from] [-u until] [-c] trace.bin
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+#define MAX_STATES 64
+
+typedef struct block {
+    int node;                   /* node that wrote the block */
+    int first_time;             /* time of the first record */
+    int count;                  /* # of records */
+    int len;                    /* payload bytes */
+    const unsigned char *data;  /* payload */
+    long order;                 /* position in the file, to keep a node's blocks in time order */
+} block_t;
+
+typedef struct cursor {
+    block_t **blocks;           /* this node's blocks in time order */
+    int nblocks;
+    int cur;                    /* current block */
+    int left;                   /* records left in the current block */
+    const unsigned char *p;     /* next record */
+    int time;                   /* time of the last record decoded */
+    int node;
+} cursor_t;
+
+typedef struct filter {
+    int node, pid, state;       /* -1 = any */
+    int from, until;
+} filter_t;
+
+static char *states[MAX_STATES];
+static int num_states;
+
+static char outbuf[1 << 16];
+static int outlen;
+
+//LEB128 decoding
+static const unsigned char *_varint(const unsigned char *p, const unsigned char *end, unsigned *v) {
+    unsigned r = 0;
+    int shift = 0;
+    while (p < end) {
+        unsigned char b = *p++;
+        r |= (unsigned)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = r;
+            return p;
+        }
+        shift += 7;
+    }
+    fprintf(stderr, "Truncated trace\n");
+    exit(1);
+}
+
+static void _flush_out(void) {
+    fwrite(outbuf, 1, outlen, stdout);
+    outlen = 0;
+}
+
+//appends v with at least width digits (zero padded)
+static char *_put(char *p, int v, int width) {
+    char tmp[12];
+    int n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n < width) tmp[n++] = '0';
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+//formats the "process P state" part of a line, which is what `sort` compares within one node and time
+static int _format_tail(char *p, int pid, int state) {
+    char *s = p;
+    memcpy(p, "process ", 8);
+    p = _put(p + 8, pid, 1);
+    *p++ = ' ';
+    const char *name = state < num_states ? states[state] : "?";
+    size_t l = strlen(name);
+    memcpy(p, name, l);
+    p += l;
+    *p = '\0';
+    return (int)(p - s);
+}
+
+static int _cmp_str(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int _cmp_block(const void *a, const void *b) {
+    const block_t *x = *(block_t * const *)a, *y = *(block_t * const *)b;
+    if (x->node != y->node) return x->node < y->node ? -1 : 1;
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+//moves the cursor to its next record, crossing into the next block as needed. returns 0 at the end
+static int _next(cursor_t *c, unsigned *pid, unsigned *state) {
+    while (c->left == 0) {
+        if (++c->cur >= c->nblocks) {
+            return 0;
+        }
+        block_t *b = c->blocks[c->cur];
+        c->left = b->count;
+        c->p = b->data;
+        c->time = b->first_time;
+    }
+
+    const unsigned char *end = c->blocks[c->cur]->data + c->blocks[c->cur]->len;
+    unsigned dt;
+    c->p = _varint(c->p, end, &dt);
+    c->p = _varint(c->p, end, pid);
+    if (c->p >= end) {
+        fprintf(stderr, "Truncated trace\n");
+        exit(1);
+    }
+    *state = *c->p++;
+    c->time += (int)dt;
+    c->left--;
+    return 1;
+}
+
+/* Prints every record of the cursor's node at its current time (the record just decoded and the ones
+ * after it with the same time) in `sort` order, then leaves the cursor on the first later record.
+ * @returns:
+ *   1 if the cursor has a pending record after this group, 0 if the node is exhausted
+ */
+static int _emit_group(cursor_t *c, unsigned pid, unsigned state, filter_t *f,
+                       char ***lines, int *cap, unsigned *next_pid, unsigned *next_state) {
+    int time = c->time;
+    int n = 0;
+    int more;
+
+    for (;;) {
+        if ((f->pid < 0 || (int)pid == f->pid) && (f->state < 0 || (int)state == f->state) &&
+            time >= f->from && time <= f->until) {
+            if (n == *cap) {
+                *cap = *cap ? 2 * *cap : 64;
+                *lines = realloc(*lines, *cap * sizeof(char *));
+                for (int i = n; i < *cap; i++) (*lines)[i] = malloc(96);
+            }
+            _format_tail((*lines)[n++], (int)pid, (int)state);
+        }
+        more = _next(c, &pid, &state);
+        if (!more || c->time != time) {
+            break;
+        }
+    }
+
+    if (n > 1) {
+        qsort(*lines, n, sizeof(char *), _cmp_str);
+    }
+    for (int i = 0; i < n; i++) {
+        if (outlen > (int)sizeof(outbuf) - 128) {
+            _flush_out();
+        }
+        char *p = outbuf + outlen;
+        *p++ = '[';
+        p = _put(p, c->node, 2);
+        *p++ = ']';
+        *p++ = ' ';
+        p = _put(p, time, 5);
+        *p++ = ':';
+        *p++ = ' ';
+        size_t l = strlen((*lines)[i]);
+        memcpy(p, (*lines)[i], l);
+        p += l;
+        *p++ = '\n';
+        outlen = (int)(p - outbuf);
+    }
+
+    *next_pid = pid;
+    *next_state = state;
+    return more;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-n node] [-p pid] [-s state] [-f from] [-u until] [-c] trace.bin\n", prog);
+}
+
+/* Main line
+ * @params:
+ *   command line options, see usage()
+ * @returns:
+ *   0 on success
+ */
+int main(int argc, char **argv) {
+    filter_t f = { -1, -1, -1, 0, 0x7fffffff };
+    const char *state_name = NULL;
+    int chrono = 0;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:p:s:f:u:c")) != -1) {
+        switch (c) {
+            case 'n': f.node = atoi(optarg); break;
+            case 'p': f.pid = atoi(optarg); break;
+            case 's': state_name = optarg; break;
+            case 'f': f.from = atoi(optarg); break;
+            case 'u': f.until = atoi(optarg); break;
+            case 'c': chrono = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* Map the whole trace, blocks are decoded in place
+     */
+    int fd = open(argv[optind], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(argv[optind]);
+        return 1;
+    }
+    if (st.st_size < 5) {
+        fprintf(stderr, "Not a prosim trace\n");
+        return 1;
+    }
+    const unsigned char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    const unsigned char *end = data + st.st_size;
+
+    if (memcmp(data, TRACE_MAGIC, 4) || data[4] != TRACE_VERSION) {
+        fprintf(stderr, "Not a prosim trace (or wrong version)\n");
+        return 1;
+    }
+
+    /* Header: the state names, so traces stay readable if states are added
+     */
+    const unsigned char *p = data + 5;
+    unsigned v;
+    p = _varint(p, end, &v);
+    num_states = (int)v;
+    if (num_states > MAX_STATES) {
+        fprintf(stderr, "Bad trace header\n");
+        return 1;
+    }
+    for (int i = 0; i < num_states; i++) {
+        p = _varint(p, end, &v);
+        if (p + v > end) {
+            fprintf(stderr, "Truncated trace\n");
+            return 1;
+        }
+        states[i] = strndup((const char *)p, v);
+        p += v;
+        if (state_name && !strcmp(state_name, states[i])) {
+            f.state = i;
+        }
+    }
+    if (state_name && f.state < 0) {
+        fprintf(stderr, "Unknown state %s\n", state_name);
+        return 1;
+    }
+
+    /* Index the blocks, skipping nodes that are filtered out
+     */
+    int nblocks = 0, cap = 0, max_node = 0;
+    block_t *blocks = NULL;
+    while (p < end) {
+        if (*p++ != 'B') {
+            fprintf(stderr, "Corrupt trace at offset %ld\n", (long)(p - 1 - data));
+            return 1;
+        }
+        block_t b;
+        p = _varint(p, end, &v); b.node = (int)v;
+        p = _varint(p, end, &v); b.first_time = (int)v;
+        p = _varint(p, end, &v); b.count = (int)v;
+        p = _varint(p, end, &v); b.len = (int)v;
+        if (p + b.len > end) {
+            fprintf(stderr, "Truncated trace\n");
+            return 1;
+        }
+        b.data = p;
+        b.order = nblocks;
+        p += b.len;
+
+        if (f.node >= 0 && b.node != f.node) continue;
+        if (nblocks == cap) {
+            cap = cap ? 2 * cap : 256;
+            blocks = realloc(blocks, cap * sizeof(block_t));
+        }
+        blocks[nblocks++] = b;
+        if (b.node > max_node) max_node = b.node;
+    }
+
+    /* One cursor per node over its blocks in file (= time) order
+     */
+    block_t **sorted = malloc((nblocks + 1) * sizeof(block_t *));
+    for (int i = 0; i < nblocks; i++) sorted[i] = &blocks[i];
+    qsort(sorted, nblocks, sizeof(block_t *), _cmp_block);
+
+    cursor_t *cursors = calloc(max_node + 1, sizeof(cursor_t));
+    int ncursors = 0;
+    for (int i = 0; i < nblocks; ) {
+        int j = i;
+        while (j < nblocks && sorted[j]->node == sorted[i]->node) j++;
+        cursor_t *cu = &cursors[ncursors++];
+        cu->blocks = &sorted[i];
+        cu->nblocks = j - i;
+        cu->cur = -1;
+        cu->node = sorted[i]->node;
+        i = j;
+    }
+
+    char **lines = NULL;
+    int lines_cap = 0;
+    unsigned *pid = calloc(ncursors + 1, sizeof(unsigned));
+    unsigned *state = calloc(ncursors + 1, sizeof(unsigned));
+    int *live = calloc(ncursors + 1, sizeof(int));
+
+    for (int i = 0; i < ncursors; i++) {
+        live[i] = _next(&cursors[i], &pid[i], &state[i]);
+    }
+
+    if (!chrono) {
+        /* sort order: node by node, time groups within a node
+         */
+        for (int i = 0; i < ncursors; i++) {
+            while (live[i] && cursors[i].time <= f.until) {
+                live[i] = _emit_group(&cursors[i], pid[i], state[i], &f, &lines, &lines_cap, &pid[i], &state[i]);
+            }
+        }
+    } else {
+        /* time order: repeatedly take the node with the earliest pending time (ties by node id).
+         * A linear scan over the nodes is enough, there are at most 100 of them.
+         */
+        for (;;) {
+            int best = -1;
+            for (int i = 0; i < ncursors; i++) {
+                if (live[i] && cursors[i].time <= f.until &&
+                    (best < 0 || cursors[i].time < cursors[best].time)) {
+                    best = i;
+                }
+            }
+            if (best < 0) break;
+            live[best] = _emit_group(&cursors[best], pid[best], state[best], &f, &lines, &lines_cap,
+                                     &pid[best], &state[best]);
+        }
+    }
+
+    _flush_out();
+    munmap((void *)data, st.st_size);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,127 @@
+//filename: vtick.c
+//Description: the tick kernel, see vtick.h. The AVX2 version is compiled for that target alone and picked
+//at run time, so the binary still runs on hosts without it; SSE2 is part of x86-64 and covers the rest.
+//PROSIM_VTICK=scalar or sse2 in the environment caps the version picked, so each can be tested on any host.
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "vtick.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VTICK_X86
+#include <immintrin.h>
+#endif
+
+typedef int (*vtick_fn)(int *, int *, const int *, const int *, int, int *);
+
+static pthread_once_t chosen = PTHREAD_ONCE_INIT;
+static vtick_fn run;
+
+//pads n up to a whole number of vectors
+static int _padded(int n) {
+    return (n + VTICK_WIDTH - 1) / VTICK_WIDTH * VTICK_WIDTH;
+}
+
+//one core at a time, for hosts without vector units and as the reference for the others
+static int _run_scalar(int *left, int *slice, const int *lane, const int *busy, int n, int *attn) {
+    int m = 0;
+    for (int k = 0; k < n; k++) {
+        if (lane[k]) {
+            left[k]--;
+            slice[k]--;
+            if (left[k] == 0 || slice[k] == 0) {
+                attn[m++] = k;
+            }
+        } else if (busy[k]) {
+            attn[m++] = k;
+        }
+    }
+    return m;
+}
+
+#ifdef VTICK_X86
+/* Lanes hold -1, so adding them counts the lane's counters down and leaves the other cores alone;
+ * a core needs attention if its lane hit zero on either counter, or it is busy off the lanes
+ */
+#ifdef __SSE2__
+static int _run_sse2(int *left, int *slice, const int *lane, const int *busy, int n, int *attn) {
+    const __m128i zero = _mm_setzero_si128();
+    int m = 0;
+    for (int k = 0; k < n; k += 4) {
+        __m128i on = _mm_load_si128((const __m128i *)(lane + k));
+        __m128i l = _mm_add_epi32(_mm_load_si128((__m128i *)(left + k)), on);
+        __m128i s = _mm_add_epi32(_mm_load_si128((__m128i *)(slice + k)), on);
+        _mm_store_si128((__m128i *)(left + k), l);
+        _mm_store_si128((__m128i *)(slice + k), s);
+
+        __m128i done = _mm_or_si128(_mm_cmpeq_epi32(l, zero), _mm_cmpeq_epi32(s, zero));
+        __m128i need = _mm_or_si128(_mm_and_si128(on, done),
+                                    _mm_andnot_si128(on, _mm_load_si128((const __m128i *)(busy + k))));
+        for (unsigned bits = _mm_movemask_ps(_mm_castsi128_ps(need)); bits; bits &= bits - 1) {
+            attn[m++] = k + __builtin_ctz(bits);
+        }
+    }
+    return m;
+}
+#endif
+
+__attribute__((target("avx2")))
+static int _run_avx2(int *left, int *slice, const int *lane, const int *busy, int n, int *attn) {
+    const __m256i zero = _mm256_setzero_si256();
+    int m = 0;
+    for (int k = 0; k < n; k += 8) {
+        __m256i on = _mm256_load_si256((const __m256i *)(lane + k));
+        __m256i l = _mm256_add_epi32(_mm256_load_si256((__m256i *)(left + k)), on);
+        __m256i s = _mm256_add_epi32(_mm256_load_si256((__m256i *)(slice + k)), on);
+        _mm256_store_si256((__m256i *)(left + k), l);
+        _mm256_store_si256((__m256i *)(slice + k), s);
+
+        __m256i done = _mm256_or_si256(_mm256_cmpeq_epi32(l, zero), _mm256_cmpeq_epi32(s, zero));
+        __m256i need = _mm256_or_si256(_mm256_and_si256(on, done),
+                                       _mm256_andnot_si256(on, _mm256_load_si256((const __m256i *)(busy + k))));
+        for (unsigned bits = _mm256_movemask_ps(_mm256_castsi256_ps(need)); bits; bits &= bits - 1) {
+            attn[m++] = k + __builtin_ctz(bits);
+        }
+    }
+    return m;
+}
+#endif
+
+//the widest version the host runs, up to the one PROSIM_VTICK names
+static void _choose(void) {
+    const char *cap = getenv("PROSIM_VTICK");
+    run = _run_scalar;
+    if (cap && !strcmp(cap, "scalar")) {
+        return;
+    }
+#ifdef VTICK_X86
+#ifdef __SSE2__
+    run = _run_sse2;
+#endif
+    if (cap && !strcmp(cap, "sse2")) {
+        return;
+    }
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        run = _run_avx2;
+    }
+#endif
+}
+
+//32 byte aligned, for the AVX2 loads
+int *vtick_alloc(int n) {
+    pthread_once(&chosen, _choose);
+    size_t bytes = _padded(n) * sizeof(int);
+    int *a = aligned_alloc(32, bytes);
+    assert(a);
+    memset(a, 0, bytes);
+    return a;
+}
+
+//the padding lanes are idle, so whole vectors can be run
+int vtick_run(int *left, int *slice, const int *lane, const int *busy, int n, int *attn) {
+    return run(left, slice, lane, busy, _padded(n), attn);
+}
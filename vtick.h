@@ -0,0 +1,36 @@
+//filename: vtick.h
+//Description: the tick kernel for cores running a DOOP. A core whose process is in the middle of a DOOP
+//(past its dispatch overhead, not being preempted, under a policy with no per-tick work) only counts its
+//DOOP and its quantum down each tick. Those counters are kept per node in structure-of-arrays form, one
+//int per core, and advanced together with AVX2 or SSE2 where the host has them (scalar otherwise); only
+//the cores that need more than that come back to the scalar code in process.c.
+//
+//The arrays are allocated with vtick_alloc and padded with idle lanes, so the kernel never needs a tail loop.
+#ifndef PROSIM_VTICK_H
+#define PROSIM_VTICK_H
+
+#define VTICK_WIDTH 8               /* ints per AVX2 vector; arrays are padded to a multiple */
+
+/* Allocates a zeroed, vector aligned array for n cores
+ * @params:
+ *   n : # of cores
+ * @returns:
+ *   pointer to the array, n rounded up to VTICK_WIDTH ints
+ */
+extern int *vtick_alloc(int n);
+
+/* Advances every lane by a tick and lists the cores that need the scalar path
+ * @params:
+ *   left  : DOOP ticks left per core, counted down on lanes
+ *   slice : quantum ticks left per core, counted down on lanes
+ *   lane  : -1 for a core the kernel advances, 0 otherwise
+ *   busy  : -1 for a core that has a process, 0 otherwise
+ *   n     : # of cores
+ *   attn  : set to the cores, in ascending order, that are busy but not on a lane, or whose lane reached
+ *           the end of its DOOP or quantum
+ * @returns:
+ *   # of cores written to attn
+ */
+extern int vtick_run(int *left, int *slice, const int *lane, const int *busy, int n, int *attn);
+
+#endif